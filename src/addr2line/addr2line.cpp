@@ -39,6 +39,7 @@
 #include <getoptW.h>
 
 #include "symbols.h"
+#include "mgwhelp.h"
 #include "wine.h"
 
 
@@ -57,6 +58,7 @@ usage(const wchar_t *argv0)
              L"  -e EXECUTABLE  specify the EXE/DLL\n"
              L"  -f             show functions\n"
              L"  -H             displays command line help text\n"
+             L"  -i             show inlined functions\n"
              L"  -p             pretty print\n",
              argv0);
 }
@@ -87,9 +89,10 @@ wmain(int argc, wchar_t **argv)
     bool functions = false;
     bool demangle = false;
     bool pretty = false;
+    bool inlines = false;
 
     while (1) {
-        int opt = getoptW(argc, argv, L"?CDe:fHp");
+        int opt = getoptW(argc, argv, L"?CDe:fHip");
 
         switch (opt) {
         case L'C':
@@ -107,6 +110,9 @@ wmain(int argc, wchar_t **argv)
         case L'H':
             usage(argv[0]);
             return EXIT_SUCCESS;
+        case L'i':
+            inlines = true;
+            break;
         case L'p':
             pretty = true;
             break;
@@ -194,40 +200,58 @@ wmain(int argc, wchar_t **argv)
 
         UINT_PTR dwAddr = BaseOfDll + dwRelAddr;
 
-        if (functions) {
-            struct {
-                SYMBOL_INFO Symbol;
-                CHAR Name[512];
-            } sym;
-            char UnDecoratedName[512];
-            const char *function = "??";
-            ZeroMemory(&sym, sizeof sym);
-            sym.Symbol.SizeOfStruct = sizeof sym.Symbol;
-            sym.Symbol.MaxNameLen = sizeof sym.Symbol.Name + sizeof sym.Name;
-            DWORD64 dwSymDisplacement = 0;
-            bRet = SymFromAddr(hProcess, dwAddr, &dwSymDisplacement, &sym.Symbol);
-            if (bRet) {
-                function = sym.Symbol.Name;
-                if (demangle) {
-                    if (UnDecorateSymbolName(sym.Symbol.Name, UnDecoratedName,
-                                             sizeof UnDecoratedName, UNDNAME_COMPLETE)) {
-                        function = UnDecoratedName;
+        // Inlined functions come first, innermost first, each followed by
+        // the location of its call
+        DWORD dwInlineContext = INLINE_FRAME_CONTEXT_INIT;
+        DWORD dwInlineFrames = 0;
+        if (inlines) {
+            dwInlineFrames = GetInlineTrace(hProcess, dwAddr, &dwInlineContext);
+        }
+
+        for (DWORD i = 0; i <= dwInlineFrames; ++i) {
+            ULONG InlineContext = dwInlineFrames ? dwInlineContext + i : INLINE_FRAME_CONTEXT_INIT;
+
+            if (i > 0 && pretty) {
+                fputws(L" (inlined by) ", stdout);
+            }
+
+            if (functions) {
+                struct {
+                    SYMBOL_INFO Symbol;
+                    CHAR Name[512];
+                } sym;
+                char UnDecoratedName[512];
+                const char *function = "??";
+                ZeroMemory(&sym, sizeof sym);
+                sym.Symbol.SizeOfStruct = sizeof sym.Symbol;
+                sym.Symbol.MaxNameLen = sizeof sym.Symbol.Name + sizeof sym.Name;
+                DWORD64 dwSymDisplacement = 0;
+                bRet = MgwSymFromInlineContext(hProcess, dwAddr, InlineContext,
+                                               &dwSymDisplacement, &sym.Symbol);
+                if (bRet) {
+                    function = sym.Symbol.Name;
+                    if (demangle) {
+                        if (UnDecorateSymbolName(sym.Symbol.Name, UnDecoratedName,
+                                                 sizeof UnDecoratedName, UNDNAME_COMPLETE)) {
+                            function = UnDecoratedName;
+                        }
                     }
                 }
+                fwprintf(stdout, L"%hs", function);
+                fputws(pretty ? L" at " : L"\n", stdout);
             }
-            fwprintf(stdout, L"%hs", function);
-            fputws(pretty ? L" at " : L"\n", stdout);
-        }
 
-        IMAGEHLP_LINEW64 line;
-        ZeroMemory(&line, sizeof line);
-        line.SizeOfStruct = sizeof line;
-        DWORD dwLineDisplacement = 0;
-        bRet = SymGetLineFromAddrW64(hProcess, dwAddr, &dwLineDisplacement, &line);
-        if (bRet) {
-            fwprintf(stdout, L"%ls:%lu\n", line.FileName, line.LineNumber);
-        } else {
-            fputws(L"??:?\n", stdout);
+            IMAGEHLP_LINEW64 line;
+            ZeroMemory(&line, sizeof line);
+            line.SizeOfStruct = sizeof line;
+            DWORD dwLineDisplacement = 0;
+            bRet = MgwSymGetLineFromInlineContextW(hProcess, dwAddr, InlineContext, BaseOfDll,
+                                                   &dwLineDisplacement, &line);
+            if (bRet) {
+                fwprintf(stdout, L"%ls:%lu\n", line.FileName, line.LineNumber);
+            } else {
+                fputws(L"??:?\n", stdout);
+            }
         }
         fflush(stdout);
     }
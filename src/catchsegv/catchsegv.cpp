@@ -39,6 +39,7 @@
 #include "debugger.h"
 #include "symbols.h"
 #include "getoptW.h"
+#include "mgwhelp.h"
 
 
 static void
@@ -49,6 +50,36 @@ outputCallback(const wchar_t *s)
 }
 
 
+/*
+ * Summarize where symbol resolution time went.
+ */
+static void
+dumpSymStats(void)
+{
+    MGW_STATS Stats;
+    Stats.SizeOfStruct = sizeof Stats;
+    if (!MgwSymGetStats(nullptr, 0, &Stats)) {
+        return;
+    }
+
+    fwprintf(stderr,
+             L"catchsegv: DWARF loads: %I64u (%I64u from index cache, %I64u evicted), %I64u us\n"
+             L"catchsegv: CU line tables: %I64u, %I64u us\n"
+             L"catchsegv: DWARF lookups: %I64u (%I64u hits), %I64u us\n"
+             L"catchsegv: PE lookups: %I64u (%I64u hits), %I64u us\n"
+             L"catchsegv: DbgHelp lookups: %I64u (%I64u hits), %I64u us\n"
+             L"catchsegv: demangles: %I64u, %I64u us\n"
+             L"catchsegv: bytes mapped: %I64u\n",
+             Stats.DwarfLoads, Stats.IndexCacheHits, Stats.DwarfEvictions, Stats.DwarfLoadTime,
+             Stats.CuReads, Stats.CuReadTime,
+             Stats.DwarfLookups, Stats.DwarfHits, Stats.DwarfLookupTime,
+             Stats.PeLookups, Stats.PeHits, Stats.PeLookupTime,
+             Stats.DbgHelpLookups, Stats.DbgHelpHits, Stats.DbgHelpLookupTime,
+             Stats.Demangles, Stats.DemangleTime,
+             Stats.BytesMapped);
+}
+
+
 static ULONG g_TimeOut = 0;
 static HANDLE g_hTimer = NULL;
 static HANDLE g_hTimerQueue = NULL;
@@ -148,14 +179,16 @@ Usage(void)
            L"options:\n"
            L"  -?|-h        displays command line help text\n"
            L"  -v           enables verbose output from the debugger\n"
-           L"  -d           enables debugging output (for debugging catchsegv itself)\n"
+           L"  -d           enables debugging output and symbol lookup statistics\n"
            L"  -t SECONDS   specifies a timeout in seconds\n"
            L"  -1           dump stack on first chance exceptions\n"
            L"  -m           ignore modal dialogs\n"
            L"  -z           write minidumps\n"
            L"  -Z DIRECTORY write minidumps to specified directory\n"
            L"  -H           use debug heap\n"
-           L"  -q           silence messages from OutputDebugString\n",
+           L"  -q           silence messages from OutputDebugString\n"
+           L"  -w           index symbols of loaded modules in the background\n"
+           L"  -u ENGINE    selects the stack unwinder: mgwhelp (default) or dbghelp\n",
            stderr);
 }
 
@@ -270,7 +303,7 @@ wmain(int argc, wchar_t **argv)
 
     bool debugHeap = false;
     while (1) {
-        int opt = getoptW(argc, argv, L"?1dhHmt:zZ:vq");
+        int opt = getoptW(argc, argv, L"?1dhHmt:u:wzZ:vq");
 
         switch (opt) {
         case L'h':
@@ -304,6 +337,20 @@ wmain(int argc, wchar_t **argv)
         case L'q':
             debugOptions.no_debug_string = true;
             break;
+        case L'w':
+            debugOptions.prewarm = true;
+            break;
+        case L'u':
+            if (wcscmp(optarg, L"mgwhelp") == 0) {
+                setStackWalker(STACK_WALKER_MGWHELP);
+            } else if (wcscmp(optarg, L"dbghelp") == 0) {
+                setStackWalker(STACK_WALKER_DBGHELP);
+            } else {
+                fwprintf(stderr, L"catchsegv: error: unknown stack unwinder %ls\n\n", optarg);
+                Usage();
+                return EXIT_FAILURE;
+            }
+            break;
         case L'?':
             if (optopt == L'?') {
                 Usage();
@@ -418,6 +465,10 @@ wmain(int argc, wchar_t **argv)
 
     DebugMainLoop();
 
+    if (debugOptions.debug_flag) {
+        dumpSymStats();
+    }
+
     DWORD dwExitCode = STILL_ACTIVE;
     GetExitCodeProcess(ProcessInformation.hProcess, &dwExitCode);
 
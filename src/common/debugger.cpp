@@ -17,6 +17,7 @@
  */
 
 
+#include <deque>
 #include <map>
 #include <string>
 
@@ -28,6 +29,7 @@
 #include <psapi.h>
 
 #include "debugger.h"
+#include "mgwhelp.h"
 #include "log.h"
 #include "outdbg.h"
 #include "symbols.h"
@@ -268,6 +270,119 @@ getModuleSize(HANDLE hProcess, LPVOID lpBaseOfDll)
 }
 
 
+/*
+ * Background symbol pre-warming.
+ *
+ * Modules are queued as they get loaded, and a low priority thread loads
+ * their debugging information one at a time, so that by the time an
+ * exception is reported the symbols of most modules on the stack are
+ * already indexed.  Lookups for a module that is still being indexed simply
+ * wait for it.
+ */
+
+typedef struct {
+    HANDLE hProcess;
+    DWORD64 BaseOfDll;
+} PREWARM_ITEM;
+
+static SRWLOCK g_PrewarmLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE g_PrewarmCond = CONDITION_VARIABLE_INIT;
+static std::deque<PREWARM_ITEM> g_PrewarmQueue;
+static PREWARM_ITEM g_PrewarmCurrent;
+static bool g_bPrewarmStop = false;
+static HANDLE g_hPrewarmThread = nullptr;
+
+
+static DWORD WINAPI
+prewarmThread(LPVOID lpParameter)
+{
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+
+    AcquireSRWLockExclusive(&g_PrewarmLock);
+    while (true) {
+        while (g_PrewarmQueue.empty() && !g_bPrewarmStop) {
+            SleepConditionVariableSRW(&g_PrewarmCond, &g_PrewarmLock, INFINITE, 0);
+        }
+        if (g_bPrewarmStop) {
+            break;
+        }
+
+        g_PrewarmCurrent = g_PrewarmQueue.front();
+        g_PrewarmQueue.pop_front();
+        ReleaseSRWLockExclusive(&g_PrewarmLock);
+
+        MgwSymPrewarmModule(g_PrewarmCurrent.hProcess, g_PrewarmCurrent.BaseOfDll);
+
+        AcquireSRWLockExclusive(&g_PrewarmLock);
+        g_PrewarmCurrent.hProcess = nullptr;
+        WakeAllConditionVariable(&g_PrewarmCond);
+    }
+    ReleaseSRWLockExclusive(&g_PrewarmLock);
+
+    return 0;
+}
+
+
+static void
+prewarmModule(HANDLE hProcess, DWORD64 BaseOfDll)
+{
+    AcquireSRWLockExclusive(&g_PrewarmLock);
+    if (!g_hPrewarmThread) {
+        g_hPrewarmThread = CreateThread(nullptr, 0, prewarmThread, nullptr, 0, nullptr);
+    }
+    if (g_hPrewarmThread) {
+        g_PrewarmQueue.push_back({hProcess, BaseOfDll});
+        WakeAllConditionVariable(&g_PrewarmCond);
+    }
+    ReleaseSRWLockExclusive(&g_PrewarmLock);
+}
+
+
+/*
+ * Forget the queued modules of a process (or a single module when BaseOfDll
+ * is not zero), and wait for the one being indexed, so that it can be safely
+ * unloaded.
+ */
+static void
+prewarmCancel(HANDLE hProcess, DWORD64 BaseOfDll)
+{
+    auto matches = [=](const PREWARM_ITEM &item) {
+        return item.hProcess == hProcess && (!BaseOfDll || item.BaseOfDll == BaseOfDll);
+    };
+
+    AcquireSRWLockExclusive(&g_PrewarmLock);
+    auto it = g_PrewarmQueue.begin();
+    while (it != g_PrewarmQueue.end()) {
+        if (matches(*it)) {
+            it = g_PrewarmQueue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (matches(g_PrewarmCurrent)) {
+        SleepConditionVariableSRW(&g_PrewarmCond, &g_PrewarmLock, INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&g_PrewarmLock);
+}
+
+
+static void
+prewarmStop(void)
+{
+    AcquireSRWLockExclusive(&g_PrewarmLock);
+    HANDLE hThread = g_hPrewarmThread;
+    g_PrewarmQueue.clear();
+    g_bPrewarmStop = true;
+    WakeAllConditionVariable(&g_PrewarmCond);
+    ReleaseSRWLockExclusive(&g_PrewarmLock);
+
+    if (hThread) {
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+    }
+}
+
+
 static void
 loadModule(HANDLE hProcess, HANDLE hFile, PCWSTR pszImageName, LPVOID lpBaseOfDll)
 {
@@ -283,6 +398,8 @@ loadModule(HANDLE hProcess, HANDLE hFile, PCWSTR pszImageName, LPVOID lpBaseOfDl
     if (!SymLoadModuleExW(hProcess, hFile, pszImageName, NULL, (UINT_PTR)lpBaseOfDll, DllSize,
                           NULL, 0)) {
         OutputDebug("warning: SymLoadModule64 failed: 0x%08lx\n", GetLastError());
+    } else if (debugOptions.prewarm) {
+        prewarmModule(hProcess, (UINT_PTR)lpBaseOfDll);
     }
 
     // DbgHelp keeps an copy of hFile, and closing the handle here may cause
@@ -467,6 +584,8 @@ DebugMainLoop(void)
         if (!WaitForDebugEvent(&DebugEvent, INFINITE)) {
             OutputDebug("WaitForDebugEvent: 0x%08lx", GetLastError());
 
+            prewarmStop();
+
             return FALSE;
         }
 
@@ -700,6 +819,8 @@ DebugMainLoop(void)
                 writeDump(DebugEvent.dwProcessId, pProcessInfo, nullptr);
             }
 
+            prewarmCancel(pProcessInfo->hProcess, 0);
+
             // Remove the process from the process list
             g_Processes.erase(DebugEvent.dwProcessId);
 
@@ -745,6 +866,8 @@ DebugMainLoop(void)
 
             pProcessInfo = &g_Processes[DebugEvent.dwProcessId];
 
+            prewarmCancel(pProcessInfo->hProcess, (UINT_PTR)DebugEvent.u.UnloadDll.lpBaseOfDll);
+
             SymUnloadModule64(pProcessInfo->hProcess, (UINT_PTR)DebugEvent.u.UnloadDll.lpBaseOfDll);
 
             break;
@@ -789,5 +912,7 @@ DebugMainLoop(void)
         ContinueDebugEvent(DebugEvent.dwProcessId, DebugEvent.dwThreadId, dwContinueStatus);
     }
 
+    prewarmStop();
+
     return TRUE;
 }
@@ -32,6 +32,7 @@ struct DebugOptions {
     HANDLE hEvent = nullptr; // Signal an event after process is attached
     DWORD dwThreadId = 0;    // Resume thread after process is attached
     bool no_debug_string = false; // Silence OutputDebugString messages
+    bool prewarm = false;         // Index modules' symbols in the background
 };
 
 EXTERN_C DebugOptions debugOptions;
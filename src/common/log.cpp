@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "mgwhelp.h"
 #include "outdbg.h"
 #include "paths.h"
 #include "symbols.h"
@@ -63,6 +64,16 @@ setDumpCallback(DumpCallback cb)
 }
 
 
+static enum StackWalker g_StackWalker = STACK_WALKER_MGWHELP;
+
+
+void
+setStackWalker(enum StackWalker walker)
+{
+    g_StackWalker = walker;
+}
+
+
 int
 lprintf(const wchar_t *format, ...)
 {
@@ -348,56 +359,83 @@ dumpStack(HANDLE hProcess, HANDLE hThread, const CONTEXT *pContext)
     DWORD64 PrevFrameStackOffset = StackFrame.AddrStack.Offset - 1;
     int nudge = 0;
 
+    // Unlike StackWalk64, MgwStackWalk64 unwinds i686 code without frame
+    // pointers, and x64 code with the function tables of the image files
+    BOOL bDbgHelp = g_StackWalker == STACK_WALKER_DBGHELP;
+    auto pfnStackWalk64 = bDbgHelp ? StackWalk64 : MgwStackWalk64;
+
     while (TRUE) {
-        char szSymName[MAX_SYM_NAME_SIZE] = "";
-        wchar_t szFileName[MAX_PATH] = {};
-        DWORD dwLineNumber = 0;
-
-        if (!StackWalk64(MachineType, hProcess, hThread, &StackFrame, &Context,
-                         NULL, // ReadMemoryRoutine
-                         SymFunctionTableAccess64, SymGetModuleBase64,
-                         NULL // TranslateAddress
-                         ))
+        if (!pfnStackWalk64(MachineType, hProcess, hThread, &StackFrame, &Context,
+                            NULL, // ReadMemoryRoutine
+                            SymFunctionTableAccess64, SymGetModuleBase64,
+                            NULL // TranslateAddress
+                            ))
             break;
 
-        if (MachineType == IMAGE_FILE_MACHINE_I386) {
-            lprintf(L"%08lX %08lX %08lX %08lX", (DWORD)StackFrame.AddrPC.Offset,
-                    (DWORD)StackFrame.Params[0], (DWORD)StackFrame.Params[1],
-                    (DWORD)StackFrame.Params[2]);
-        } else {
-            lprintf(L"%016I64X %016I64X %016I64X %016I64X", StackFrame.AddrPC.Offset,
-                    StackFrame.Params[0], StackFrame.Params[1], StackFrame.Params[2]);
-        }
-
-        BOOL bSymbol = TRUE;
-        BOOL bLine = FALSE;
-        DWORD dwOffsetFromSymbol = 0;
-
         DWORD64 AddrPC = StackFrame.AddrPC.Offset;
         HMODULE hModule = (HMODULE)(INT_PTR)SymGetModuleBase64(hProcess, AddrPC);
         wchar_t szModule[MAX_PATH];
-        if (hModule && GetModuleFileNameExW(hProcess, hModule, szModule, _countof(szModule))) {
-            lprintf(L"  %ls", getBaseNameW(szModule));
-
-            bSymbol = GetSymFromAddr(hProcess, AddrPC + nudge, szSymName, MAX_SYM_NAME_SIZE,
-                                     &dwOffsetFromSymbol);
-            if (bSymbol) {
-                lprintf(L"!%S+0x%lx", szSymName, dwOffsetFromSymbol - nudge);
-
-                bLine =
-                    GetLineFromAddr(hProcess, AddrPC + nudge, szFileName, _countof(szFileName), &dwLineNumber);
-                if (bLine) {
-                    lprintf(L"  [%ls:%ld]", szFileName, dwLineNumber);
+        BOOL bModule =
+            hModule && GetModuleFileNameExW(hProcess, hModule, szModule, _countof(szModule));
+
+        // Frames of inlined subroutines come first, innermost first, each
+        // with the line of the call to the previous one
+        DWORD dwInlineContext = 0;
+        DWORD dwInlineFrames =
+            bModule ? GetInlineTrace(hProcess, AddrPC + nudge, &dwInlineContext) : 0;
+
+        for (DWORD i = 0; i <= dwInlineFrames; ++i) {
+            if (i < dwInlineFrames) {
+                if (MachineType == IMAGE_FILE_MACHINE_I386) {
+                    lprintf(L"%08lX %-26ls", (DWORD)AddrPC, L"(inlined)");
+                } else {
+                    lprintf(L"%016I64X %-50ls", AddrPC, L"(inlined)");
                 }
+            } else if (MachineType == IMAGE_FILE_MACHINE_I386) {
+                lprintf(L"%08lX %08lX %08lX %08lX", (DWORD)AddrPC, (DWORD)StackFrame.Params[0],
+                        (DWORD)StackFrame.Params[1], (DWORD)StackFrame.Params[2]);
             } else {
-                lprintf(L"!0x%I64x", AddrPC - (DWORD64)(INT_PTR)hModule);
+                lprintf(L"%016I64X %016I64X %016I64X %016I64X", AddrPC, StackFrame.Params[0],
+                        StackFrame.Params[1], StackFrame.Params[2]);
             }
-        }
 
-        lprintf(L"\n");
+            char szSymName[MAX_SYM_NAME_SIZE] = "";
+            wchar_t szFileName[MAX_PATH] = {};
+            DWORD dwLineNumber = 0;
+            BOOL bSymbol = TRUE;
+            BOOL bLine = FALSE;
+            DWORD dwOffsetFromSymbol = 0;
+
+            if (bModule) {
+                lprintf(L"  %ls", getBaseNameW(szModule));
+
+                if (dwInlineFrames) {
+                    bSymbol = GetInlineSymLineFromAddr(
+                        hProcess, AddrPC + nudge, dwInlineContext + i, szSymName,
+                        MAX_SYM_NAME_SIZE, &dwOffsetFromSymbol, szFileName,
+                        _countof(szFileName), &dwLineNumber);
+                } else {
+                    bSymbol = GetSymLineFromAddr(hProcess, AddrPC + nudge, szSymName,
+                                                 MAX_SYM_NAME_SIZE, &dwOffsetFromSymbol,
+                                                 szFileName, _countof(szFileName), &dwLineNumber);
+                }
+                if (bSymbol) {
+                    lprintf(L"!%S+0x%lx", szSymName, dwOffsetFromSymbol - nudge);
+
+                    bLine = dwLineNumber != 0;
+                    if (bLine) {
+                        lprintf(L"  [%ls:%ld]", szFileName, dwLineNumber);
+                    }
+                } else {
+                    lprintf(L"!0x%I64x", AddrPC - (DWORD64)(INT_PTR)hModule);
+                }
+            }
 
-        if (bLine) {
-            dumpSourceCode(szFileName, dwLineNumber);
+            lprintf(L"\n");
+
+            if (bLine) {
+                dumpSourceCode(szFileName, dwLineNumber);
+            }
         }
 
         // Basic sanity check to make sure  the frame is OK.  Bail if not.
@@ -409,7 +447,7 @@ dumpStack(HANDLE hProcess, HANDLE hThread, const CONTEXT *pContext)
 
         // Wine's StackWalk64 implementation on certain yield never ending
         // stack backtraces unless one bails out when AddrFrame is zero.
-        if (bInsideWine && StackFrame.AddrFrame.Offset == 0) {
+        if (bDbgHelp && bInsideWine && StackFrame.AddrFrame.Offset == 0) {
             break;
         }
 
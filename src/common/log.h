@@ -26,6 +26,15 @@ typedef void (*DumpCallback)(const wchar_t *);
 EXTERN_C void
 setDumpCallback(DumpCallback cb);
 
+// Stack unwinding engines
+enum StackWalker {
+    STACK_WALKER_MGWHELP, // MgwStackWalk64 (the default)
+    STACK_WALKER_DBGHELP, // DbgHelp's StackWalk64
+};
+
+EXTERN_C void
+setStackWalker(enum StackWalker walker);
+
 EXTERN_C int
 lprintf(const wchar_t *format, ...);
 
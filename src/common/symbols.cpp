@@ -28,6 +28,7 @@
 
 #include "outdbg.h"
 #include "symbols.h"
+#include "mgwhelp.h"
 
 
 EXTERN_C DWORD
@@ -151,3 +152,147 @@ GetLineFromAddr(HANDLE hProcess,
 
     return TRUE;
 }
+
+
+/*
+ * Combined GetSymFromAddr and GetLineFromAddr.  mgwhelp resolves both from
+ * a single cached lookup, and the narrow symbol name straight from its UTF-8
+ * form.  *lpLineNumber is set to zero when there's no line information.
+ */
+BOOL
+GetSymLineFromAddr(HANDLE hProcess,
+                   DWORD64 dwAddress,
+                   LPSTR lpSymName,
+                   DWORD nSymNameSize,
+                   LPDWORD lpdwDisplacement,
+                   LPWSTR lpFileName,
+                   DWORD nFileNameSize,
+                   LPDWORD lpLineNumber)
+{
+    PSYMBOL_INFO pSymbol =
+        (PSYMBOL_INFO)malloc(sizeof(SYMBOL_INFO) + nSymNameSize * sizeof(char));
+
+    DWORD64 dwDisplacement =
+        0; // Displacement of the input address, relative to the start of the symbol
+    BOOL bRet;
+
+    pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+    pSymbol->MaxNameLen = nSymNameSize;
+
+    MGW_LINE64 Line;
+    memset(&Line, 0, sizeof Line);
+    Line.SizeOfStruct = sizeof Line;
+
+    DWORD dwOptions = SymGetOptions();
+
+    bRet = MgwSymFromAddrExA(hProcess, dwAddress, &dwDisplacement, pSymbol, &Line);
+
+    if (bRet) {
+        // Demangle if not done already
+        if ((dwOptions & SYMOPT_UNDNAME) ||
+            UnDecorateSymbolName(pSymbol->Name, lpSymName, nSymNameSize, UNDNAME_NAME_ONLY) ==
+                0) {
+            strncpy(lpSymName, pSymbol->Name, nSymNameSize);
+        }
+        if (lpdwDisplacement) {
+            *lpdwDisplacement = dwDisplacement;
+        }
+
+        assert(lpFileName && lpLineNumber);
+
+        if (Line.LineNumber &&
+            MultiByteToWideChar(CP_UTF8, 0, Line.FileName, -1, lpFileName, nFileNameSize)) {
+            *lpLineNumber = Line.LineNumber;
+        } else {
+            *lpLineNumber = 0;
+        }
+    }
+
+    free(pSymbol);
+
+    return bRet;
+}
+
+
+/*
+ * Get the number of inlined subroutines containing an address, and the
+ * inline context of the innermost one.  The contexts of the enclosing
+ * frames follow consecutively, up to *lpdwInlineContext + the returned
+ * count, which is the context of the function they were inlined into.
+ */
+DWORD
+GetInlineTrace(HANDLE hProcess, DWORD64 dwAddress, LPDWORD lpdwInlineContext)
+{
+    DWORD dwInlineFrames = MgwSymAddrIncludeInlineTrace(hProcess, dwAddress);
+    if (dwInlineFrames == 0) {
+        return 0;
+    }
+
+    DWORD dwFrameIndex = 0;
+    if (!MgwSymQueryInlineTrace(hProcess, dwAddress, INLINE_FRAME_CONTEXT_INIT, dwAddress,
+                                dwAddress, lpdwInlineContext, &dwFrameIndex)) {
+        return 0;
+    }
+
+    return dwInlineFrames;
+}
+
+
+/*
+ * GetSymLineFromAddr for one of the inline contexts of an address.
+ */
+BOOL
+GetInlineSymLineFromAddr(HANDLE hProcess,
+                         DWORD64 dwAddress,
+                         DWORD dwInlineContext,
+                         LPSTR lpSymName,
+                         DWORD nSymNameSize,
+                         LPDWORD lpdwDisplacement,
+                         LPWSTR lpFileName,
+                         DWORD nFileNameSize,
+                         LPDWORD lpLineNumber)
+{
+    PSYMBOL_INFO pSymbol =
+        (PSYMBOL_INFO)malloc(sizeof(SYMBOL_INFO) + nSymNameSize * sizeof(char));
+
+    DWORD64 dwDisplacement = 0;
+    BOOL bRet;
+
+    pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+    pSymbol->MaxNameLen = nSymNameSize;
+
+    DWORD dwOptions = SymGetOptions();
+
+    bRet = MgwSymFromInlineContext(hProcess, dwAddress, dwInlineContext, &dwDisplacement,
+                                   pSymbol);
+
+    if (bRet) {
+        // Demangle if not done already
+        if ((dwOptions & SYMOPT_UNDNAME) ||
+            UnDecorateSymbolName(pSymbol->Name, lpSymName, nSymNameSize, UNDNAME_NAME_ONLY) ==
+                0) {
+            strncpy(lpSymName, pSymbol->Name, nSymNameSize);
+        }
+        if (lpdwDisplacement) {
+            *lpdwDisplacement = dwDisplacement;
+        }
+
+        assert(lpFileName && lpLineNumber);
+
+        IMAGEHLP_LINEW64 Line;
+        DWORD dwLineDisplacement = 0;
+        memset(&Line, 0, sizeof Line);
+        Line.SizeOfStruct = sizeof Line;
+        if (MgwSymGetLineFromInlineContextW(hProcess, dwAddress, dwInlineContext, 0,
+                                            &dwLineDisplacement, &Line)) {
+            wcsncpy(lpFileName, Line.FileName, nFileNameSize);
+            *lpLineNumber = Line.LineNumber;
+        } else {
+            *lpLineNumber = 0;
+        }
+    }
+
+    free(pSymbol);
+
+    return bRet;
+}
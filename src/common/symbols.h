@@ -40,3 +40,27 @@ GetLineFromAddr(HANDLE hProcess,
                 LPWSTR lpFileName,
                 DWORD nSize,
                 LPDWORD lpLineNumber);
+
+EXTERN_C BOOL
+GetSymLineFromAddr(HANDLE hProcess,
+                   DWORD64 dwAddress,
+                   LPSTR lpSymName,
+                   DWORD nSymNameSize,
+                   LPDWORD lpdwDisplacement,
+                   LPWSTR lpFileName,
+                   DWORD nFileNameSize,
+                   LPDWORD lpLineNumber);
+
+EXTERN_C DWORD
+GetInlineTrace(HANDLE hProcess, DWORD64 dwAddress, LPDWORD lpdwInlineContext);
+
+EXTERN_C BOOL
+GetInlineSymLineFromAddr(HANDLE hProcess,
+                         DWORD64 dwAddress,
+                         DWORD dwInlineContext,
+                         LPSTR lpSymName,
+                         DWORD nSymNameSize,
+                         LPDWORD lpdwDisplacement,
+                         LPWSTR lpFileName,
+                         DWORD nFileNameSize,
+                         LPDWORD lpLineNumber);
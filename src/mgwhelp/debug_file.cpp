@@ -0,0 +1,266 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Discovery of separate debug files.
+ *
+ * See https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
+ *
+ * Images are matched to their debug files by build ID, looked up in the
+ * .build-id\xx\yyyy.debug store of every directory in DRMINGW_DEBUG_PATH,
+ * and then by .gnu_debuglink name, looked up in the image directory, its
+ * .debug subdirectory, and every directory in DRMINGW_DEBUG_PATH.
+ *
+ * Results, including misses, are cached for the lifetime of the process, so
+ * that modules sharing a directory and debug link, or loaded again, don't
+ * probe the file system again.
+ */
+
+
+#include "debug_file.h"
+
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "outdbg.h"
+#include "paths.h"
+#include "pe_image.h"
+
+
+#define CODEVIEW_RSDS_SIGNATURE 0x53445352 // 'RSDS'
+
+
+static SRWLOCK debug_file_lock = SRWLOCK_INIT;
+
+// Search roots from DRMINGW_DEBUG_PATH, each with a trailing separator
+static std::vector<std::wstring> debug_file_roots;
+static bool debug_file_roots_parsed = false;
+
+// Debug file path for each build ID or debug link, empty if not found
+static std::unordered_map<std::wstring, std::wstring> debug_file_cache;
+
+
+static void
+debug_file_parse_roots(void)
+{
+    const wchar_t *szDebugPath = _wgetenv(L"DRMINGW_DEBUG_PATH");
+    if (!szDebugPath) {
+        return;
+    }
+
+    const wchar_t *p = szDebugPath;
+    while (*p) {
+        const wchar_t *q = wcschr(p, L';');
+        if (!q) {
+            q = p + wcslen(p);
+        }
+
+        std::wstring root(p, q);
+        while (!root.empty() && (root.back() == L'\\' || root.back() == L'/')) {
+            root.pop_back();
+        }
+        if (!root.empty()) {
+            root.push_back(L'\\');
+            debug_file_roots.emplace_back(std::move(root));
+        }
+
+        p = *q ? q + 1 : q;
+    }
+}
+
+
+/*
+ * Get the build ID of an image as an hexadecimal string.
+ *
+ * GNU ld's --build-id stores it as the GUID of a CodeView RSDS debug
+ * directory entry, and, like BFD, the GUID's integer fields are taken in big
+ * endian order.
+ */
+static bool
+debug_file_build_id(const struct pe_image *image, std::wstring &buildId)
+{
+    DWORD Size = 0;
+    const BYTE *data = pe_image_directory_data(image, IMAGE_DIRECTORY_ENTRY_DEBUG, &Size);
+    if (!data) {
+        return false;
+    }
+
+    DWORD NumberOfEntries = Size / sizeof(IMAGE_DEBUG_DIRECTORY);
+    for (DWORD i = 0; i < NumberOfEntries; ++i) {
+        const IMAGE_DEBUG_DIRECTORY UNALIGNED *pEntry =
+            (const IMAGE_DEBUG_DIRECTORY UNALIGNED *)data + i;
+        if (pEntry->Type != IMAGE_DEBUG_TYPE_CODEVIEW ||
+            pEntry->SizeOfData < sizeof(DWORD) + 16 ||
+            pEntry->PointerToRawData > image->nFileSize ||
+            pEntry->SizeOfData > image->nFileSize - pEntry->PointerToRawData) {
+            continue;
+        }
+
+        const BYTE *pRecord = image->lpFileBase + pEntry->PointerToRawData;
+        if (*(const DWORD UNALIGNED *)pRecord != CODEVIEW_RSDS_SIGNATURE) {
+            continue;
+        }
+
+        static const unsigned order[16] = {3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+        const BYTE *pGuid = pRecord + sizeof(DWORD);
+        wchar_t szBuildId[2 * 16 + 1];
+        for (unsigned j = 0; j < 16; ++j) {
+            _snwprintf(szBuildId + 2 * j, 3, L"%02x", pGuid[order[j]]);
+        }
+        buildId = szBuildId;
+        return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Get the file name in the .gnu_debuglink section of an image.
+ */
+static bool
+debug_file_debuglink(const struct pe_image *image, std::wstring &debuglink)
+{
+    PIMAGE_SECTION_HEADER pSection = pe_image_find_section(image, ".gnu_debuglink");
+    if (!pSection) {
+        return false;
+    }
+
+    DWORD Size = 0;
+    const BYTE *data = pe_image_section_data(image, pSection, &Size);
+    if (!data || !memchr(data, '\0', Size)) {
+        return false;
+    }
+
+    const char *szDebuglink = (const char *)data;
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, szDebuglink, -1, nullptr, 0);
+    if (wlen <= 1) {
+        return false;
+    }
+
+    std::vector<wchar_t> wbuf(wlen);
+    MultiByteToWideChar(CP_UTF8, 0, szDebuglink, -1, wbuf.data(), wlen);
+    debuglink = wbuf.data();
+    return true;
+}
+
+
+static bool
+debug_file_exists(const std::wstring &path)
+{
+    DWORD dwAttributes = GetFileAttributesW(path.c_str());
+    if (dwAttributes == INVALID_FILE_ATTRIBUTES || (dwAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        OutputDebug("MGWHELP: %ls - not found\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+static std::wstring
+debug_file_search(const std::wstring &buildId,
+                  const std::wstring &imageDir,
+                  const std::wstring &debuglink)
+{
+    std::vector<std::wstring> candidates;
+
+    if (!buildId.empty()) {
+        for (auto const &root : debug_file_roots) {
+            candidates.emplace_back(root + L".build-id\\" + buildId.substr(0, 2) + L"\\" +
+                                    buildId.substr(2) + L".debug");
+        }
+    }
+
+    if (!debuglink.empty()) {
+        candidates.emplace_back(imageDir + debuglink);
+        candidates.emplace_back(imageDir + L".debug\\" + debuglink);
+        for (auto const &root : debug_file_roots) {
+            candidates.emplace_back(root + debuglink);
+        }
+    }
+
+    for (auto const &candidate : candidates) {
+        if (debug_file_exists(candidate)) {
+            return candidate;
+        }
+    }
+
+    return std::wstring();
+}
+
+
+/*
+ * Find the separate debug file of an image, returning whether one was found.
+ */
+bool
+debug_file_find(const struct pe_image *image, const wchar_t *name, std::wstring &path)
+{
+    std::wstring buildId;
+    std::wstring debuglink;
+    bool bHasBuildId = debug_file_build_id(image, buildId);
+    bool bHasDebuglink = debug_file_debuglink(image, debuglink);
+    if (!bHasBuildId && !bHasDebuglink) {
+        return false;
+    }
+
+    std::wstring imageDir;
+    const wchar_t *pImageSep = getSeparatorW(name);
+    if (pImageSep) {
+        imageDir.append(name, pImageSep);
+    }
+
+    // Build IDs are unique, whereas debug links are only meaningful relative
+    // to the image directory
+    std::wstring key = buildId;
+    key += L'|';
+    key += imageDir;
+    key += L'|';
+    key += debuglink;
+
+    AcquireSRWLockShared(&debug_file_lock);
+    auto it = debug_file_cache.find(key);
+    bool bCached = it != debug_file_cache.end();
+    if (bCached) {
+        path = it->second;
+    }
+    bool bRootsParsed = debug_file_roots_parsed;
+    ReleaseSRWLockShared(&debug_file_lock);
+
+    if (!bCached) {
+        if (!bRootsParsed) {
+            AcquireSRWLockExclusive(&debug_file_lock);
+            if (!debug_file_roots_parsed) {
+                debug_file_parse_roots();
+                debug_file_roots_parsed = true;
+            }
+            ReleaseSRWLockExclusive(&debug_file_lock);
+        }
+
+        // The roots are never modified once parsed, so the file system is
+        // probed without holding the lock
+        path = debug_file_search(buildId, imageDir, debuglink);
+
+        AcquireSRWLockExclusive(&debug_file_lock);
+        debug_file_cache.emplace(key, path);
+        ReleaseSRWLockExclusive(&debug_file_lock);
+    }
+
+    return !path.empty();
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Persistent cache of DWARF indices, under %LOCALAPPDATA%\drmingw, so that
+ * the DWARF of unchanged images needs not be parsed again on every run.
+ *
+ * Cache files are named after the image and keyed by its PE timestamp, size,
+ * checksum, and file size, which are also stored in the file header and
+ * checked when mapping it.
+ *
+ * Indices are only written once done with, so that indexing stays cheap on
+ * the first lookup, and the cache can be disabled by setting the
+ * MGWHELP_INDEX_CACHE environment variable to 0.
+ */
+
+
+#include "dwarf_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "dwarf_find.h"
+#include "outdbg.h"
+#include "pe_image.h"
+
+
+static bool
+dwarf_cache_enabled(void)
+{
+    static bool enabled = []() -> bool {
+        const wchar_t *szCache = _wgetenv(L"MGWHELP_INDEX_CACHE");
+        return !szCache || wcscmp(szCache, L"0") != 0;
+    }();
+    return enabled;
+}
+
+
+static bool
+dwarf_cache_key(const struct pe_image *image, struct dwarf_index_key *key)
+{
+    PIMAGE_NT_HEADERS pNtHeaders = image->pNtHeaders;
+    key->TimeDateStamp = pNtHeaders->FileHeader.TimeDateStamp;
+    key->SizeOfImage = image->SizeOfImage;
+    if (image->b64Bit) {
+        key->CheckSum = ((PIMAGE_NT_HEADERS64)pNtHeaders)->OptionalHeader.CheckSum;
+    } else {
+        key->CheckSum = ((PIMAGE_NT_HEADERS32)pNtHeaders)->OptionalHeader.CheckSum;
+    }
+    key->FileSize = image->nFileSize;
+
+    // Images linked without timestamp (e.g., reproducible builds) nor
+    // checksum can't be told apart reliably
+    return key->TimeDateStamp != 0 || key->CheckSum != 0;
+}
+
+
+static bool
+dwarf_cache_path(const wchar_t *name,
+                 const struct dwarf_index_key *key,
+                 wchar_t *szPath,
+                 size_t nPathSize)
+{
+    const wchar_t *szLocalAppData = _wgetenv(L"LOCALAPPDATA");
+    if (!szLocalAppData || !szLocalAppData[0]) {
+        return false;
+    }
+
+    int len = _snwprintf(szPath, nPathSize, L"%ls\\drmingw", szLocalAppData);
+    if (len < 0 || (size_t)len >= nPathSize) {
+        return false;
+    }
+    if (!CreateDirectoryW(szPath, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        return false;
+    }
+
+    const wchar_t *basename = name;
+    for (const wchar_t *p = name; *p; ++p) {
+        if (*p == L'\\' || *p == L'/') {
+            basename = p + 1;
+        }
+    }
+
+    len = _snwprintf(szPath, nPathSize, L"%ls\\drmingw\\%ls-%08lx-%lx-%08lx-%llx.idx",
+                     szLocalAppData, basename, (unsigned long)key->TimeDateStamp,
+                     (unsigned long)key->SizeOfImage, (unsigned long)key->CheckSum,
+                     (unsigned long long)key->FileSize);
+    return len >= 0 && (size_t)len < nPathSize;
+}
+
+
+/*
+ * Map the cached index of an image, or return NULL if there is none.
+ */
+struct dwarf_index *
+dwarf_cache_load(struct pe_image *image, const wchar_t *name)
+{
+    struct dwarf_index_key key;
+    WCHAR szPath[MAX_PATH];
+    if (!dwarf_cache_enabled() || !dwarf_cache_key(image, &key) ||
+        !dwarf_cache_path(name, &key, szPath, _countof(szPath))) {
+        return nullptr;
+    }
+
+    HANDLE hFile = CreateFileW(szPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    // The mapping keeps the file open
+    struct dwarf_index *index = dwarf_index_load(hFile, &key, image->ImageBase, image->SizeOfImage);
+    CloseHandle(hFile);
+
+    if (!index) {
+        OutputDebug("MGWHELP: %ls - ignoring stale index cache %ls\n", name, szPath);
+    }
+
+    return index;
+}
+
+
+/*
+ * Write the index of an image to the cache, if the cache lacks any of it, and
+ * destroy it.
+ *
+ * The file is written under a temporary name and then renamed, so that
+ * concurrent processes never map a partially written file.  The index is
+ * destroyed before renaming, as it may be mapped from the file being
+ * replaced.
+ */
+void
+dwarf_cache_release(struct pe_image *image, const wchar_t *name, struct dwarf_index *index)
+{
+    struct dwarf_index_key key;
+    WCHAR szPath[MAX_PATH];
+    WCHAR szTempPath[MAX_PATH];
+    HANDLE hFile;
+    bool bSaved;
+    int len;
+
+    if (!dwarf_cache_enabled() || !dwarf_index_is_dirty(index) ||
+        !dwarf_cache_key(image, &key) || !dwarf_cache_path(name, &key, szPath, _countof(szPath))) {
+        goto no_save;
+    }
+
+    len = _snwprintf(szTempPath, _countof(szTempPath), L"%ls.%lu.tmp", szPath,
+                     GetCurrentProcessId());
+    if (len < 0 || (size_t)len >= _countof(szTempPath)) {
+        goto no_save;
+    }
+
+    hFile = CreateFileW(szTempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                        NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        goto no_save;
+    }
+
+    bSaved = dwarf_index_save(index, &key, hFile);
+    CloseHandle(hFile);
+    dwarf_index_destroy(index);
+
+    if (!bSaved || !MoveFileExW(szTempPath, szPath, MOVEFILE_REPLACE_EXISTING)) {
+        OutputDebug("MGWHELP: %ls - failed to write index cache %ls\n", name, szPath);
+        DeleteFileW(szTempPath);
+    }
+    return;
+
+no_save:
+    dwarf_index_destroy(index);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include <dwarf.h>
+#include <libdwarf.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct dwarf_index;
+struct pe_image;
+
+
+struct dwarf_index *
+dwarf_cache_load(struct pe_image *image, const wchar_t *name);
+
+void
+dwarf_cache_release(struct pe_image *image, const wchar_t *name, struct dwarf_index *index);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -33,11 +33,1703 @@
 
 #include <cassert>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <windows.h>
 
 #include "libdwarf.h"
 #include <dwarf_arange.h>
 #include <dwarfstack.h>
 
+#include "stats.h"
+
+
+/*
+ * Address ranges are kept as 32-bit RVAs (relative to the image base VMA), as
+ * PE images can't exceed 4GB anyway, which halves the size of the index.
+ */
+struct dwarf_range {
+    uint32_t lowpc;
+    uint32_t highpc;
+    uint32_t index;
+};
+
+struct dwarf_function {
+    uint32_t entry;
+    uint32_t name;
+    uint32_t cu;
+};
+
+#define DWARF_END_SEQUENCE (~(uint32_t)0)
+
+struct dwarf_line {
+    uint32_t addr;
+    uint32_t file; // DWARF_END_SEQUENCE for end of sequence markers
+    uint32_t line;
+    uint32_t column;
+};
+
+/*
+ * Inlined subroutine instance.  Inlined subroutines nested in other inlined
+ * subroutines have increasing depths, starting at 1.
+ */
+struct dwarf_inline {
+    uint32_t name;
+    uint32_t function;
+    uint32_t depth;
+    uint32_t entry;
+    uint32_t call_file; // index into the CU's file table
+    uint32_t call_line;
+    uint32_t call_column;
+};
+
+/*
+ * Read-only view of an array, pointing either into the vectors built from
+ * DWARF, or into a memory-mapped cache file.
+ */
+template <typename T>
+struct dwarf_array {
+    const T *data = nullptr;
+    size_t size = 0;
+
+    dwarf_array() = default;
+
+    dwarf_array(const T *_data, size_t _size) :
+        data(_data),
+        size(_size)
+    {}
+
+    dwarf_array(const std::vector<T> &v) :
+        data(v.data()),
+        size(v.size())
+    {}
+
+    const T *begin() const { return data; }
+    const T *end() const { return data + size; }
+    const T &operator[](size_t i) const { return data[i]; }
+};
+
+/*
+ * Line tables are decoded on first use, so they keep their file names in a
+ * separate string pool, as the index's own pool must not change once it can
+ * be read by other threads.
+ */
+struct dwarf_cu {
+    Dwarf_Off die_offset;
+    LONG volatile lines_read;
+    std::vector<dwarf_line> line_storage;
+    std::vector<char> string_storage;
+    std::vector<uint32_t> file_storage;
+    dwarf_array<dwarf_line> lines;
+    dwarf_array<char> strings;
+
+    // File table, as offsets into the string pool, indexed by DWARF file
+    // number
+    dwarf_array<uint32_t> files;
+};
+
+struct dwarf_index {
+    Dwarf_Addr image_base_vma;
+    uint32_t image_size;
+
+    std::vector<dwarf_cu> cus;
+
+    // Only used when building the index from DWARF
+    std::vector<char> string_storage;
+    std::vector<dwarf_function> function_storage;
+    std::vector<dwarf_range> function_range_storage;
+    std::vector<dwarf_range> cu_range_storage;
+    std::vector<dwarf_inline> inline_storage;
+    std::vector<dwarf_range> inline_range_storage;
+    std::vector<uint32_t> inline_max_storage;
+
+    // Pool of NUL-terminated strings (function names and file paths)
+    dwarf_array<char> strings;
+
+    dwarf_array<dwarf_function> functions;
+
+    // Sorted, non-overlapping address ranges
+    dwarf_array<dwarf_range> function_ranges;
+    dwarf_array<dwarf_range> cu_ranges;
+
+    // Inlined subroutine ranges, which nest, so they are sorted by start
+    // address and searched as an interval tree, laid out as an implicit
+    // binary search tree, where inline_max holds the highest end address of
+    // each subtree
+    dwarf_array<dwarf_inline> inlines;
+    dwarf_array<dwarf_range> inline_ranges;
+    dwarf_array<uint32_t> inline_max;
+
+    // Cache file mapping the arrays point into, if any
+    HANDLE hFileMapping;
+    const void *lpView;
+    uint64_t nViewSize;
+
+    // Whether the index is in the cache, and how many of its CUs have their
+    // line tables there
+    bool cached;
+    uint32_t num_cached_cus;
+};
+
+
+struct dwarf_index_builder {
+    Dwarf_Debug dbg;
+    Dwarf_Error error;
+    struct dwarf_index *index;
+
+    Dwarf_Half cu_version;
+    Dwarf_Addr cu_base;
+    uint32_t cu;
+
+    // Function the DIEs being visited belong to, and their inlining depth
+    uint32_t function;
+    uint32_t inline_depth;
+
+    std::unordered_map<std::string, uint32_t> string_map;
+};
+
+
+static int
+dwarf_check(Dwarf_Debug dbg, int res, Dwarf_Error *error)
+{
+    if (res == DW_DLV_ERROR) {
+        dwarf_dealloc_error(dbg, *error);
+        *error = nullptr;
+    }
+    return res;
+}
+
+
+static uint32_t
+dwarf_intern(std::vector<char> &strings,
+             std::unordered_map<std::string, uint32_t> &string_map,
+             const char *s)
+{
+    auto it = string_map.find(s);
+    if (it != string_map.end()) {
+        return it->second;
+    }
+
+    uint32_t offset = strings.size();
+    strings.insert(strings.end(), s, s + strlen(s) + 1);
+    string_map.emplace(s, offset);
+    return offset;
+}
+
+
+/*
+ * Convert a VMA range into a RVA range, discarding ranges of code which was
+ * discarded by the linker (whose addresses were typically zeroed.)
+ */
+static bool
+dwarf_index_clip(const struct dwarf_index *index,
+                 Dwarf_Addr lowpc,
+                 Dwarf_Addr highpc,
+                 struct dwarf_range *range)
+{
+    Dwarf_Addr image_end = index->image_base_vma + index->image_size;
+    if (lowpc < index->image_base_vma || lowpc >= highpc || lowpc >= image_end) {
+        return false;
+    }
+    if (highpc > image_end) {
+        highpc = image_end;
+    }
+    range->lowpc = lowpc - index->image_base_vma;
+    range->highpc = highpc - index->image_base_vma;
+    return true;
+}
+
+
+typedef std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>> dwarf_pc_ranges;
+
+
+static void
+dwarf_get_rnglists(struct dwarf_index_builder *b,
+                   Dwarf_Attribute attr,
+                   Dwarf_Half form,
+                   Dwarf_Unsigned value,
+                   dwarf_pc_ranges &ranges)
+{
+    Dwarf_Rnglists_Head head = nullptr;
+    Dwarf_Unsigned count = 0;
+    Dwarf_Unsigned global_offset = 0;
+    if (dwarf_check(b->dbg,
+                    dwarf_rnglists_get_rle_head(attr, form, value, &head, &count, &global_offset,
+                                                &b->error),
+                    &b->error) != DW_DLV_OK) {
+        return;
+    }
+
+    for (Dwarf_Unsigned i = 0; i < count; ++i) {
+        unsigned entrylen = 0;
+        unsigned code = 0;
+        Dwarf_Unsigned raw1 = 0;
+        Dwarf_Unsigned raw2 = 0;
+        Dwarf_Bool debug_addr_unavailable = false;
+        Dwarf_Unsigned lowpc = 0;
+        Dwarf_Unsigned highpc = 0;
+        if (dwarf_check(b->dbg,
+                        dwarf_get_rnglists_entry_fields_a(head, i, &entrylen, &code, &raw1, &raw2,
+                                                          &debug_addr_unavailable, &lowpc, &highpc,
+                                                          &b->error),
+                        &b->error) != DW_DLV_OK) {
+            break;
+        }
+        if (code == DW_RLE_end_of_list) {
+            break;
+        }
+        if (code == DW_RLE_base_address || code == DW_RLE_base_addressx ||
+            debug_addr_unavailable) {
+            continue;
+        }
+        ranges.emplace_back(lowpc, highpc);
+    }
+
+    dwarf_dealloc_rnglists_head(head);
+}
+
+
+static void
+dwarf_get_ranges(struct dwarf_index_builder *b,
+                 Dwarf_Die die,
+                 Dwarf_Unsigned offset,
+                 dwarf_pc_ranges &ranges)
+{
+    Dwarf_Off realoffset = 0;
+    Dwarf_Ranges *rangesbuf = nullptr;
+    Dwarf_Signed rangecount = 0;
+    Dwarf_Unsigned bytecount = 0;
+    if (dwarf_check(b->dbg,
+                    dwarf_get_ranges_b(b->dbg, offset, die, &realoffset, &rangesbuf, &rangecount,
+                                       &bytecount, &b->error),
+                    &b->error) != DW_DLV_OK) {
+        return;
+    }
+
+    // Entries are relative to the CU base address, unless overriden
+    Dwarf_Addr base = b->cu_base;
+    for (Dwarf_Signed i = 0; i < rangecount; ++i) {
+        Dwarf_Ranges *r = &rangesbuf[i];
+        switch (r->dwr_type) {
+        case DW_RANGES_ENTRY:
+            ranges.emplace_back(base + r->dwr_addr1, base + r->dwr_addr2);
+            break;
+        case DW_RANGES_ADDRESS_SELECTION:
+            base = r->dwr_addr2;
+            break;
+        case DW_RANGES_END:
+            break;
+        }
+    }
+
+    dwarf_dealloc_ranges(b->dbg, rangesbuf, rangecount);
+}
+
+
+/*
+ * Get the code address ranges of a DIE, be it from DW_AT_low_pc/DW_AT_high_pc
+ * or DW_AT_ranges.
+ */
+static void
+dwarf_get_die_ranges(struct dwarf_index_builder *b, Dwarf_Die die, dwarf_pc_ranges &ranges)
+{
+    Dwarf_Addr lowpc = 0;
+    Dwarf_Addr highpc = 0;
+    Dwarf_Half form = 0;
+    enum Dwarf_Form_Class formclass = DW_FORM_CLASS_UNKNOWN;
+    if (dwarf_check(b->dbg, dwarf_lowpc(die, &lowpc, &b->error), &b->error) == DW_DLV_OK &&
+        dwarf_check(b->dbg, dwarf_highpc_b(die, &highpc, &form, &formclass, &b->error),
+                    &b->error) == DW_DLV_OK) {
+        if (formclass == DW_FORM_CLASS_CONSTANT) {
+            highpc += lowpc;
+        }
+        ranges.emplace_back(lowpc, highpc);
+        return;
+    }
+
+    Dwarf_Attribute attr = nullptr;
+    if (dwarf_check(b->dbg, dwarf_attr(die, DW_AT_ranges, &attr, &b->error), &b->error) !=
+        DW_DLV_OK) {
+        return;
+    }
+
+    Dwarf_Half attr_form = 0;
+    Dwarf_Unsigned value = 0;
+    int res = dwarf_check(b->dbg, dwarf_whatform(attr, &attr_form, &b->error), &b->error);
+    if (res == DW_DLV_OK) {
+        if (attr_form == DW_FORM_sec_offset) {
+            Dwarf_Off offset = 0;
+            res = dwarf_global_formref(attr, &offset, &b->error);
+            value = offset;
+        } else {
+            res = dwarf_formudata(attr, &value, &b->error);
+        }
+        res = dwarf_check(b->dbg, res, &b->error);
+    }
+    if (res == DW_DLV_OK) {
+        if (b->cu_version >= 5) {
+            dwarf_get_rnglists(b, attr, attr_form, value, ranges);
+        } else {
+            dwarf_get_ranges(b, die, value, ranges);
+        }
+    }
+
+    dwarf_dealloc_attribute(attr);
+}
+
+
+static const char *
+dwarf_get_attr_string(struct dwarf_index_builder *b, Dwarf_Die die, Dwarf_Half attrnum)
+{
+    Dwarf_Attribute attr = nullptr;
+    if (dwarf_check(b->dbg, dwarf_attr(die, attrnum, &attr, &b->error), &b->error) !=
+        DW_DLV_OK) {
+        return nullptr;
+    }
+
+    // The returned string points into the string section, so it's not
+    // necessary to free it.
+    char *str = nullptr;
+    if (dwarf_check(b->dbg, dwarf_formstring(attr, &str, &b->error), &b->error) != DW_DLV_OK) {
+        str = nullptr;
+    }
+
+    dwarf_dealloc_attribute(attr);
+
+    return str;
+}
+
+
+static uint32_t
+dwarf_get_attr_udata(struct dwarf_index_builder *b, Dwarf_Die die, Dwarf_Half attrnum)
+{
+    Dwarf_Attribute attr = nullptr;
+    if (dwarf_check(b->dbg, dwarf_attr(die, attrnum, &attr, &b->error), &b->error) !=
+        DW_DLV_OK) {
+        return 0;
+    }
+
+    Dwarf_Unsigned value = 0;
+    if (dwarf_check(b->dbg, dwarf_formudata(attr, &value, &b->error), &b->error) != DW_DLV_OK) {
+        value = 0;
+    }
+
+    dwarf_dealloc_attribute(attr);
+
+    return value;
+}
+
+
+/*
+ * Get the name of a subprogram, preferring the linkage (mangled) name, and
+ * following DW_AT_abstract_origin/DW_AT_specification for concrete instances
+ * and out of line definitions.
+ */
+static const char *
+dwarf_get_die_name(struct dwarf_index_builder *b, Dwarf_Die die, unsigned depth)
+{
+    const char *name;
+
+    name = dwarf_get_attr_string(b, die, DW_AT_linkage_name);
+    if (name) {
+        return name;
+    }
+    name = dwarf_get_attr_string(b, die, DW_AT_MIPS_linkage_name);
+    if (name) {
+        return name;
+    }
+
+    if (depth < 4) {
+        static const Dwarf_Half origin_attrs[] = {DW_AT_abstract_origin, DW_AT_specification};
+        for (Dwarf_Half attrnum : origin_attrs) {
+            Dwarf_Attribute attr = nullptr;
+            if (dwarf_check(b->dbg, dwarf_attr(die, attrnum, &attr, &b->error), &b->error) !=
+                DW_DLV_OK) {
+                continue;
+            }
+
+            Dwarf_Off offset = 0;
+            int res = dwarf_check(b->dbg, dwarf_global_formref(attr, &offset, &b->error),
+                                  &b->error);
+            dwarf_dealloc_attribute(attr);
+
+            Dwarf_Die origin = nullptr;
+            if (res == DW_DLV_OK &&
+                dwarf_check(b->dbg, dwarf_offdie_b(b->dbg, offset, true, &origin, &b->error),
+                            &b->error) == DW_DLV_OK) {
+                name = dwarf_get_die_name(b, origin, depth + 1);
+                dwarf_dealloc_die(origin);
+                if (name) {
+                    return name;
+                }
+            }
+        }
+    }
+
+    return dwarf_get_attr_string(b, die, DW_AT_name);
+}
+
+
+static void
+dwarf_index_die_children(struct dwarf_index_builder *b, Dwarf_Die parent);
+
+
+static void
+dwarf_index_die(struct dwarf_index_builder *b, Dwarf_Die die)
+{
+    Dwarf_Half tag = 0;
+    if (dwarf_check(b->dbg, dwarf_tag(die, &tag, &b->error), &b->error) != DW_DLV_OK) {
+        return;
+    }
+
+    switch (tag) {
+    case DW_TAG_subprogram: {
+        uint32_t indexed_function = DWARF_END_SEQUENCE;
+
+        dwarf_pc_ranges ranges;
+        dwarf_get_die_ranges(b, die, ranges);
+        if (!ranges.empty()) {
+            struct dwarf_index *index = b->index;
+
+            struct dwarf_function function;
+            function.entry = DWARF_END_SEQUENCE;
+            function.cu = b->cu;
+            function.name = DWARF_END_SEQUENCE;
+
+            uint32_t function_index = index->function_storage.size();
+
+            for (auto &pc_range : ranges) {
+                struct dwarf_range range;
+                if (dwarf_index_clip(index, pc_range.first, pc_range.second, &range)) {
+                    // The first range contains the entry point, the remaining
+                    // are typically .text.unlikely cold parts
+                    if (function.entry == DWARF_END_SEQUENCE) {
+                        function.entry = range.lowpc;
+                    }
+                    range.index = function_index;
+                    index->function_range_storage.push_back(range);
+                }
+            }
+
+            if (function.entry != DWARF_END_SEQUENCE) {
+                const char *name = dwarf_get_die_name(b, die, 0);
+                function.name =
+                    dwarf_intern(index->string_storage, b->string_map, name ? name : "");
+                index->function_storage.push_back(function);
+                indexed_function = function_index;
+            }
+        }
+
+        // Inlined subroutines and nested functions
+        uint32_t saved_function = b->function;
+        uint32_t saved_inline_depth = b->inline_depth;
+        b->function = indexed_function;
+        b->inline_depth = 0;
+        dwarf_index_die_children(b, die);
+        b->function = saved_function;
+        b->inline_depth = saved_inline_depth;
+        break;
+    }
+
+    case DW_TAG_inlined_subroutine: {
+        // Abstract instances have no code
+        if (b->function == DWARF_END_SEQUENCE) {
+            break;
+        }
+
+        dwarf_pc_ranges ranges;
+        dwarf_get_die_ranges(b, die, ranges);
+
+        struct dwarf_index *index = b->index;
+
+        struct dwarf_inline inl;
+        inl.name = DWARF_END_SEQUENCE;
+        inl.function = b->function;
+        inl.depth = b->inline_depth + 1;
+        inl.entry = DWARF_END_SEQUENCE;
+        inl.call_file = dwarf_get_attr_udata(b, die, DW_AT_call_file);
+        inl.call_line = dwarf_get_attr_udata(b, die, DW_AT_call_line);
+        inl.call_column = dwarf_get_attr_udata(b, die, DW_AT_call_column);
+
+        uint32_t inline_index = index->inline_storage.size();
+
+        for (auto &pc_range : ranges) {
+            struct dwarf_range range;
+            if (dwarf_index_clip(index, pc_range.first, pc_range.second, &range)) {
+                if (inl.entry == DWARF_END_SEQUENCE) {
+                    inl.entry = range.lowpc;
+                }
+                range.index = inline_index;
+                index->inline_range_storage.push_back(range);
+            }
+        }
+
+        if (inl.entry != DWARF_END_SEQUENCE) {
+            const char *name = dwarf_get_die_name(b, die, 0);
+            inl.name = dwarf_intern(index->string_storage, b->string_map, name ? name : "");
+            index->inline_storage.push_back(inl);
+        }
+
+        // Nested inlined subroutines
+        b->inline_depth = inl.depth;
+        dwarf_index_die_children(b, die);
+        b->inline_depth = inl.depth - 1;
+        break;
+    }
+
+    case DW_TAG_namespace:
+    case DW_TAG_class_type:
+    case DW_TAG_structure_type:
+    case DW_TAG_union_type:
+    case DW_TAG_lexical_block:
+    case DW_TAG_module:
+        dwarf_index_die_children(b, die);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+static void
+dwarf_index_die_children(struct dwarf_index_builder *b, Dwarf_Die parent)
+{
+    Dwarf_Die die = nullptr;
+    int res = dwarf_check(b->dbg, dwarf_child(parent, &die, &b->error), &b->error);
+    while (res == DW_DLV_OK) {
+        dwarf_index_die(b, die);
+
+        Dwarf_Die sibling = nullptr;
+        res = dwarf_check(b->dbg, dwarf_siblingof_b(b->dbg, die, true, &sibling, &b->error),
+                          &b->error);
+        dwarf_dealloc_die(die);
+        die = sibling;
+    }
+}
+
+
+/*
+ * Register a CU, returning false if it should be skipped.
+ */
+static bool
+dwarf_index_add_cu(Dwarf_Debug dbg, struct dwarf_index *index, Dwarf_Die cu_die, Dwarf_Error *error)
+{
+    struct dwarf_cu cu;
+    cu.die_offset = 0;
+    cu.lines_read = FALSE;
+    if (dwarf_check(dbg, dwarf_dieoffset(cu_die, &cu.die_offset, error), error) != DW_DLV_OK) {
+        return false;
+    }
+
+    index->cus.push_back(std::move(cu));
+    return true;
+}
+
+
+/*
+ * Index the ranges and functions of the CU number b->cu.
+ */
+static void
+dwarf_index_cu(struct dwarf_index_builder *b, Dwarf_Die cu_die)
+{
+    struct dwarf_index *index = b->index;
+
+    // DW_AT_ranges entries are relative to the CU's DW_AT_low_pc
+    b->cu_base = 0;
+    dwarf_check(b->dbg, dwarf_lowpc(cu_die, &b->cu_base, &b->error), &b->error);
+
+    dwarf_pc_ranges ranges;
+    dwarf_get_die_ranges(b, cu_die, ranges);
+    for (auto &pc_range : ranges) {
+        struct dwarf_range range;
+        if (dwarf_index_clip(index, pc_range.first, pc_range.second, &range)) {
+            range.index = b->cu;
+            index->cu_range_storage.push_back(range);
+        }
+    }
+
+    dwarf_index_die_children(b, cu_die);
+}
+
+
+/*
+ * Sort ranges and clip overlapping ones, so that lookups are a simple binary
+ * search.  Overlaps are rare (e.g., GCC nested functions), and the inner
+ * range takes precedence.
+ */
+static void
+dwarf_sort_ranges(std::vector<dwarf_range> &ranges)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const dwarf_range &a, const dwarf_range &b) {
+        return a.lowpc < b.lowpc || (a.lowpc == b.lowpc && a.highpc > b.highpc);
+    });
+
+    size_t j = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        dwarf_range range = ranges[i];
+        if (i + 1 < ranges.size() && range.highpc > ranges[i + 1].lowpc) {
+            range.highpc = ranges[i + 1].lowpc;
+        }
+        if (range.lowpc < range.highpc) {
+            ranges[j++] = range;
+        }
+    }
+    ranges.resize(j);
+    ranges.shrink_to_fit();
+}
+
+
+static const struct dwarf_range *
+dwarf_lookup_range(const dwarf_array<dwarf_range> &ranges, uint32_t rva)
+{
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), rva,
+                               [](uint32_t addr, const dwarf_range &range) {
+                                   return addr < range.lowpc;
+                               });
+    if (it == ranges.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (rva >= it->highpc) {
+        return nullptr;
+    }
+    return it;
+}
+
+
+static uint32_t
+dwarf_build_interval_max(const std::vector<dwarf_range> &ranges,
+                         std::vector<uint32_t> &max,
+                         size_t lo,
+                         size_t hi)
+{
+    if (lo >= hi) {
+        return 0;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    uint32_t highpc = ranges[mid].highpc;
+    highpc = std::max(highpc, dwarf_build_interval_max(ranges, max, lo, mid));
+    highpc = std::max(highpc, dwarf_build_interval_max(ranges, max, mid + 1, hi));
+    max[mid] = highpc;
+    return highpc;
+}
+
+
+/*
+ * Sort possibly overlapping ranges, outer ranges first, and build the
+ * interval tree over them.
+ */
+static void
+dwarf_build_interval_tree(std::vector<dwarf_range> &ranges, std::vector<uint32_t> &max)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const dwarf_range &a, const dwarf_range &b) {
+        return a.lowpc < b.lowpc || (a.lowpc == b.lowpc && a.highpc > b.highpc);
+    });
+    ranges.shrink_to_fit();
+
+    max.resize(ranges.size());
+    dwarf_build_interval_max(ranges, max, 0, ranges.size());
+}
+
+
+/*
+ * Collect the indices of all ranges containing the given address.
+ */
+static void
+dwarf_query_interval_tree(const dwarf_array<dwarf_range> &ranges,
+                          const dwarf_array<uint32_t> &max,
+                          size_t lo,
+                          size_t hi,
+                          uint32_t rva,
+                          std::vector<uint32_t> &indices)
+{
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (max[mid] <= rva) {
+            return;
+        }
+        dwarf_query_interval_tree(ranges, max, lo, mid, rva, indices);
+        if (ranges[mid].lowpc > rva) {
+            return;
+        }
+        if (rva < ranges[mid].highpc) {
+            indices.push_back(ranges[mid].index);
+        }
+        lo = mid + 1;
+    }
+}
+
+
+static int
+dwarf_next_cu(Dwarf_Debug dbg, Dwarf_Half *version_stamp, Dwarf_Error *error)
+{
+    Dwarf_Unsigned cu_header_length = 0;
+    Dwarf_Off abbrev_offset = 0;
+    Dwarf_Half address_size = 0;
+    Dwarf_Half length_size = 0;
+    Dwarf_Half extension_size = 0;
+    Dwarf_Sig8 type_signature;
+    Dwarf_Unsigned typeoffset = 0;
+    Dwarf_Unsigned next_cu_header_offset = 0;
+    Dwarf_Half header_cu_type = 0;
+    return dwarf_check(dbg,
+                       dwarf_next_cu_header_d(dbg, true, &cu_header_length, version_stamp,
+                                              &abbrev_offset, &address_size, &length_size,
+                                              &extension_size, &type_signature, &typeoffset,
+                                              &next_cu_header_offset, &header_cu_type, error),
+                       error);
+}
+
+
+/*
+ * Parallel indexing.
+ *
+ * CUs are split in fixed size batches, which worker threads pick in turn and
+ * index into separate parts, each thread with its own libdwarf instance.
+ * Parts are then merged in order, so that the result doesn't depend on the
+ * scheduling.
+ */
+#define DWARF_INDEX_BATCH_SIZE 64
+#define DWARF_INDEX_MAX_THREADS 32
+
+struct dwarf_index_job {
+    const struct dwarf_index *index;
+    const std::vector<Dwarf_Half> *versions;
+    const struct dwarf_index_opener *opener;
+    std::vector<struct dwarf_index> parts;
+    LONG volatile next_part;
+};
+
+
+static unsigned
+dwarf_index_num_processors(void)
+{
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    return SystemInfo.dwNumberOfProcessors;
+}
+
+
+static void
+dwarf_index_job_run(struct dwarf_index_job *job, Dwarf_Debug dbg)
+{
+    struct dwarf_index_builder b;
+    b.dbg = dbg;
+    b.error = nullptr;
+    b.cu_version = 0;
+    b.cu_base = 0;
+    b.cu = 0;
+    b.function = DWARF_END_SEQUENCE;
+    b.inline_depth = 0;
+
+    size_t num_cus = job->index->cus.size();
+    while (true) {
+        size_t part = InterlockedIncrement(&job->next_part) - 1;
+        if (part >= job->parts.size()) {
+            break;
+        }
+
+        b.index = &job->parts[part];
+        b.string_map.clear();
+
+        size_t end = std::min((part + 1) * DWARF_INDEX_BATCH_SIZE, num_cus);
+        for (size_t i = part * DWARF_INDEX_BATCH_SIZE; i < end; ++i) {
+            Dwarf_Die cu_die = nullptr;
+            if (dwarf_check(dbg,
+                            dwarf_offdie_b(dbg, job->index->cus[i].die_offset, true, &cu_die,
+                                           &b.error),
+                            &b.error) != DW_DLV_OK) {
+                continue;
+            }
+
+            b.cu = i;
+            b.cu_version = (*job->versions)[i];
+            dwarf_index_cu(&b, cu_die);
+
+            dwarf_dealloc_die(cu_die);
+        }
+    }
+}
+
+
+static DWORD WINAPI
+dwarf_index_thread(LPVOID lpParameter)
+{
+    struct dwarf_index_job *job = (struct dwarf_index_job *)lpParameter;
+
+    Dwarf_Debug dbg = nullptr;
+    if (job->opener->open(job->opener->arg, &dbg) == DW_DLV_OK) {
+        dwarf_index_job_run(job, dbg);
+        job->opener->close(job->opener->arg, dbg);
+    }
+
+    return 0;
+}
+
+
+static void
+dwarf_index_cus_parallel(Dwarf_Debug dbg,
+                         struct dwarf_index *index,
+                         const std::vector<Dwarf_Half> &versions,
+                         const struct dwarf_index_opener *opener)
+{
+    struct dwarf_index_job job;
+    job.index = index;
+    job.versions = &versions;
+    job.opener = opener;
+    job.parts.resize((index->cus.size() + DWARF_INDEX_BATCH_SIZE - 1) / DWARF_INDEX_BATCH_SIZE);
+    for (auto &part : job.parts) {
+        part.image_base_vma = index->image_base_vma;
+        part.image_size = index->image_size;
+    }
+    job.next_part = 0;
+
+    size_t num_threads = std::min<size_t>(dwarf_index_num_processors(), DWARF_INDEX_MAX_THREADS);
+    num_threads = std::min(num_threads, job.parts.size());
+
+    // Workers run at this thread's priority, which is lowered when indexing
+    // in the background
+    int nPriority = GetThreadPriority(GetCurrentThread());
+
+    std::vector<HANDLE> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        HANDLE hThread =
+            CreateThread(NULL, 0, dwarf_index_thread, &job, CREATE_SUSPENDED, NULL);
+        if (hThread) {
+            SetThreadPriority(hThread, nPriority);
+            ResumeThread(hThread);
+            threads.push_back(hThread);
+        }
+    }
+
+    // This thread does its share with the original libdwarf instance, which
+    // also guarantees progress should no worker manage to open its own
+    dwarf_index_job_run(&job, dbg);
+
+    if (!threads.empty()) {
+        WaitForMultipleObjects(threads.size(), threads.data(), TRUE, INFINITE);
+        for (HANDLE hThread : threads) {
+            CloseHandle(hThread);
+        }
+    }
+
+    for (auto &part : job.parts) {
+        uint32_t function_base = index->function_storage.size();
+        uint32_t inline_base = index->inline_storage.size();
+        uint32_t string_base = index->string_storage.size();
+        for (auto function : part.function_storage) {
+            function.name += string_base;
+            index->function_storage.push_back(function);
+        }
+        for (auto range : part.function_range_storage) {
+            range.index += function_base;
+            index->function_range_storage.push_back(range);
+        }
+        for (auto inl : part.inline_storage) {
+            inl.name += string_base;
+            inl.function += function_base;
+            index->inline_storage.push_back(inl);
+        }
+        for (auto range : part.inline_range_storage) {
+            range.index += inline_base;
+            index->inline_range_storage.push_back(range);
+        }
+        index->cu_range_storage.insert(index->cu_range_storage.end(),
+                                       part.cu_range_storage.begin(),
+                                       part.cu_range_storage.end());
+        index->string_storage.insert(index->string_storage.end(), part.string_storage.begin(),
+                                     part.string_storage.end());
+    }
+}
+
+
+struct dwarf_index *
+dwarf_index_create(Dwarf_Debug dbg,
+                   Dwarf_Addr image_base_vma,
+                   uint32_t image_size,
+                   const struct dwarf_index_opener *opener)
+{
+    struct dwarf_index *index = new dwarf_index;
+    index->image_base_vma = image_base_vma;
+    index->image_size = image_size;
+    index->hFileMapping = NULL;
+    index->lpView = nullptr;
+    index->nViewSize = 0;
+    index->cached = false;
+    index->num_cached_cus = 0;
+
+    // When indexing in parallel, the first pass merely collects the CUs
+    bool parallel = opener && dwarf_index_num_processors() > 1;
+    std::vector<Dwarf_Half> versions;
+
+    struct dwarf_index_builder b;
+    b.dbg = dbg;
+    b.error = nullptr;
+    b.index = index;
+    b.cu_version = 0;
+    b.cu_base = 0;
+    b.cu = 0;
+    b.function = DWARF_END_SEQUENCE;
+    b.inline_depth = 0;
+
+    int res;
+    while (true) {
+        Dwarf_Half version_stamp = 0;
+        res = dwarf_next_cu(dbg, &version_stamp, &b.error);
+        if (res != DW_DLV_OK) {
+            break;
+        }
+
+        Dwarf_Die cu_die = nullptr;
+        res = dwarf_check(dbg, dwarf_siblingof_b(dbg, nullptr, true, &cu_die, &b.error), &b.error);
+        if (res != DW_DLV_OK) {
+            break;
+        }
+
+        if (dwarf_index_add_cu(dbg, index, cu_die, &b.error)) {
+            if (parallel) {
+                versions.push_back(version_stamp);
+            } else {
+                b.cu = index->cus.size() - 1;
+                b.cu_version = version_stamp;
+                dwarf_index_cu(&b, cu_die);
+            }
+        }
+
+        dwarf_dealloc_die(cu_die);
+    }
+
+    if (res == DW_DLV_ERROR) {
+        // Rewind the CU iteration, so that dwstReadCUs starts afresh
+        Dwarf_Half version_stamp = 0;
+        while (dwarf_next_cu(dbg, &version_stamp, &b.error) == DW_DLV_OK) {
+        }
+
+        delete index;
+        return nullptr;
+    }
+
+    if (parallel) {
+        dwarf_index_cus_parallel(dbg, index, versions, opener);
+    }
+
+    dwarf_sort_ranges(index->function_range_storage);
+    dwarf_sort_ranges(index->cu_range_storage);
+    dwarf_build_interval_tree(index->inline_range_storage, index->inline_max_storage);
+    index->function_storage.shrink_to_fit();
+    index->inline_storage.shrink_to_fit();
+    index->string_storage.shrink_to_fit();
+
+    index->strings = index->string_storage;
+    index->functions = index->function_storage;
+    index->function_ranges = index->function_range_storage;
+    index->cu_ranges = index->cu_range_storage;
+    index->inlines = index->inline_storage;
+    index->inline_ranges = index->inline_range_storage;
+    index->inline_max = index->inline_max_storage;
+
+    return index;
+}
+
+
+void
+dwarf_index_destroy(struct dwarf_index *index)
+{
+    if (index->lpView) {
+        UnmapViewOfFile(index->lpView);
+    }
+    if (index->hFileMapping) {
+        CloseHandle(index->hFileMapping);
+    }
+    delete index;
+}
+
+
+template <typename T>
+static size_t
+dwarf_vector_size(const std::vector<T> &v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+
+/*
+ * Approximate memory used by the index, including its cache file view, if
+ * any, and the line tables decoded so far.
+ */
+size_t
+dwarf_index_memory_usage(const struct dwarf_index *index)
+{
+    size_t size = sizeof *index + index->nViewSize;
+    size += dwarf_vector_size(index->cus);
+    size += dwarf_vector_size(index->string_storage);
+    size += dwarf_vector_size(index->function_storage);
+    size += dwarf_vector_size(index->function_range_storage);
+    size += dwarf_vector_size(index->cu_range_storage);
+    size += dwarf_vector_size(index->inline_storage);
+    size += dwarf_vector_size(index->inline_range_storage);
+    size += dwarf_vector_size(index->inline_max_storage);
+    for (auto &cu : index->cus) {
+        // Line tables may be decoding in another thread
+        if (InterlockedCompareExchange(const_cast<LONG volatile *>(&cu.lines_read), FALSE,
+                                       FALSE)) {
+            size += dwarf_vector_size(cu.line_storage);
+            size += dwarf_vector_size(cu.string_storage);
+            size += dwarf_vector_size(cu.file_storage);
+        }
+    }
+    return size;
+}
+
+
+/*
+ * Line tables are decoded on demand, one CU at a time.
+ */
+static void
+dwarf_index_read_lines(Dwarf_Debug dbg, struct dwarf_index *index, struct dwarf_cu *cu)
+{
+    Dwarf_Error error = nullptr;
+
+    Dwarf_Die cu_die = nullptr;
+    if (dwarf_check(dbg, dwarf_offdie_b(dbg, cu->die_offset, true, &cu_die, &error), &error) !=
+        DW_DLV_OK) {
+        return;
+    }
+
+    Dwarf_Unsigned version = 0;
+    Dwarf_Small table_count = 0;
+    Dwarf_Line_Context context = nullptr;
+    if (dwarf_check(dbg, dwarf_srclines_b(cu_die, &version, &table_count, &context, &error),
+                    &error) != DW_DLV_OK) {
+        dwarf_dealloc_die(cu_die);
+        return;
+    }
+
+    Dwarf_Line *linebuf = nullptr;
+    Dwarf_Signed linecount = 0;
+    if (dwarf_check(dbg, dwarf_srclines_from_linecontext(context, &linebuf, &linecount, &error),
+                    &error) == DW_DLV_OK) {
+        // Map from file numbers to string pool offsets
+        std::unordered_map<Dwarf_Unsigned, uint32_t> files;
+        std::unordered_map<std::string, uint32_t> string_map;
+
+        // File table, for DW_AT_call_file.  File numbers start at 1 before
+        // DWARF 5.
+        char **srcfiles = nullptr;
+        Dwarf_Signed filecount = 0;
+        if (dwarf_check(dbg, dwarf_srcfiles(cu_die, &srcfiles, &filecount, &error), &error) ==
+            DW_DLV_OK) {
+            if (version < 5) {
+                cu->file_storage.push_back(DWARF_END_SEQUENCE);
+            }
+            for (Dwarf_Signed i = 0; i < filecount; ++i) {
+                cu->file_storage.push_back(
+                    dwarf_intern(cu->string_storage, string_map, srcfiles[i]));
+                dwarf_dealloc(dbg, srcfiles[i], DW_DLA_STRING);
+            }
+            dwarf_dealloc(dbg, srcfiles, DW_DLA_LIST);
+        }
+
+        cu->line_storage.reserve(linecount);
+        for (Dwarf_Signed i = 0; i < linecount; ++i) {
+            Dwarf_Line line = linebuf[i];
+
+            Dwarf_Addr addr = 0;
+            if (dwarf_check(dbg, dwarf_lineaddr(line, &addr, &error), &error) != DW_DLV_OK ||
+                addr < index->image_base_vma ||
+                addr - index->image_base_vma > index->image_size) {
+                continue;
+            }
+
+            struct dwarf_line entry;
+            entry.addr = addr - index->image_base_vma;
+            entry.file = DWARF_END_SEQUENCE;
+            entry.line = 0;
+            entry.column = 0;
+
+            Dwarf_Bool end_sequence = false;
+            dwarf_check(dbg, dwarf_lineendsequence(line, &end_sequence, &error), &error);
+            if (!end_sequence) {
+                Dwarf_Unsigned fileno = 0;
+                dwarf_check(dbg, dwarf_line_srcfileno(line, &fileno, &error), &error);
+                auto it = files.find(fileno);
+                if (it == files.end()) {
+                    char *filename = nullptr;
+                    uint32_t file = DWARF_END_SEQUENCE;
+                    if (dwarf_check(dbg, dwarf_linesrc(line, &filename, &error), &error) ==
+                        DW_DLV_OK) {
+                        file = dwarf_intern(cu->string_storage, string_map, filename);
+                        dwarf_dealloc(dbg, filename, DW_DLA_STRING);
+                    }
+                    it = files.emplace(fileno, file).first;
+                }
+                entry.file = it->second;
+
+                Dwarf_Unsigned lineno = 0;
+                dwarf_check(dbg, dwarf_lineno(line, &lineno, &error), &error);
+                entry.line = lineno;
+
+                Dwarf_Unsigned column = 0;
+                dwarf_check(dbg, dwarf_lineoff_b(line, &column, &error), &error);
+                entry.column = column;
+            }
+
+            cu->line_storage.push_back(entry);
+        }
+
+        // Sequences need not be in address order.  When a sequence ends where
+        // another starts, the start must take precedence, as must the last row
+        // for any given address.
+        std::stable_sort(cu->line_storage.begin(), cu->line_storage.end(),
+                         [](const dwarf_line &a, const dwarf_line &b) {
+                             if (a.addr != b.addr) {
+                                 return a.addr < b.addr;
+                             }
+                             return a.file == DWARF_END_SEQUENCE && b.file != DWARF_END_SEQUENCE;
+                         });
+        cu->line_storage.shrink_to_fit();
+        cu->string_storage.shrink_to_fit();
+        cu->file_storage.shrink_to_fit();
+        cu->lines = cu->line_storage;
+        cu->strings = cu->string_storage;
+        cu->files = cu->file_storage;
+    }
+
+    dwarf_srclines_dealloc_b(context);
+    dwarf_dealloc_die(cu_die);
+}
+
+
+/*
+ * Index cache file layout.  The header is followed by the functions, function
+ * ranges, CU ranges, CUs, lines, inlines, inline ranges, inline tree, file
+ * tables, and the string pool, all of which are arrays of 32-bit integers, so
+ * they can be used in place once mapped.
+ */
+#define DWARF_INDEX_MAGIC "MGWHIDX"
+#define DWARF_INDEX_VERSION 3
+
+struct dwarf_index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t TimeDateStamp;
+    uint32_t SizeOfImage;
+    uint32_t CheckSum;
+    uint64_t FileSize;
+    uint64_t image_base_vma;
+    uint32_t image_size;
+    uint32_t num_functions;
+    uint32_t num_function_ranges;
+    uint32_t num_cu_ranges;
+    uint32_t num_cus;
+    uint32_t num_lines;
+    uint32_t num_inlines;
+    uint32_t num_inline_ranges;
+    uint32_t num_files;
+    uint32_t num_strings;
+    uint32_t reserved;
+};
+
+/*
+ * Line tables not decoded by the time the index was saved are left out, and
+ * decoded from the CU's DIE when needed.
+ */
+struct dwarf_index_cu_entry {
+    uint32_t first_line;
+    uint32_t num_lines;
+    uint32_t first_file;
+    uint32_t num_files;
+    uint32_t die_offset_low;
+    uint32_t die_offset_high;
+    uint32_t lines_read;
+};
+
+static_assert(sizeof(dwarf_index_header) % 8 == 0, "unexpected header size");
+static_assert(sizeof(dwarf_function) == 12 && sizeof(dwarf_range) == 12 &&
+                  sizeof(dwarf_line) == 16 && sizeof(dwarf_inline) == 28 &&
+                  sizeof(dwarf_index_cu_entry) == 28,
+              "unexpected index record size");
+
+
+static bool
+dwarf_index_write(HANDLE hFile, const void *data, size_t size)
+{
+    DWORD dwWritten = 0;
+    return size == 0 ||
+           (WriteFile(hFile, data, (DWORD)size, &dwWritten, NULL) && dwWritten == size);
+}
+
+
+/*
+ * Whether the cache lacks any of the index's state, i.e., the index was not
+ * loaded from nor saved to the cache, or line tables were decoded since.
+ */
+bool
+dwarf_index_is_dirty(const struct dwarf_index *index)
+{
+    if (!index->cached) {
+        return true;
+    }
+    uint32_t num_cus = 0;
+    for (auto &cu : index->cus) {
+        num_cus += cu.lines_read ? 1 : 0;
+    }
+    return num_cus != index->num_cached_cus;
+}
+
+
+/*
+ * Line tables decoded from DWARF have their own string pools, which are
+ * appended to the index's in the cache file, whereas those mapped from the
+ * cache file already point into the index's pool.
+ */
+static uint32_t
+dwarf_index_cu_strings_size(const struct dwarf_index *index, const struct dwarf_cu *cu)
+{
+    if (!cu->lines_read || cu->strings.data == index->strings.data) {
+        return 0;
+    }
+    return cu->strings.size;
+}
+
+
+/*
+ * Write the index to a cache file, along with the line tables decoded so far,
+ * as decoding the rest would defeat decoding them lazily.
+ *
+ * The index must not be in use by other threads.
+ */
+bool
+dwarf_index_save(struct dwarf_index *index,
+                 const struct dwarf_index_key *key,
+                 HANDLE hFile)
+{
+    std::vector<dwarf_index_cu_entry> cus;
+    cus.reserve(index->cus.size());
+    uint32_t num_lines = 0;
+    uint32_t num_files = 0;
+    uint32_t num_strings = index->strings.size;
+    uint32_t num_cached_cus = 0;
+    for (auto &cu : index->cus) {
+        struct dwarf_index_cu_entry entry;
+        entry.first_line = num_lines;
+        entry.num_lines = cu.lines_read ? cu.lines.size : 0;
+        entry.first_file = num_files;
+        entry.num_files = cu.lines_read ? cu.files.size : 0;
+        entry.die_offset_low = (uint32_t)cu.die_offset;
+        entry.die_offset_high = (uint32_t)(cu.die_offset >> 32);
+        entry.lines_read = cu.lines_read ? 1 : 0;
+        cus.push_back(entry);
+        num_lines += entry.num_lines;
+        num_files += entry.num_files;
+        num_strings += dwarf_index_cu_strings_size(index, &cu);
+        num_cached_cus += entry.lines_read;
+    }
+
+    struct dwarf_index_header header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, DWARF_INDEX_MAGIC, sizeof header.magic);
+    header.version = DWARF_INDEX_VERSION;
+    header.TimeDateStamp = key->TimeDateStamp;
+    header.SizeOfImage = key->SizeOfImage;
+    header.CheckSum = key->CheckSum;
+    header.FileSize = key->FileSize;
+    header.image_base_vma = index->image_base_vma;
+    header.image_size = index->image_size;
+    header.num_functions = index->functions.size;
+    header.num_function_ranges = index->function_ranges.size;
+    header.num_cu_ranges = index->cu_ranges.size;
+    header.num_cus = cus.size();
+    header.num_lines = num_lines;
+    header.num_inlines = index->inlines.size;
+    header.num_inline_ranges = index->inline_ranges.size;
+    header.num_files = num_files;
+    header.num_strings = num_strings;
+
+    if (!dwarf_index_write(hFile, &header, sizeof header) ||
+        !dwarf_index_write(hFile, index->functions.data,
+                           index->functions.size * sizeof(dwarf_function)) ||
+        !dwarf_index_write(hFile, index->function_ranges.data,
+                           index->function_ranges.size * sizeof(dwarf_range)) ||
+        !dwarf_index_write(hFile, index->cu_ranges.data,
+                           index->cu_ranges.size * sizeof(dwarf_range)) ||
+        !dwarf_index_write(hFile, cus.data(), cus.size() * sizeof(dwarf_index_cu_entry))) {
+        return false;
+    }
+
+    // The CUs' string pools are appended to the index's, so file name
+    // offsets must be rebased
+    uint32_t string_base = index->strings.size;
+    std::vector<dwarf_line> lines;
+    for (auto &cu : index->cus) {
+        if (!cu.lines_read) {
+            continue;
+        }
+        uint32_t cu_strings_size = dwarf_index_cu_strings_size(index, &cu);
+        lines.assign(cu.lines.begin(), cu.lines.end());
+        for (auto &line : lines) {
+            if (line.file != DWARF_END_SEQUENCE && cu_strings_size) {
+                line.file += string_base;
+            }
+        }
+        if (!dwarf_index_write(hFile, lines.data(), lines.size() * sizeof(dwarf_line))) {
+            return false;
+        }
+        string_base += cu_strings_size;
+    }
+
+    if (!dwarf_index_write(hFile, index->inlines.data,
+                           index->inlines.size * sizeof(dwarf_inline)) ||
+        !dwarf_index_write(hFile, index->inline_ranges.data,
+                           index->inline_ranges.size * sizeof(dwarf_range)) ||
+        !dwarf_index_write(hFile, index->inline_max.data,
+                           index->inline_max.size * sizeof(uint32_t))) {
+        return false;
+    }
+
+    string_base = index->strings.size;
+    std::vector<uint32_t> files;
+    for (auto &cu : index->cus) {
+        if (!cu.lines_read) {
+            continue;
+        }
+        uint32_t cu_strings_size = dwarf_index_cu_strings_size(index, &cu);
+        files.assign(cu.files.begin(), cu.files.end());
+        for (auto &file : files) {
+            if (file != DWARF_END_SEQUENCE && cu_strings_size) {
+                file += string_base;
+            }
+        }
+        if (!dwarf_index_write(hFile, files.data(), files.size() * sizeof(uint32_t))) {
+            return false;
+        }
+        string_base += cu_strings_size;
+    }
+
+    if (!dwarf_index_write(hFile, index->strings.data, index->strings.size)) {
+        return false;
+    }
+    for (auto &cu : index->cus) {
+        if (!dwarf_index_write(hFile, cu.strings.data, dwarf_index_cu_strings_size(index, &cu))) {
+            return false;
+        }
+    }
+
+    index->cached = true;
+    index->num_cached_cus = num_cached_cus;
+    return true;
+}
+
+
+/*
+ * Point a new index into a mapped cache file, after validating it, so that a
+ * stale or corrupt file is merely ignored.
+ */
+static struct dwarf_index *
+dwarf_index_from_view(const BYTE *lpView,
+                      uint64_t nSize,
+                      const struct dwarf_index_key *key,
+                      Dwarf_Addr image_base_vma,
+                      uint32_t image_size)
+{
+    if (nSize < sizeof(dwarf_index_header)) {
+        return nullptr;
+    }
+
+    const struct dwarf_index_header *header = (const struct dwarf_index_header *)lpView;
+    if (memcmp(header->magic, DWARF_INDEX_MAGIC, sizeof header->magic) != 0 ||
+        header->version != DWARF_INDEX_VERSION || header->TimeDateStamp != key->TimeDateStamp ||
+        header->SizeOfImage != key->SizeOfImage || header->CheckSum != key->CheckSum ||
+        header->FileSize != key->FileSize || header->image_base_vma != image_base_vma ||
+        header->image_size != image_size) {
+        return nullptr;
+    }
+
+    uint64_t nExpectedSize = sizeof(dwarf_index_header) +
+                             (uint64_t)header->num_functions * sizeof(dwarf_function) +
+                             (uint64_t)header->num_function_ranges * sizeof(dwarf_range) +
+                             (uint64_t)header->num_cu_ranges * sizeof(dwarf_range) +
+                             (uint64_t)header->num_cus * sizeof(dwarf_index_cu_entry) +
+                             (uint64_t)header->num_lines * sizeof(dwarf_line) +
+                             (uint64_t)header->num_inlines * sizeof(dwarf_inline) +
+                             (uint64_t)header->num_inline_ranges *
+                                 (sizeof(dwarf_range) + sizeof(uint32_t)) +
+                             (uint64_t)header->num_files * sizeof(uint32_t) +
+                             header->num_strings;
+    if (nSize != nExpectedSize) {
+        return nullptr;
+    }
+
+    const BYTE *p = lpView + sizeof(dwarf_index_header);
+    dwarf_array<dwarf_function> functions((const dwarf_function *)p, header->num_functions);
+    p += functions.size * sizeof(dwarf_function);
+    dwarf_array<dwarf_range> function_ranges((const dwarf_range *)p, header->num_function_ranges);
+    p += function_ranges.size * sizeof(dwarf_range);
+    dwarf_array<dwarf_range> cu_ranges((const dwarf_range *)p, header->num_cu_ranges);
+    p += cu_ranges.size * sizeof(dwarf_range);
+    dwarf_array<dwarf_index_cu_entry> cus((const dwarf_index_cu_entry *)p, header->num_cus);
+    p += cus.size * sizeof(dwarf_index_cu_entry);
+    dwarf_array<dwarf_line> lines((const dwarf_line *)p, header->num_lines);
+    p += lines.size * sizeof(dwarf_line);
+    dwarf_array<dwarf_inline> inlines((const dwarf_inline *)p, header->num_inlines);
+    p += inlines.size * sizeof(dwarf_inline);
+    dwarf_array<dwarf_range> inline_ranges((const dwarf_range *)p, header->num_inline_ranges);
+    p += inline_ranges.size * sizeof(dwarf_range);
+    dwarf_array<uint32_t> inline_max((const uint32_t *)p, header->num_inline_ranges);
+    p += inline_max.size * sizeof(uint32_t);
+    dwarf_array<uint32_t> files((const uint32_t *)p, header->num_files);
+    p += files.size * sizeof(uint32_t);
+    dwarf_array<char> strings((const char *)p, header->num_strings);
+
+    if (strings.size && strings[strings.size - 1] != '\0') {
+        return nullptr;
+    }
+    for (auto &function : functions) {
+        if (function.name >= strings.size || function.cu >= cus.size) {
+            return nullptr;
+        }
+    }
+    for (auto &range : function_ranges) {
+        if (range.index >= functions.size) {
+            return nullptr;
+        }
+    }
+    for (auto &range : cu_ranges) {
+        if (range.index >= cus.size) {
+            return nullptr;
+        }
+    }
+    for (auto &cu : cus) {
+        if (cu.first_line > lines.size || cu.num_lines > lines.size - cu.first_line ||
+            cu.first_file > files.size || cu.num_files > files.size - cu.first_file ||
+            cu.lines_read > 1) {
+            return nullptr;
+        }
+    }
+    for (auto &line : lines) {
+        if (line.file != DWARF_END_SEQUENCE && line.file >= strings.size) {
+            return nullptr;
+        }
+    }
+    for (auto &inl : inlines) {
+        if (inl.name >= strings.size || inl.function >= functions.size) {
+            return nullptr;
+        }
+    }
+    for (auto &range : inline_ranges) {
+        if (range.index >= inlines.size) {
+            return nullptr;
+        }
+    }
+    for (auto &file : files) {
+        if (file != DWARF_END_SEQUENCE && file >= strings.size) {
+            return nullptr;
+        }
+    }
+
+    struct dwarf_index *index = new dwarf_index;
+    index->image_base_vma = image_base_vma;
+    index->image_size = image_size;
+    index->hFileMapping = NULL;
+    index->lpView = nullptr;
+    index->nViewSize = 0;
+    index->cached = true;
+    index->num_cached_cus = 0;
+    index->strings = strings;
+    index->functions = functions;
+    index->function_ranges = function_ranges;
+    index->cu_ranges = cu_ranges;
+    index->inlines = inlines;
+    index->inline_ranges = inline_ranges;
+    index->inline_max = inline_max;
+    index->cus.resize(cus.size);
+    for (size_t i = 0; i < cus.size; ++i) {
+        struct dwarf_cu *cu = &index->cus[i];
+        cu->die_offset = (Dwarf_Off)cus[i].die_offset_high << 32 | cus[i].die_offset_low;
+        cu->lines_read = cus[i].lines_read;
+        if (cu->lines_read) {
+            cu->strings = strings;
+            cu->lines = dwarf_array<dwarf_line>(lines.data + cus[i].first_line, cus[i].num_lines);
+            cu->files = dwarf_array<uint32_t>(files.data + cus[i].first_file, cus[i].num_files);
+            ++index->num_cached_cus;
+        }
+    }
+
+    return index;
+}
+
+
+/*
+ * Map an index cache file written by dwarf_index_save.  Returns NULL if the
+ * file doesn't match the key.
+ */
+struct dwarf_index *
+dwarf_index_load(HANDLE hFile,
+                 const struct dwarf_index_key *key,
+                 Dwarf_Addr image_base_vma,
+                 uint32_t image_size)
+{
+    LARGE_INTEGER FileSize;
+    if (!GetFileSizeEx(hFile, &FileSize) || FileSize.QuadPart <= 0) {
+        return nullptr;
+    }
+
+    HANDLE hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!hFileMapping) {
+        return nullptr;
+    }
+
+    const BYTE *lpView = (const BYTE *)MapViewOfFile(hFileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!lpView) {
+        CloseHandle(hFileMapping);
+        return nullptr;
+    }
+
+    struct dwarf_index *index =
+        dwarf_index_from_view(lpView, FileSize.QuadPart, key, image_base_vma, image_size);
+    if (!index) {
+        UnmapViewOfFile(lpView);
+        CloseHandle(hFileMapping);
+        return nullptr;
+    }
+
+    index->hFileMapping = hFileMapping;
+    index->lpView = lpView;
+    index->nViewSize = FileSize.QuadPart;
+    return index;
+}
+
+
+static const struct dwarf_function *
+dwarf_index_find_function(const struct dwarf_index *index, uint32_t rva)
+{
+    const struct dwarf_range *range = dwarf_lookup_range(index->function_ranges, rva);
+    if (!range) {
+        return nullptr;
+    }
+    return &index->functions[range->index];
+}
+
+
+static bool
+dwarf_index_find_symbol(const struct dwarf_index *index,
+                        const struct dwarf_function *function,
+                        uint32_t rva,
+                        struct dwarf_symbol_info *info)
+{
+    if (!function) {
+        return false;
+    }
+
+    info->functionname = &index->strings[function->name];
+    info->offset_addr = rva - function->entry;
+    return !info->functionname.empty();
+}
+
+
+/*
+ * Get a CU, decoding its line table first if necessary.  Indices mapped from
+ * the cache only open the DWARF when a line table missing from the cache is
+ * needed.
+ */
+static const struct dwarf_cu *
+dwarf_index_get_cu(struct dwarf_module *module, uint32_t cu_index)
+{
+    struct dwarf_index *index = module->index;
+    struct dwarf_cu *cu = &index->cus[cu_index];
+    if (!InterlockedCompareExchange(&cu->lines_read, FALSE, FALSE)) {
+        AcquireSRWLockExclusive(&module->lock);
+        if (!module->dbg && !module->open_failed && module->opener.open) {
+            if (module->opener.open(module->opener.arg, &module->dbg) != DW_DLV_OK) {
+                module->dbg = nullptr;
+                module->open_failed = true;
+            }
+        }
+        if (!cu->lines_read && module->dbg) {
+            LONG64 start = mgwhelp_stats_clock();
+            dwarf_index_read_lines(module->dbg, index, cu);
+            mgwhelp_stats_add(module->stats, MGWHELP_STAT_CU_READS, 1);
+            mgwhelp_stats_add_time(module->stats, MGWHELP_STAT_CU_READ_TIME, start);
+            InterlockedExchange(&cu->lines_read, TRUE);
+        }
+        ReleaseSRWLockExclusive(&module->lock);
+    }
+    return cu;
+}
+
+
+static bool
+dwarf_utf8_to_wide(const char *s, std::wstring &ws)
+{
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, s, -1, nullptr, 0);
+    if (wlen <= 1) {
+        return false;
+    }
+    ws.resize(wlen - 1);
+    MultiByteToWideChar(CP_UTF8, 0, s, -1, &ws[0], wlen);
+    return true;
+}
+
+
+static bool
+dwarf_index_find_line(struct dwarf_module *module,
+                      const struct dwarf_function *function,
+                      uint32_t rva,
+                      struct dwarf_line_info *info)
+{
+    struct dwarf_index *index = module->index;
+
+    uint32_t cu_index;
+    if (function) {
+        cu_index = function->cu;
+    } else {
+        const struct dwarf_range *range = dwarf_lookup_range(index->cu_ranges, rva);
+        if (!range) {
+            return false;
+        }
+        cu_index = range->index;
+    }
+
+    const struct dwarf_cu *cu = dwarf_index_get_cu(module, cu_index);
+
+    auto it = std::upper_bound(cu->lines.begin(), cu->lines.end(), rva,
+                               [](uint32_t addr, const dwarf_line &line) {
+                                   return addr < line.addr;
+                               });
+    if (it == cu->lines.begin()) {
+        return false;
+    }
+    --it;
+    if (it->file == DWARF_END_SEQUENCE || it->line == 0) {
+        return false;
+    }
+
+    if (!dwarf_utf8_to_wide(&cu->strings[it->file], info->filename)) {
+        return false;
+    }
+
+    // Measure the displacement from the start of the line, rather than of the
+    // row, as a line may span several rows, one per column, but not from
+    // before the start of the function
+    uint32_t entry = function ? function->entry : 0;
+    auto first = it;
+    while (first != cu->lines.begin() && first[-1].file == it->file &&
+           first[-1].line == it->line && first[-1].addr >= entry) {
+        --first;
+    }
+
+    info->line = it->line;
+    info->column = it->column;
+    info->offset_addr = rva - first->addr;
+    return true;
+}
+
 static void
 find_symbol_cbW(uint64_t addr,
                 const wchar_t *filename,
@@ -64,17 +1756,24 @@ find_symbol_cbW(uint64_t addr,
 }
 
 bool
-dwarf_find_symbol(Dwarf_Debug dbg,
-                  void *cuArr,
-                  int cuQty,
+dwarf_find_symbol(struct dwarf_module *module,
                   Dwarf_Addr image_base_vma,
                   wchar_t *name,
                   Dwarf_Addr image_base,
                   Dwarf_Addr addr,
                   struct dwarf_symbol_info *info)
 {
-    dwstOfDwarfDebugW(dbg, image_base_vma, name, image_base, &addr, 1, &find_symbol_cbW, info,
-                      cuArr, cuQty);
+    if (module->index) {
+        uint32_t rva = addr - image_base;
+        const struct dwarf_function *function = dwarf_index_find_function(module->index, rva);
+        return dwarf_index_find_symbol(module->index, function, rva, info);
+    }
+
+    // libdwarf is not thread safe
+    AcquireSRWLockExclusive(&module->lock);
+    dwstOfDwarfDebugW(module->dbg, image_base_vma, name, image_base, &addr, 1, &find_symbol_cbW,
+                      info, module->cuArr, module->cuQty);
+    ReleaseSRWLockExclusive(&module->lock);
     return !info->functionname.empty();
 }
 
@@ -100,22 +1799,249 @@ find_line_cbW(uint64_t addr,
         info->filename = filename ? filename : L"";
         info->offset_addr = addr;
         info->line = lineno;
+        info->column = columnno > 0 ? columnno : 0;
         return;
     }
 }
 
 bool
-dwarf_find_line(Dwarf_Debug dbg,
-                void *cuArr,
-                int cuQty,
+dwarf_find_line(struct dwarf_module *module,
                 Dwarf_Addr image_base_vma,
                 wchar_t *name,
                 Dwarf_Addr image_base,
                 Dwarf_Addr addr,
                 struct dwarf_line_info *info)
 {
-    dwstOfDwarfDebugW(dbg, image_base_vma, name, image_base, &addr, 1, &find_line_cbW, info,
-                      cuArr, cuQty);
+    if (module->index) {
+        uint32_t rva = addr - image_base;
+        const struct dwarf_function *function = dwarf_index_find_function(module->index, rva);
+        return dwarf_index_find_line(module, function, rva, info);
+    }
+
+    AcquireSRWLockExclusive(&module->lock);
+    dwstOfDwarfDebugW(module->dbg, image_base_vma, name, image_base, &addr, 1, &find_line_cbW,
+                      info, module->cuArr, module->cuQty);
+    ReleaseSRWLockExclusive(&module->lock);
 
     return !info->filename.empty();
 }
+
+
+struct find_symbol_line_context {
+    struct dwarf_symbol_info *symbol;
+    struct dwarf_line_info *line;
+};
+
+static void
+find_symbol_line_cbW(uint64_t addr,
+                     const wchar_t *filename,
+                     int lineno,
+                     const char *funcname,
+                     void *context,
+                     int columnno)
+{
+    auto ctx = (struct find_symbol_line_context *)context;
+    find_symbol_cbW(addr, filename, lineno, funcname, ctx->symbol, columnno);
+    find_line_cbW(addr, filename, lineno, funcname, ctx->line, columnno);
+}
+
+/*
+ * Look up both the symbol and the line for an address in a single pass.
+ */
+bool
+dwarf_find_symbol_line(struct dwarf_module *module,
+                       Dwarf_Addr image_base_vma,
+                       wchar_t *name,
+                       Dwarf_Addr image_base,
+                       Dwarf_Addr addr,
+                       struct dwarf_symbol_info *symbol,
+                       struct dwarf_line_info *line)
+{
+    if (module->index) {
+        uint32_t rva = addr - image_base;
+        const struct dwarf_function *function = dwarf_index_find_function(module->index, rva);
+        if (!dwarf_index_find_symbol(module->index, function, rva, symbol)) {
+            return false;
+        }
+        dwarf_index_find_line(module, function, rva, line);
+        return true;
+    }
+
+    struct find_symbol_line_context ctx = {symbol, line};
+    AcquireSRWLockExclusive(&module->lock);
+    dwstOfDwarfDebugW(module->dbg, image_base_vma, name, image_base, &addr, 1,
+                      &find_symbol_line_cbW, &ctx, module->cuArr, module->cuQty);
+    ReleaseSRWLockExclusive(&module->lock);
+    return !symbol->functionname.empty();
+}
+
+
+/*
+ * Look up the symbols and lines of many addresses, which must be sorted in
+ * ascending order.
+ */
+void
+dwarf_find_symbol_lines(struct dwarf_module *module,
+                        Dwarf_Addr image_base_vma,
+                        wchar_t *name,
+                        Dwarf_Addr image_base,
+                        const Dwarf_Addr *addrs,
+                        size_t count,
+                        struct dwarf_symbol_line_info *infos)
+{
+    struct dwarf_index *index = module->index;
+    if (!index) {
+        // dwarfstack's callback doesn't identify which of the input addresses
+        // it reports on, so look them up one by one
+        for (size_t i = 0; i < count; ++i) {
+            infos[i].found = dwarf_find_symbol_line(module, image_base_vma, name, image_base,
+                                                    addrs[i], &infos[i].symbol, &infos[i].line);
+        }
+        return;
+    }
+
+    // Sweep the function ranges once, as the addresses are sorted
+    const dwarf_array<dwarf_range> &ranges = index->function_ranges;
+    auto it = ranges.begin();
+    for (size_t i = 0; i < count; ++i) {
+        assert(i == 0 || addrs[i - 1] <= addrs[i]);
+        uint32_t rva = addrs[i] - image_base;
+
+        it = std::upper_bound(it, ranges.end(), rva, [](uint32_t addr, const dwarf_range &range) {
+            return addr < range.lowpc;
+        });
+
+        const struct dwarf_function *function = nullptr;
+        if (it != ranges.begin() && rva < (it - 1)->highpc) {
+            function = &index->functions[(it - 1)->index];
+        }
+
+        infos[i].found = dwarf_index_find_symbol(index, function, rva, &infos[i].symbol);
+        if (infos[i].found) {
+            dwarf_index_find_line(module, function, rva, &infos[i].line);
+        }
+    }
+}
+
+
+static void
+dwarf_index_find_call_site(const struct dwarf_cu *cu,
+                           const struct dwarf_inline *inl,
+                           uint32_t offset_addr,
+                           struct dwarf_line_info *info)
+{
+    if (inl->call_file < cu->files.size && cu->files[inl->call_file] != DWARF_END_SEQUENCE &&
+        dwarf_utf8_to_wide(&cu->strings[cu->files[inl->call_file]], info->filename)) {
+        info->line = inl->call_line;
+        info->column = inl->call_column;
+        info->offset_addr = offset_addr;
+    }
+}
+
+
+/*
+ * Look up the inlined subroutines containing an address, returning a frame
+ * for each, innermost first, followed by a frame for the function they were
+ * inlined into.  The line of the first frame comes from the line table,
+ * whereas the lines of the following frames are the call sites of the
+ * preceding inlined subroutines.
+ *
+ * Only supported when the module was indexed.
+ */
+bool
+dwarf_find_inline_frames(struct dwarf_module *module,
+                         Dwarf_Addr image_base,
+                         Dwarf_Addr addr,
+                         std::vector<struct dwarf_frame_info> *frames)
+{
+    const struct dwarf_index *index = module->index;
+    if (!index) {
+        return false;
+    }
+
+    uint32_t rva = addr - image_base;
+    const struct dwarf_function *function = dwarf_index_find_function(index, rva);
+    if (!function) {
+        return false;
+    }
+    uint32_t function_index = function - index->functions.data;
+
+    std::vector<uint32_t> indices;
+    dwarf_query_interval_tree(index->inline_ranges, index->inline_max, 0,
+                              index->inline_ranges.size, rva, indices);
+
+    // Discard inlined subroutines from enclosing functions, when the address
+    // falls in a nested function
+    std::vector<const struct dwarf_inline *> inlines;
+    for (uint32_t i : indices) {
+        const struct dwarf_inline *inl = &index->inlines[i];
+        if (inl->function == function_index) {
+            inlines.push_back(inl);
+        }
+    }
+    std::sort(inlines.begin(), inlines.end(),
+              [](const struct dwarf_inline *a, const struct dwarf_inline *b) {
+                  return a->depth > b->depth;
+              });
+
+    frames->clear();
+    frames->resize(inlines.size() + 1);
+
+    for (size_t i = 0; i < inlines.size(); ++i) {
+        const struct dwarf_inline *inl = inlines[i];
+        struct dwarf_frame_info *frame = &(*frames)[i];
+        frame->symbol.functionname = &index->strings[inl->name];
+        frame->symbol.offset_addr = rva >= inl->entry ? rva - inl->entry : 0;
+    }
+    struct dwarf_frame_info *outer = &frames->back();
+    dwarf_index_find_symbol(index, function, rva, &outer->symbol);
+
+    dwarf_index_find_line(module, function, rva, &frames->front().line);
+
+    if (!inlines.empty()) {
+        const struct dwarf_cu *cu = dwarf_index_get_cu(module, function->cu);
+        for (size_t i = 0; i < inlines.size(); ++i) {
+            struct dwarf_frame_info *caller = &(*frames)[i + 1];
+            dwarf_index_find_call_site(cu, inlines[i], caller->symbol.offset_addr,
+                                       &caller->line);
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Enumerate the named functions of the module, along with their entry point
+ * RVA and the size of the code starting there.
+ *
+ * Only supported when the module was indexed.
+ */
+bool
+dwarf_enum_functions(struct dwarf_module *module, dwarf_enum_functions_cb callback, void *arg)
+{
+    const struct dwarf_index *index = module->index;
+    if (!index) {
+        return false;
+    }
+
+    for (size_t i = 0; i < index->functions.size; ++i) {
+        const struct dwarf_function *function = &index->functions[i];
+        const char *name = &index->strings[function->name];
+        if (name[0] == '\0') {
+            continue;
+        }
+
+        // The entry point may lie in a range clipped by a nested function
+        uint32_t size = 0;
+        const struct dwarf_range *range = dwarf_lookup_range(index->function_ranges,
+                                                             function->entry);
+        if (range && range->index == i) {
+            size = range->highpc - function->entry;
+        }
+
+        callback(arg, name, function->entry, size);
+    }
+
+    return true;
+}
@@ -21,9 +21,14 @@
 
 #include "dwarfstack.h"
 #include <string>
+#include <vector>
+
+#include <stdint.h>
 
 #include <stdbool.h>
 
+#include <windows.h>
+
 #include <dwarf.h>
 #include <libdwarf.h>
 
@@ -41,20 +46,98 @@ struct dwarf_symbol_info {
 struct dwarf_line_info {
     std::wstring filename;
     unsigned int line = 0;
+    unsigned int column = 0;
     unsigned int offset_addr;
 };
 
+struct dwarf_symbol_line_info {
+    struct dwarf_symbol_info symbol;
+    struct dwarf_line_info line;
+    bool found = false;
+};
+
+struct dwarf_frame_info {
+    struct dwarf_symbol_info symbol;
+    struct dwarf_line_info line;
+};
+
+struct dwarf_index;
+
+/*
+ * Opens and closes libdwarf instances on the module's debugging information,
+ * so that CUs can be indexed by several threads, as libdwarf instances can't
+ * be shared among threads, and so that indices mapped from the cache can
+ * decode the line tables missing from it.
+ */
+struct dwarf_index_opener {
+    int (*open)(void *arg, Dwarf_Debug *ret_dbg);
+    void (*close)(void *arg, Dwarf_Debug dbg);
+    void *arg;
+};
+
 struct dwarf_module {
     Dwarf_Debug dbg;
+
+    // Serializes libdwarf accesses, i.e., lazy loading and the dwarfstack
+    // fallback, as lookups on the index are otherwise lock free
+    SRWLOCK lock;
+
+    // Flattened address index, built when the module is first queried, or
+    // mapped from the index cache
+    struct dwarf_index *index;
+
+    // Opens dbg on demand, when the index was mapped from the cache, for the
+    // line tables missing from it
+    struct dwarf_index_opener opener;
+    bool open_failed;
+
+    // Only used as fallback, when the index could not be built
     void *cuArr;
     int cuQty;
+
+    // Lookup counters of the owning module
+    struct mgwhelp_stats *stats;
+};
+
+
+struct dwarf_index *
+dwarf_index_create(Dwarf_Debug dbg,
+                   Dwarf_Addr image_base_vma,
+                   uint32_t image_size,
+                   const struct dwarf_index_opener *opener);
+
+void
+dwarf_index_destroy(struct dwarf_index *index);
+
+size_t
+dwarf_index_memory_usage(const struct dwarf_index *index);
+
+/*
+ * Identity of the PE image an index cache file was built for.
+ */
+struct dwarf_index_key {
+    uint32_t TimeDateStamp;
+    uint32_t SizeOfImage;
+    uint32_t CheckSum;
+    uint64_t FileSize;
 };
 
+bool
+dwarf_index_is_dirty(const struct dwarf_index *index);
+
+bool
+dwarf_index_save(struct dwarf_index *index,
+                 const struct dwarf_index_key *key,
+                 HANDLE hFile);
+
+struct dwarf_index *
+dwarf_index_load(HANDLE hFile,
+                 const struct dwarf_index_key *key,
+                 Dwarf_Addr image_base_vma,
+                 uint32_t image_size);
 
 bool
-dwarf_find_symbol(Dwarf_Debug dbg,
-                  void *cuArr,
-                  int cuQty,
+dwarf_find_symbol(struct dwarf_module *module,
                   Dwarf_Addr image_base_vma,
                   wchar_t *name,
                   Dwarf_Addr image_base,
@@ -62,15 +145,42 @@ dwarf_find_symbol(Dwarf_Debug dbg,
                   struct dwarf_symbol_info *info);
 
 bool
-dwarf_find_line(Dwarf_Debug dbg,
-                void *cuArr,
-                int cuQty,
+dwarf_find_line(struct dwarf_module *module,
                 Dwarf_Addr image_base_vma,
                 wchar_t *name,
                 Dwarf_Addr image_base,
                 Dwarf_Addr addr,
                 struct dwarf_line_info *info);
 
+bool
+dwarf_find_symbol_line(struct dwarf_module *module,
+                       Dwarf_Addr image_base_vma,
+                       wchar_t *name,
+                       Dwarf_Addr image_base,
+                       Dwarf_Addr addr,
+                       struct dwarf_symbol_info *symbol,
+                       struct dwarf_line_info *line);
+
+void
+dwarf_find_symbol_lines(struct dwarf_module *module,
+                        Dwarf_Addr image_base_vma,
+                        wchar_t *name,
+                        Dwarf_Addr image_base,
+                        const Dwarf_Addr *addrs,
+                        size_t count,
+                        struct dwarf_symbol_line_info *infos);
+
+bool
+dwarf_find_inline_frames(struct dwarf_module *module,
+                         Dwarf_Addr image_base,
+                         Dwarf_Addr addr,
+                         std::vector<struct dwarf_frame_info> *frames);
+
+typedef void (*dwarf_enum_functions_cb)(void *arg, const char *name, uint32_t rva, uint32_t size);
+
+bool
+dwarf_enum_functions(struct dwarf_module *module, dwarf_enum_functions_cb callback, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,938 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Stack unwinding with DWARF call frame information.
+ *
+ * Only the CIEs and FDEs needed to unwind a frame are decoded, straight
+ * from the mapped image, so that unwinding doesn't depend on libdwarf nor on
+ * the (much larger) debugging information having been loaded.
+ *
+ * See also:
+ * - DWARF 4 standard, section 6.4, "Call Frame Information"
+ * - Linux Standard Base Core Specification, section 10.6, "Exception Frames"
+ */
+
+
+#include "dwarf_frame.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <dwarf.h>
+
+#include "pe_image.h"
+
+
+// Pointer encodings of .eh_frame
+#ifndef DW_EH_PE_absptr
+#define DW_EH_PE_absptr 0x00
+#define DW_EH_PE_uleb128 0x01
+#define DW_EH_PE_udata2 0x02
+#define DW_EH_PE_udata4 0x03
+#define DW_EH_PE_udata8 0x04
+#define DW_EH_PE_sleb128 0x09
+#define DW_EH_PE_sdata2 0x0a
+#define DW_EH_PE_sdata4 0x0b
+#define DW_EH_PE_sdata8 0x0c
+#define DW_EH_PE_pcrel 0x10
+#define DW_EH_PE_indirect 0x80
+#define DW_EH_PE_omit 0xff
+#endif
+
+
+// Maximum DW_CFA_remember_state nesting
+#define DWARF_FRAME_STATE_STACK 8
+
+// Maximum DWARF expression stack depth
+#define DWARF_FRAME_EXPR_STACK 16
+
+
+struct dwarf_frame_reader {
+    const BYTE *p;
+    const BYTE *end;
+    bool bError;
+};
+
+
+static DWORD64
+dwarf_frame_read_fixed(struct dwarf_frame_reader *r, unsigned Size)
+{
+    if ((size_t)(r->end - r->p) < Size) {
+        r->p = r->end;
+        r->bError = true;
+        return 0;
+    }
+
+    DWORD64 Value = 0;
+    for (unsigned i = 0; i < Size; ++i) {
+        Value |= (DWORD64)r->p[i] << (8 * i);
+    }
+    r->p += Size;
+    return Value;
+}
+
+
+static DWORD64
+dwarf_frame_read_uleb128(struct dwarf_frame_reader *r)
+{
+    DWORD64 Value = 0;
+    unsigned Shift = 0;
+    while (r->p < r->end) {
+        BYTE Byte = *r->p++;
+        if (Shift < 64) {
+            Value |= (DWORD64)(Byte & 0x7f) << Shift;
+        }
+        Shift += 7;
+        if (!(Byte & 0x80)) {
+            return Value;
+        }
+    }
+    r->bError = true;
+    return 0;
+}
+
+
+static LONG64
+dwarf_frame_read_sleb128(struct dwarf_frame_reader *r)
+{
+    DWORD64 Value = 0;
+    unsigned Shift = 0;
+    BYTE Byte;
+    do {
+        if (r->p >= r->end) {
+            r->bError = true;
+            return 0;
+        }
+        Byte = *r->p++;
+        if (Shift < 64) {
+            Value |= (DWORD64)(Byte & 0x7f) << Shift;
+        }
+        Shift += 7;
+    } while (Byte & 0x80);
+
+    if (Shift < 64 && (Byte & 0x40)) {
+        Value |= ~(DWORD64)0 << Shift;
+    }
+    return (LONG64)Value;
+}
+
+
+/*
+ * Read a pointer with the given .eh_frame encoding.  Indirect pointers are
+ * not dereferenced, as they are only used for personality routines, which
+ * are merely skipped.
+ */
+static bool
+dwarf_frame_read_pointer(const struct dwarf_frame_table *table,
+                         struct dwarf_frame_reader *r,
+                         BYTE Encoding,
+                         DWORD64 *pValue)
+{
+    DWORD64 FieldVma = table->SectionVma + (r->p - table->pData);
+    DWORD64 Value;
+
+    switch (Encoding & 0x0f) {
+    case DW_EH_PE_absptr:
+        Value = dwarf_frame_read_fixed(r, table->AddressSize);
+        break;
+    case DW_EH_PE_uleb128:
+        Value = dwarf_frame_read_uleb128(r);
+        break;
+    case DW_EH_PE_udata2:
+        Value = dwarf_frame_read_fixed(r, 2);
+        break;
+    case DW_EH_PE_udata4:
+        Value = dwarf_frame_read_fixed(r, 4);
+        break;
+    case DW_EH_PE_udata8:
+        Value = dwarf_frame_read_fixed(r, 8);
+        break;
+    case DW_EH_PE_sleb128:
+        Value = (DWORD64)dwarf_frame_read_sleb128(r);
+        break;
+    case DW_EH_PE_sdata2:
+        Value = (DWORD64)(LONG64)(INT16)dwarf_frame_read_fixed(r, 2);
+        break;
+    case DW_EH_PE_sdata4:
+        Value = (DWORD64)(LONG64)(INT32)dwarf_frame_read_fixed(r, 4);
+        break;
+    case DW_EH_PE_sdata8:
+        Value = dwarf_frame_read_fixed(r, 8);
+        break;
+    default:
+        return false;
+    }
+
+    switch (Encoding & 0x70) {
+    case DW_EH_PE_absptr:
+        break;
+    case DW_EH_PE_pcrel:
+        Value += FieldVma;
+        break;
+    default:
+        // Text, data, and function relative pointers are not used on Windows
+        return false;
+    }
+
+    if (table->AddressSize == 4) {
+        Value &= 0xffffffff;
+    }
+
+    *pValue = Value;
+    return !r->bError;
+}
+
+
+/*
+ * Start reading the CIE or FDE at the given section offset, leaving the
+ * reader past its CIE id (or pointer), and bound to its length.
+ */
+static bool
+dwarf_frame_read_entry(const struct dwarf_frame_table *table,
+                       DWORD Offset,
+                       struct dwarf_frame_reader *r,
+                       DWORD *pId,
+                       DWORD *pIdOffset,
+                       DWORD *pNextOffset)
+{
+    if (Offset >= table->nSize) {
+        return false;
+    }
+
+    r->p = table->pData + Offset;
+    r->end = table->pData + table->nSize;
+    r->bError = false;
+
+    DWORD Length = (DWORD)dwarf_frame_read_fixed(r, 4);
+    // Zero terminates .eh_frame, and 64-bit DWARF is not produced for PE
+    if (r->bError || Length == 0 || Length == 0xffffffff) {
+        return false;
+    }
+    if (Length < 4 || Length > (size_t)(r->end - r->p)) {
+        return false;
+    }
+    r->end = r->p + Length;
+
+    *pIdOffset = (DWORD)(r->p - table->pData);
+    *pId = (DWORD)dwarf_frame_read_fixed(r, 4);
+    *pNextOffset = *pIdOffset + Length;
+    return true;
+}
+
+
+static bool
+dwarf_frame_is_cie(const struct dwarf_frame_table *table, DWORD Id)
+{
+    return table->bEhFrame ? Id == 0 : Id == 0xffffffff;
+}
+
+
+struct dwarf_cie {
+    DWORD64 CodeAlign;
+    LONG64 DataAlign;
+    DWORD ReturnColumn;
+    BYTE FdeEncoding;
+    bool bAugmentationData;
+    const BYTE *pInstructions;
+    const BYTE *pEnd;
+};
+
+
+static bool
+dwarf_frame_read_cie(const struct dwarf_frame_table *table, DWORD Offset, struct dwarf_cie *cie)
+{
+    struct dwarf_frame_reader r;
+    DWORD Id, IdOffset, NextOffset;
+    if (!dwarf_frame_read_entry(table, Offset, &r, &Id, &IdOffset, &NextOffset) ||
+        !dwarf_frame_is_cie(table, Id)) {
+        return false;
+    }
+
+    BYTE Version = (BYTE)dwarf_frame_read_fixed(&r, 1);
+    if (Version != 1 && Version != 3 && Version != 4) {
+        return false;
+    }
+
+    const char *Augmentation = (const char *)r.p;
+    size_t nAugmentationLength = strnlen(Augmentation, r.end - r.p);
+    if (nAugmentationLength == (size_t)(r.end - r.p)) {
+        return false;
+    }
+    r.p += nAugmentationLength + 1;
+
+    if (Version == 4) {
+        BYTE AddressSize = (BYTE)dwarf_frame_read_fixed(&r, 1);
+        BYTE SegmentSize = (BYTE)dwarf_frame_read_fixed(&r, 1);
+        if (AddressSize != table->AddressSize || SegmentSize != 0) {
+            return false;
+        }
+    }
+
+    cie->CodeAlign = dwarf_frame_read_uleb128(&r);
+    cie->DataAlign = dwarf_frame_read_sleb128(&r);
+    if (Version == 1) {
+        cie->ReturnColumn = (DWORD)dwarf_frame_read_fixed(&r, 1);
+    } else {
+        cie->ReturnColumn = (DWORD)dwarf_frame_read_uleb128(&r);
+    }
+
+    cie->FdeEncoding = DW_EH_PE_absptr;
+    cie->bAugmentationData = false;
+
+    if (Augmentation[0] == 'z') {
+        cie->bAugmentationData = true;
+
+        DWORD64 nAugmentationSize = dwarf_frame_read_uleb128(&r);
+        if (r.bError || nAugmentationSize > (size_t)(r.end - r.p)) {
+            return false;
+        }
+        const BYTE *pAugmentationEnd = r.p + nAugmentationSize;
+
+        for (const char *pChar = Augmentation + 1; *pChar; ++pChar) {
+            if (*pChar == 'R') {
+                cie->FdeEncoding = (BYTE)dwarf_frame_read_fixed(&r, 1);
+            } else if (*pChar == 'L') {
+                dwarf_frame_read_fixed(&r, 1);
+            } else if (*pChar == 'P') {
+                BYTE Encoding = (BYTE)dwarf_frame_read_fixed(&r, 1);
+                DWORD64 Personality;
+                if (!dwarf_frame_read_pointer(table, &r, Encoding, &Personality)) {
+                    return false;
+                }
+            } else if (*pChar != 'S') {
+                // Unknown augmentations can still be skipped over
+                break;
+            }
+        }
+
+        r.p = pAugmentationEnd;
+    } else if (Augmentation[0]) {
+        return false;
+    }
+
+    cie->pInstructions = r.p;
+    cie->pEnd = r.end;
+    return !r.bError && cie->CodeAlign != 0;
+}
+
+
+/*
+ * Index all FDEs of the image, sorted by address.
+ *
+ * .eh_frame is preferred, as it's loaded and kept by strip, and GCC emits
+ * it for all functions of i686 code, so it's the only one with complete
+ * coverage.  .debug_frame is used otherwise, e.g., for SJLJ exception
+ * handling builds.
+ */
+struct dwarf_frame_table *
+dwarf_frame_table_create(const struct pe_image *image)
+{
+    bool bEhFrame = true;
+    PIMAGE_SECTION_HEADER pSection = pe_image_find_section(image, ".eh_frame");
+    if (!pSection) {
+        bEhFrame = false;
+        pSection = pe_image_find_section(image, ".debug_frame");
+        if (!pSection) {
+            return NULL;
+        }
+    }
+
+    DWORD nSize = 0;
+    const BYTE *pData = pe_image_section_data(image, pSection, &nSize);
+    if (!pData || !nSize) {
+        return NULL;
+    }
+
+    struct dwarf_frame_table *table = new dwarf_frame_table;
+    table->pData = pData;
+    table->nSize = nSize;
+    table->SectionVma = image->ImageBase + pSection->VirtualAddress;
+    table->ImageBase = image->ImageBase;
+    table->bEhFrame = bEhFrame;
+    table->AddressSize = image->b64Bit ? 8 : 4;
+
+    // There are only a few CIEs, shared by all FDEs, so keep their FDE
+    // pointer encodings
+    std::unordered_map<DWORD, BYTE> Encodings;
+
+    DWORD Offset = 0;
+    struct dwarf_frame_reader r;
+    DWORD Id, IdOffset, NextOffset;
+    while (dwarf_frame_read_entry(table, Offset, &r, &Id, &IdOffset, &NextOffset)) {
+        Offset = NextOffset;
+
+        if (dwarf_frame_is_cie(table, Id)) {
+            continue;
+        }
+
+        DWORD CieOffset;
+        if (bEhFrame) {
+            if (Id > IdOffset) {
+                continue;
+            }
+            CieOffset = IdOffset - Id;
+        } else {
+            CieOffset = Id;
+        }
+
+        BYTE Encoding;
+        auto it = Encodings.find(CieOffset);
+        if (it != Encodings.end()) {
+            Encoding = it->second;
+        } else {
+            struct dwarf_cie cie;
+            Encoding = dwarf_frame_read_cie(table, CieOffset, &cie) ? cie.FdeEncoding
+                                                                    : DW_EH_PE_omit;
+            Encodings[CieOffset] = Encoding;
+        }
+        if (Encoding == DW_EH_PE_omit) {
+            continue;
+        }
+
+        DWORD64 Begin, Range;
+        if (!dwarf_frame_read_pointer(table, &r, Encoding, &Begin) ||
+            !dwarf_frame_read_pointer(table, &r, Encoding & 0x0f, &Range)) {
+            continue;
+        }
+
+        // Skip FDEs of functions discarded by the linker
+        if (Range == 0 || Begin < image->ImageBase ||
+            Begin - image->ImageBase + Range > image->SizeOfImage) {
+            continue;
+        }
+
+        struct dwarf_fde fde;
+        fde.BeginRva = (DWORD)(Begin - image->ImageBase);
+        fde.EndRva = (DWORD)(fde.BeginRva + Range);
+        fde.Offset = IdOffset - 4;
+        fde.CieOffset = CieOffset;
+        table->Fdes.push_back(fde);
+    }
+
+    if (table->Fdes.empty()) {
+        delete table;
+        return NULL;
+    }
+
+    std::sort(table->Fdes.begin(), table->Fdes.end(),
+              [](const struct dwarf_fde &a, const struct dwarf_fde &b) {
+                  return a.BeginRva < b.BeginRva;
+              });
+    table->Fdes.shrink_to_fit();
+
+    return table;
+}
+
+
+void
+dwarf_frame_table_destroy(struct dwarf_frame_table *table)
+{
+    delete table;
+}
+
+
+/*
+ * Find the FDE covering the address, whose range is that of the function
+ * containing it, or of a part of it.
+ */
+const struct dwarf_fde *
+dwarf_frame_find_fde(const struct dwarf_frame_table *table, DWORD Rva)
+{
+    auto it = std::upper_bound(table->Fdes.begin(), table->Fdes.end(), Rva,
+                               [](DWORD Value, const struct dwarf_fde &fde) {
+                                   return Value < fde.BeginRva;
+                               });
+    if (it == table->Fdes.begin()) {
+        return NULL;
+    }
+    --it;
+
+    if (Rva >= it->EndRva) {
+        return NULL;
+    }
+
+    return &*it;
+}
+
+
+enum dwarf_rule_type {
+    DWARF_RULE_SAME_VALUE,
+    DWARF_RULE_UNDEFINED,
+    DWARF_RULE_OFFSET,
+    DWARF_RULE_VAL_OFFSET,
+    DWARF_RULE_REGISTER,
+    DWARF_RULE_EXPRESSION,
+    DWARF_RULE_VAL_EXPRESSION,
+};
+
+struct dwarf_rule {
+    enum dwarf_rule_type Type;
+    LONG64 Value; // offset or register
+    const BYTE *pExpression;
+    size_t nExpressionSize;
+};
+
+struct dwarf_frame_state {
+    DWORD CfaRegister;
+    LONG64 CfaOffset;
+    const BYTE *pCfaExpression; // NULL unless the CFA is defined by an expression
+    size_t nCfaExpressionSize;
+    struct dwarf_rule Rules[DWARF_X86_REGS];
+};
+
+
+/*
+ * Run call frame instructions, up to the given address.
+ */
+static bool
+dwarf_frame_execute(const struct dwarf_frame_table *table,
+                    const struct dwarf_cie *cie,
+                    const BYTE *pInstructions,
+                    const BYTE *pEnd,
+                    DWORD64 Location,
+                    DWORD64 Address,
+                    const struct dwarf_frame_state *initial,
+                    struct dwarf_frame_state *state)
+{
+    struct dwarf_frame_state stack[DWARF_FRAME_STATE_STACK];
+    unsigned nStackDepth = 0;
+
+    struct dwarf_frame_reader r = {pInstructions, pEnd, false};
+    while (r.p < r.end && !r.bError) {
+        BYTE Opcode = *r.p++;
+        DWORD Register = DWARF_X86_REGS;
+        struct dwarf_rule Rule = {DWARF_RULE_SAME_VALUE, 0, NULL, 0};
+        bool bRule = false;
+
+        switch (Opcode & 0xc0) {
+        case DW_CFA_advance_loc:
+            Location += (Opcode & 0x3f) * cie->CodeAlign;
+            if (Location > Address) {
+                return true;
+            }
+            continue;
+        case DW_CFA_offset:
+            Register = Opcode & 0x3f;
+            Rule.Type = DWARF_RULE_OFFSET;
+            Rule.Value = (LONG64)dwarf_frame_read_uleb128(&r) * cie->DataAlign;
+            bRule = true;
+            break;
+        case DW_CFA_restore:
+            Register = Opcode & 0x3f;
+            if (!initial) {
+                return false;
+            }
+            if (Register < DWARF_X86_REGS) {
+                state->Rules[Register] = initial->Rules[Register];
+            }
+            continue;
+        default:
+            break;
+        }
+
+        if (!bRule) {
+            DWORD64 Delta;
+            switch (Opcode) {
+            case DW_CFA_nop:
+            case DW_CFA_GNU_args_size:
+                if (Opcode == DW_CFA_GNU_args_size) {
+                    dwarf_frame_read_uleb128(&r);
+                }
+                continue;
+            case DW_CFA_set_loc:
+                if (!dwarf_frame_read_pointer(table, &r, cie->FdeEncoding, &Location)) {
+                    return false;
+                }
+                if (Location > Address) {
+                    return true;
+                }
+                continue;
+            case DW_CFA_advance_loc1:
+            case DW_CFA_advance_loc2:
+            case DW_CFA_advance_loc4:
+                Delta = dwarf_frame_read_fixed(&r, Opcode == DW_CFA_advance_loc1   ? 1
+                                                   : Opcode == DW_CFA_advance_loc2 ? 2
+                                                                                   : 4);
+                Location += Delta * cie->CodeAlign;
+                if (Location > Address) {
+                    return !r.bError;
+                }
+                continue;
+            case DW_CFA_offset_extended:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_OFFSET;
+                Rule.Value = (LONG64)dwarf_frame_read_uleb128(&r) * cie->DataAlign;
+                break;
+            case DW_CFA_offset_extended_sf:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_OFFSET;
+                Rule.Value = dwarf_frame_read_sleb128(&r) * cie->DataAlign;
+                break;
+            case DW_CFA_GNU_negative_offset_extended:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_OFFSET;
+                Rule.Value = -(LONG64)dwarf_frame_read_uleb128(&r) * cie->DataAlign;
+                break;
+            case DW_CFA_val_offset:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_VAL_OFFSET;
+                Rule.Value = (LONG64)dwarf_frame_read_uleb128(&r) * cie->DataAlign;
+                break;
+            case DW_CFA_val_offset_sf:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_VAL_OFFSET;
+                Rule.Value = dwarf_frame_read_sleb128(&r) * cie->DataAlign;
+                break;
+            case DW_CFA_restore_extended:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                if (!initial) {
+                    return false;
+                }
+                if (Register < DWARF_X86_REGS) {
+                    state->Rules[Register] = initial->Rules[Register];
+                }
+                continue;
+            case DW_CFA_undefined:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_UNDEFINED;
+                break;
+            case DW_CFA_same_value:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_SAME_VALUE;
+                break;
+            case DW_CFA_register:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = DWARF_RULE_REGISTER;
+                Rule.Value = (LONG64)dwarf_frame_read_uleb128(&r);
+                break;
+            case DW_CFA_expression:
+            case DW_CFA_val_expression:
+                Register = (DWORD)dwarf_frame_read_uleb128(&r);
+                Rule.Type = Opcode == DW_CFA_expression ? DWARF_RULE_EXPRESSION
+                                                        : DWARF_RULE_VAL_EXPRESSION;
+                Rule.nExpressionSize = (size_t)dwarf_frame_read_uleb128(&r);
+                Rule.pExpression = r.p;
+                if (Rule.nExpressionSize > (size_t)(r.end - r.p)) {
+                    return false;
+                }
+                r.p += Rule.nExpressionSize;
+                break;
+            case DW_CFA_remember_state:
+                if (nStackDepth >= DWARF_FRAME_STATE_STACK) {
+                    return false;
+                }
+                stack[nStackDepth++] = *state;
+                continue;
+            case DW_CFA_restore_state:
+                if (nStackDepth == 0) {
+                    return false;
+                }
+                *state = stack[--nStackDepth];
+                continue;
+            case DW_CFA_def_cfa:
+                state->CfaRegister = (DWORD)dwarf_frame_read_uleb128(&r);
+                state->CfaOffset = (LONG64)dwarf_frame_read_uleb128(&r);
+                state->pCfaExpression = NULL;
+                continue;
+            case DW_CFA_def_cfa_sf:
+                state->CfaRegister = (DWORD)dwarf_frame_read_uleb128(&r);
+                state->CfaOffset = dwarf_frame_read_sleb128(&r) * cie->DataAlign;
+                state->pCfaExpression = NULL;
+                continue;
+            case DW_CFA_def_cfa_register:
+                state->CfaRegister = (DWORD)dwarf_frame_read_uleb128(&r);
+                state->pCfaExpression = NULL;
+                continue;
+            case DW_CFA_def_cfa_offset:
+                state->CfaOffset = (LONG64)dwarf_frame_read_uleb128(&r);
+                continue;
+            case DW_CFA_def_cfa_offset_sf:
+                state->CfaOffset = dwarf_frame_read_sleb128(&r) * cie->DataAlign;
+                continue;
+            case DW_CFA_def_cfa_expression:
+                state->nCfaExpressionSize = (size_t)dwarf_frame_read_uleb128(&r);
+                state->pCfaExpression = r.p;
+                if (state->nCfaExpressionSize > (size_t)(r.end - r.p)) {
+                    return false;
+                }
+                r.p += state->nCfaExpressionSize;
+                continue;
+            default:
+                return false;
+            }
+        }
+
+        // Rules of registers other than the general purpose ones are ignored
+        if (Register < DWARF_X86_REGS) {
+            state->Rules[Register] = Rule;
+        }
+    }
+
+    return !r.bError;
+}
+
+
+/*
+ * Evaluate the subset of DWARF expressions GCC emits for call frame
+ * information, e.g., for functions that realign the stack.
+ */
+static bool
+dwarf_frame_evaluate(const BYTE *pExpression,
+                     size_t nExpressionSize,
+                     const DWORD Regs[DWARF_X86_REGS],
+                     const DWORD *pInitial,
+                     dwarf_frame_read_fn read,
+                     void *arg,
+                     DWORD *pResult)
+{
+    DWORD stack[DWARF_FRAME_EXPR_STACK];
+    unsigned nDepth = 0;
+
+    if (pInitial) {
+        stack[nDepth++] = *pInitial;
+    }
+
+    struct dwarf_frame_reader r = {pExpression, pExpression + nExpressionSize, false};
+    while (r.p < r.end && !r.bError) {
+        BYTE Opcode = *r.p++;
+
+        if (Opcode >= DW_OP_lit0 && Opcode <= DW_OP_lit31) {
+            if (nDepth >= DWARF_FRAME_EXPR_STACK) {
+                return false;
+            }
+            stack[nDepth++] = Opcode - DW_OP_lit0;
+            continue;
+        }
+
+        if (Opcode >= DW_OP_breg0 && Opcode <= DW_OP_breg31) {
+            DWORD Register = Opcode - DW_OP_breg0;
+            LONG64 Offset = dwarf_frame_read_sleb128(&r);
+            if (Register >= DWARF_X86_REGS || nDepth >= DWARF_FRAME_EXPR_STACK) {
+                return false;
+            }
+            stack[nDepth++] = (DWORD)(Regs[Register] + Offset);
+            continue;
+        }
+
+        DWORD Value;
+        switch (Opcode) {
+        case DW_OP_const1u:
+        case DW_OP_const1s:
+        case DW_OP_const2u:
+        case DW_OP_const2s:
+        case DW_OP_const4u:
+        case DW_OP_const4s:
+            if (nDepth >= DWARF_FRAME_EXPR_STACK) {
+                return false;
+            }
+            if (Opcode == DW_OP_const1u) {
+                Value = (BYTE)dwarf_frame_read_fixed(&r, 1);
+            } else if (Opcode == DW_OP_const1s) {
+                Value = (DWORD)(INT8)dwarf_frame_read_fixed(&r, 1);
+            } else if (Opcode == DW_OP_const2u) {
+                Value = (WORD)dwarf_frame_read_fixed(&r, 2);
+            } else if (Opcode == DW_OP_const2s) {
+                Value = (DWORD)(INT16)dwarf_frame_read_fixed(&r, 2);
+            } else {
+                Value = (DWORD)dwarf_frame_read_fixed(&r, 4);
+            }
+            stack[nDepth++] = Value;
+            break;
+        case DW_OP_dup:
+            if (nDepth == 0 || nDepth >= DWARF_FRAME_EXPR_STACK) {
+                return false;
+            }
+            stack[nDepth] = stack[nDepth - 1];
+            ++nDepth;
+            break;
+        case DW_OP_drop:
+            if (nDepth == 0) {
+                return false;
+            }
+            --nDepth;
+            break;
+        case DW_OP_deref:
+            if (nDepth == 0 || !read(arg, stack[nDepth - 1], &stack[nDepth - 1])) {
+                return false;
+            }
+            break;
+        case DW_OP_plus_uconst:
+            if (nDepth == 0) {
+                return false;
+            }
+            stack[nDepth - 1] += (DWORD)dwarf_frame_read_uleb128(&r);
+            break;
+        case DW_OP_plus:
+        case DW_OP_minus:
+        case DW_OP_and:
+            if (nDepth < 2) {
+                return false;
+            }
+            Value = stack[--nDepth];
+            if (Opcode == DW_OP_plus) {
+                stack[nDepth - 1] += Value;
+            } else if (Opcode == DW_OP_minus) {
+                stack[nDepth - 1] -= Value;
+            } else {
+                stack[nDepth - 1] &= Value;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (r.bError || nDepth == 0) {
+        return false;
+    }
+
+    *pResult = stack[nDepth - 1];
+    return true;
+}
+
+
+/*
+ * Unwind a frame of 32-bit code, replacing the registers with the caller's.
+ *
+ * Return addresses point past the call instruction, which might be the
+ * start of another function (e.g., after calls to noreturn functions), so
+ * bReturnAddress tells to look up the rules of the preceding byte.
+ */
+bool
+dwarf_frame_unwind_x86(const struct dwarf_frame_table *table,
+                       DWORD64 ModuleBase,
+                       bool bReturnAddress,
+                       DWORD Regs[DWARF_X86_REGS],
+                       dwarf_frame_read_fn read,
+                       void *arg)
+{
+    DWORD Rva = (DWORD)(Regs[DWARF_X86_EIP] - ModuleBase);
+    if (bReturnAddress) {
+        --Rva;
+    }
+
+    const struct dwarf_fde *fde = dwarf_frame_find_fde(table, Rva);
+    if (!fde) {
+        return false;
+    }
+
+    struct dwarf_cie cie;
+    if (!dwarf_frame_read_cie(table, fde->CieOffset, &cie) ||
+        cie.ReturnColumn >= DWARF_X86_REGS) {
+        return false;
+    }
+
+    // Skip the FDE header
+    struct dwarf_frame_reader r;
+    DWORD Id, IdOffset, NextOffset;
+    DWORD64 Begin, Range;
+    if (!dwarf_frame_read_entry(table, fde->Offset, &r, &Id, &IdOffset, &NextOffset) ||
+        !dwarf_frame_read_pointer(table, &r, cie.FdeEncoding, &Begin) ||
+        !dwarf_frame_read_pointer(table, &r, cie.FdeEncoding & 0x0f, &Range)) {
+        return false;
+    }
+    if (cie.bAugmentationData) {
+        DWORD64 nAugmentationSize = dwarf_frame_read_uleb128(&r);
+        if (r.bError || nAugmentationSize > (size_t)(r.end - r.p)) {
+            return false;
+        }
+        r.p += nAugmentationSize;
+    }
+
+    struct dwarf_frame_state initial;
+    ZeroMemory(&initial, sizeof initial);
+    DWORD64 Address = table->ImageBase + Rva;
+    if (!dwarf_frame_execute(table, &cie, cie.pInstructions, cie.pEnd, Begin, Address, NULL,
+                             &initial)) {
+        return false;
+    }
+    struct dwarf_frame_state state = initial;
+    if (!dwarf_frame_execute(table, &cie, r.p, r.end, Begin, Address, &initial, &state)) {
+        return false;
+    }
+
+    DWORD Cfa;
+    if (state.pCfaExpression) {
+        if (!dwarf_frame_evaluate(state.pCfaExpression, state.nCfaExpressionSize, Regs, NULL,
+                                  read, arg, &Cfa)) {
+            return false;
+        }
+    } else {
+        if (state.CfaRegister >= DWARF_X86_REGS) {
+            return false;
+        }
+        Cfa = (DWORD)(Regs[state.CfaRegister] + state.CfaOffset);
+    }
+
+    // The outermost frame has its return address undefined
+    const struct dwarf_rule *ReturnRule = &state.Rules[cie.ReturnColumn];
+    if (ReturnRule->Type == DWARF_RULE_UNDEFINED || ReturnRule->Type == DWARF_RULE_SAME_VALUE) {
+        return false;
+    }
+
+    DWORD CallerRegs[DWARF_X86_REGS];
+    memcpy(CallerRegs, Regs, sizeof CallerRegs);
+
+    // The CFA is by definition the stack pointer at the call site
+    CallerRegs[DWARF_X86_ESP] = Cfa;
+
+    for (DWORD Register = 0; Register < DWARF_X86_REGS; ++Register) {
+        const struct dwarf_rule *Rule = &state.Rules[Register];
+        DWORD Value;
+        switch (Rule->Type) {
+        case DWARF_RULE_SAME_VALUE:
+        case DWARF_RULE_UNDEFINED:
+            continue;
+        case DWARF_RULE_OFFSET:
+            if (!read(arg, (DWORD)(Cfa + Rule->Value), &Value)) {
+                return false;
+            }
+            break;
+        case DWARF_RULE_VAL_OFFSET:
+            Value = (DWORD)(Cfa + Rule->Value);
+            break;
+        case DWARF_RULE_REGISTER:
+            if (Rule->Value < 0 || Rule->Value >= DWARF_X86_REGS) {
+                return false;
+            }
+            Value = Regs[Rule->Value];
+            break;
+        case DWARF_RULE_EXPRESSION:
+        case DWARF_RULE_VAL_EXPRESSION:
+            if (!dwarf_frame_evaluate(Rule->pExpression, Rule->nExpressionSize, Regs, &Cfa,
+                                      read, arg, &Value)) {
+                return false;
+            }
+            if (Rule->Type == DWARF_RULE_EXPRESSION && !read(arg, Value, &Value)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        CallerRegs[Register] = Value;
+    }
+
+    CallerRegs[DWARF_X86_EIP] = CallerRegs[cie.ReturnColumn];
+
+    memcpy(Regs, CallerRegs, sizeof CallerRegs);
+    return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+
+struct pe_image;
+
+
+struct dwarf_fde {
+    DWORD BeginRva;
+    DWORD EndRva;
+    DWORD Offset; // of the FDE within the section
+    DWORD CieOffset;
+};
+
+
+/*
+ * Call frame information of an image, i.e., its .eh_frame or .debug_frame
+ * section, with FDEs sorted by address, as .eh_frame_hdr would have them.
+ */
+struct dwarf_frame_table {
+    const BYTE *pData;
+    DWORD nSize;
+    DWORD64 SectionVma;
+    DWORD64 ImageBase;
+    bool bEhFrame;
+    BYTE AddressSize;
+
+    std::vector<struct dwarf_fde> Fdes;
+};
+
+
+/*
+ * Registers unwound, numbered as in the i386 DWARF register mapping.
+ */
+enum {
+    DWARF_X86_EAX,
+    DWARF_X86_ECX,
+    DWARF_X86_EDX,
+    DWARF_X86_EBX,
+    DWARF_X86_ESP,
+    DWARF_X86_EBP,
+    DWARF_X86_ESI,
+    DWARF_X86_EDI,
+    DWARF_X86_EIP,
+    DWARF_X86_REGS
+};
+
+
+typedef bool (*dwarf_frame_read_fn)(void *arg, DWORD64 Address, DWORD *pValue);
+
+
+struct dwarf_frame_table *
+dwarf_frame_table_create(const struct pe_image *image);
+
+void
+dwarf_frame_table_destroy(struct dwarf_frame_table *table);
+
+const struct dwarf_fde *
+dwarf_frame_find_fde(const struct dwarf_frame_table *table, DWORD Rva);
+
+bool
+dwarf_frame_unwind_x86(const struct dwarf_frame_table *table,
+                       DWORD64 ModuleBase,
+                       bool bReturnAddress,
+                       DWORD Regs[DWARF_X86_REGS],
+                       dwarf_frame_read_fn read,
+                       void *arg);
@@ -26,29 +26,15 @@
 #include <windows.h>
 
 #include <string>
-#include <vector>
 
 #include "dwarf.h"
 #include "libdwarf.h"
 #include "dwarf_base_types.h"
 #include "dwarf_opaque.h"  // for Dwarf_Debug_s
 
+#include "debug_file.h"
 #include "outdbg.h"
-#include "paths.h"
-
-
-typedef struct {
-    HANDLE hFileMapping;
-    SIZE_T nFileSize;
-    union {
-        PBYTE lpFileBase;
-        PIMAGE_DOS_HEADER pDosHeader;
-    };
-    PIMAGE_NT_HEADERS pNtHeaders;
-    PIMAGE_SECTION_HEADER Sections;
-    PIMAGE_SYMBOL pSymbolTable;
-    PSTR pStringTable;
-} pe_access_object_t;
+#include "pe_image.h"
 
 
 static int
@@ -57,7 +43,7 @@ pe_get_section_info(void *obj,
                     Dwarf_Obj_Access_Section_a *return_section,
                     int *error)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
+    struct pe_image *image = (struct pe_image *)obj;
 
     return_section->as_addr = 0;
     if (section_index == 0) {
@@ -66,16 +52,11 @@ pe_get_section_info(void *obj,
         return_section->as_size = 0;
         return_section->as_name = "";
     } else {
-        PIMAGE_SECTION_HEADER pSection = pe_obj->Sections + section_index - 1;
-        if (pSection->Misc.VirtualSize < pSection->SizeOfRawData) {
-            return_section->as_size = pSection->Misc.VirtualSize;
-        } else {
-            return_section->as_size = pSection->SizeOfRawData;
-        }
-        return_section->as_name = (const char *)pSection->Name;
-        if (return_section->as_name[0] == '/') {
-            return_section->as_name = &pe_obj->pStringTable[atoi(&return_section->as_name[1])];
-        }
+        PIMAGE_SECTION_HEADER pSection = image->Sections + section_index - 1;
+        DWORD Size = 0;
+        pe_image_section_data(image, pSection, &Size);
+        return_section->as_size = Size;
+        return_section->as_name = image->SectionNames[section_index - 1].c_str();
     }
     return_section->as_link = 0;
     return_section->as_info = 0;
@@ -96,46 +77,41 @@ pe_get_byte_order(void *obj)
 static Dwarf_Small
 pe_get_length_pointer_size(void *obj)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
-    PIMAGE_OPTIONAL_HEADER pOptionalHeader = &pe_obj->pNtHeaders->OptionalHeader;
-
-    switch (pOptionalHeader->Magic) {
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
-        return 4;
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
-        return 8;
-    default:
-        return 0;
-    }
+    struct pe_image *image = (struct pe_image *)obj;
+    return image->b64Bit ? 8 : 4;
 }
 
 
 static Dwarf_Unsigned
 pe_get_filesize(void* obj)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
-    return pe_obj->nFileSize;
+    struct pe_image *image = (struct pe_image *)obj;
+    return image->nFileSize;
 }
 
 
 static Dwarf_Unsigned
 pe_get_section_count(void *obj)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
-    PIMAGE_FILE_HEADER pFileHeader = &pe_obj->pNtHeaders->FileHeader;
-    return pFileHeader->NumberOfSections + 1;
+    struct pe_image *image = (struct pe_image *)obj;
+    return image->NumberOfSections + 1;
 }
 
 
 static int
 pe_load_section(void *obj, Dwarf_Unsigned section_index, Dwarf_Small **return_data, int *error)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
+    struct pe_image *image = (struct pe_image *)obj;
     if (section_index == 0) {
         return DW_DLV_NO_ENTRY;
     } else {
-        PIMAGE_SECTION_HEADER pSection = pe_obj->Sections + section_index - 1;
-        *return_data = pe_obj->lpFileBase + pSection->PointerToRawData;
+        PIMAGE_SECTION_HEADER pSection = image->Sections + section_index - 1;
+        DWORD Size = 0;
+        const BYTE *data = pe_image_section_data(image, pSection, &Size);
+        if (!data) {
+            return DW_DLV_NO_ENTRY;
+        }
+        *return_data = (Dwarf_Small *)data;
         return DW_DLV_OK;
     }
 }
@@ -153,134 +129,64 @@ static const Dwarf_Obj_Access_Methods_a pe_methods = {
 };
 
 
-int
-mgwhelp_dwarf_pe_init(HANDLE hFile,
-                      const wchar_t *image,
-                      Dwarf_Handler errhand,
-                      Dwarf_Ptr errarg,
-                      Dwarf_Debug *ret_dbg,
-                      Dwarf_Error *error)
+static int
+pe_object_init(struct pe_image *image,
+               Dwarf_Handler errhand,
+               Dwarf_Ptr errarg,
+               Dwarf_Debug *ret_dbg,
+               Dwarf_Error *error)
 {
-    int res = DW_DLV_ERROR;
-    pe_access_object_t *pe_obj;
-    DWORD dwFileSizeHi;
-    DWORD dwFileSizeLo;
-    Dwarf_Unsigned section_count;
-
-    /* Initialize the internal struct */
-    pe_obj = (pe_access_object_t *)calloc(1, sizeof *pe_obj);
-    if (!pe_obj) {
-        goto no_internals;
-    }
+    Dwarf_Obj_Access_Interface_a *intfc;
 
-    pe_obj->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (!pe_obj->hFileMapping) {
-        goto no_file_mapping;
+    /* Initialize the interface struct */
+    intfc = (Dwarf_Obj_Access_Interface_a *)calloc(1, sizeof *intfc);
+    if (!intfc) {
+        return DW_DLV_ERROR;
     }
+    intfc->ai_object = pe_image_ref(image);
+    intfc->ai_methods = &pe_methods;
 
-    pe_obj->lpFileBase = (PBYTE)MapViewOfFile(pe_obj->hFileMapping, FILE_MAP_READ, 0, 0, 0);
-    if (!pe_obj->lpFileBase) {
-        goto no_view_of_file;
-    }
-
-    dwFileSizeHi = 0;
-    dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
-    pe_obj->nFileSize = dwFileSizeLo;
-#ifdef _WIN64
-    pe_obj->nFileSize |= (SIZE_T)dwFileSizeHi << 32;
-#else
-    assert(dwFileSizeHi == 0);
-#endif
-
-    pe_obj->pNtHeaders = (PIMAGE_NT_HEADERS)(pe_obj->lpFileBase + pe_obj->pDosHeader->e_lfanew);
-    pe_obj->Sections = (PIMAGE_SECTION_HEADER)((PBYTE)pe_obj->pNtHeaders + sizeof(DWORD) +
-                                               sizeof(IMAGE_FILE_HEADER) +
-                                               pe_obj->pNtHeaders->FileHeader.SizeOfOptionalHeader);
-    pe_obj->pSymbolTable =
-        (PIMAGE_SYMBOL)(pe_obj->lpFileBase + pe_obj->pNtHeaders->FileHeader.PointerToSymbolTable);
-    if (pe_obj->pNtHeaders->FileHeader.PointerToSymbolTable +
-            pe_obj->pNtHeaders->FileHeader.NumberOfSymbols * sizeof pe_obj->pSymbolTable[0] >
-        pe_obj->nFileSize) {
-        OutputDebug("MGWHELP: %ls - symbol table extends beyond image size\n", image);
-        goto no_intfc;
+    int res = dwarf_object_init_b(intfc, errhand, errarg, DW_GROUPNUMBER_ANY, ret_dbg, error);
+    if (res != DW_DLV_OK) {
+        pe_image_unref(image);
+        free(intfc);
     }
 
-    pe_obj->pStringTable =
-        (PSTR)&pe_obj->pSymbolTable[pe_obj->pNtHeaders->FileHeader.NumberOfSymbols];
-
-    // https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
-    section_count = pe_get_section_count(pe_obj);
-    for (Dwarf_Unsigned section_index = 0; section_index < section_count; ++section_index) {
-        Dwarf_Obj_Access_Section_a doas;
-        memset(&doas, 0, sizeof doas);
-        int err = 0;
-        pe_get_section_info(pe_obj, section_index, &doas, &err);
-        if (!doas.as_size) {
-            continue;
-        }
+    return res;
+}
 
-        if (strcmp(doas.as_name, ".gnu_debuglink") == 0) {
-            Dwarf_Small *data;
-            if (DW_DLV_OK != pe_load_section(pe_obj, section_index, &data, &err)) {
-                continue;
-            }
-            // debuglink is an ASCII filename from the .gnu_debuglink DWARF section
-            const char *debuglink = (const char *)data;
-            int wlen = MultiByteToWideChar(CP_UTF8, 0, debuglink, -1, nullptr, 0);
-            if (wlen <= 0) {
-                continue;
-            }
-            std::vector<wchar_t> wbuf(wlen);
-            MultiByteToWideChar(CP_UTF8, 0, debuglink, -1, wbuf.data(), wlen);
-            std::wstring wDebuglink(wbuf.data());
 
-            std::vector<std::wstring> debugSearchDirs;
+int
+mgwhelp_dwarf_pe_init(struct pe_image *image,
+                      const wchar_t *name,
+                      Dwarf_Handler errhand,
+                      Dwarf_Ptr errarg,
+                      Dwarf_Debug *ret_dbg,
+                      Dwarf_Error *error)
+{
+    int res = DW_DLV_ERROR;
 
-            // Search on the image directory
-            const wchar_t *pImageSep = getSeparatorW(image);
-            std::wstring imageDir;
-            if (pImageSep) {
-                imageDir.append(image, pImageSep);
-            }
-            debugSearchDirs.emplace_back(imageDir);
-
-            // Then search on a .debug subdirectory
-            imageDir.append(L".debug\\");
-            debugSearchDirs.emplace_back(imageDir);
-
-            HANDLE hFile = INVALID_HANDLE_VALUE;
-            for (auto const &debugSearchDir : debugSearchDirs) {
-                std::wstring debugImage(debugSearchDir);
-                debugImage.append(wDebuglink);
-                const wchar_t *debugImageStr = debugImage.c_str();
-                hFile = CreateFileW(debugImageStr, GENERIC_READ, FILE_SHARE_READ, NULL,
-                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-                if (hFile == INVALID_HANDLE_VALUE) {
-                    OutputDebug("MGWHELP: %ls - not found\n", debugImageStr);
-                } else {
-                    res = mgwhelp_dwarf_pe_init(hFile, debugImageStr, errhand, errarg, ret_dbg,
-                                                error);
-                    CloseHandle(hFile);
-                    break;
-                }
+    std::wstring debugImage;
+    if (debug_file_find(image, name, debugImage)) {
+        const wchar_t *debugImageStr = debugImage.c_str();
+        HANDLE hFile = CreateFileW(debugImageStr, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            OutputDebug("MGWHELP: %ls - failed to open\n", debugImageStr);
+        } else {
+            struct pe_image *debugImageObj = pe_image_create(hFile, debugImageStr);
+            CloseHandle(hFile);
+            if (debugImageObj) {
+                // Debug files are not searched for debug files of their own,
+                // as they usually keep the build ID of the stripped image
+                res = pe_object_init(debugImageObj, errhand, errarg, ret_dbg, error);
+                pe_image_unref(debugImageObj);
             }
-
-            break;
         }
     }
 
     if (res != DW_DLV_OK) {
-        Dwarf_Obj_Access_Interface_a *intfc;
-
-        /* Initialize the interface struct */
-        intfc = (Dwarf_Obj_Access_Interface_a *)calloc(1, sizeof *intfc);
-        if (!intfc) {
-            goto no_intfc;
-        }
-        intfc->ai_object = pe_obj;
-        intfc->ai_methods = &pe_methods;
-
-        res = dwarf_object_init_b(intfc, errhand, errarg, DW_GROUPNUMBER_ANY, ret_dbg, error);
+        res = pe_object_init(image, errhand, errarg, ret_dbg, error);
         if (res == DW_DLV_OK) {
             return res;
         }
@@ -289,21 +195,12 @@ mgwhelp_dwarf_pe_init(HANDLE hFile,
         // MinGW.
         // See also http://reverseengineering.stackexchange.com/a/1826
         PIMAGE_OPTIONAL_HEADER pOptionalHeader;
-        pOptionalHeader = &pe_obj->pNtHeaders->OptionalHeader;
+        pOptionalHeader = &image->pNtHeaders->OptionalHeader;
         if (pOptionalHeader->MajorLinkerVersion == 2 && pOptionalHeader->MinorLinkerVersion >= 21) {
-            OutputDebug("MGWHELP: %ls - no dwarf symbols\n", image);
+            OutputDebug("MGWHELP: %ls - no dwarf symbols\n", name);
         }
-
-        free(intfc);
     }
 
-no_intfc:
-    UnmapViewOfFile(pe_obj->lpFileBase);
-no_view_of_file:
-    CloseHandle(pe_obj->hFileMapping);
-no_file_mapping:
-    free(pe_obj);
-no_internals:
     return res;
 }
 
@@ -312,11 +209,9 @@ int
 mgwhelp_dwarf_pe_finish(Dwarf_Debug dbg, Dwarf_Error *error)
 {
     Dwarf_Obj_Access_Interface_a *intfc = dbg->de_obj_file;
-    pe_access_object_t *pe_obj = (pe_access_object_t *)intfc->ai_object;
+    struct pe_image *image = (struct pe_image *)intfc->ai_object;
     free(intfc);
-    UnmapViewOfFile(pe_obj->lpFileBase);
-    CloseHandle(pe_obj->hFileMapping);
-    free(pe_obj);
+    pe_image_unref(image);
     *error = nullptr;
     return dwarf_object_finish(dbg);
 }
@@ -30,9 +30,12 @@ extern "C" {
 #endif
 
 
+struct pe_image;
+
+
 int
-mgwhelp_dwarf_pe_init(HANDLE hFile,
-                      const wchar_t *image,
+mgwhelp_dwarf_pe_init(struct pe_image *image,
+                      const wchar_t *name,
                       Dwarf_Handler errhand,
                       Dwarf_Ptr errarg,
                       Dwarf_Debug *ret_dbg,
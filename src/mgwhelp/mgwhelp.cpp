@@ -24,6 +24,13 @@
 #include <stdio.h>
 #include <malloc.h>
 
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include <windows.h>
 #include <psapi.h>
 
@@ -33,195 +40,303 @@
 #include "mgwhelp.h"
 
 #include "dwarf_pe.h"
+#include "dwarf_cache.h"
 #include "dwarf_find.h"
+#include "dwarf_frame.h"
+#include "name_index.h"
+#include "pe_image.h"
+#include "pe_unwind.h"
+#include "result_cache.h"
+#include "stats.h"
 
 #include "demangle.h"
 
 
+// Default memory budget for DWARF state, in megabytes
+#define MGWHELP_DEFAULT_MEMORY_BUDGET 256
+
+
 struct mgwhelp_module {
-    struct mgwhelp_module *next;
+    // One reference is held by the process's module table, and another by
+    // every lookup until done with the module, so that a module removed
+    // meanwhile is only destroyed once no longer in use
+    LONG volatile refcount;
+
+    struct mgwhelp_process *process;
 
     DWORD64 Base;
+    DWORD SizeOfImage;
     wchar_t LoadedImageName[MAX_PATH];
 
-    HANDLE hFileMapping;
-    PBYTE lpFileBase;
-    SIZE_T nFileSize;
+    // Identity of the image file, if it could be obtained, to tell apart a
+    // different image later loaded at the same base address
+    BOOL bFileInfo;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+
+    struct pe_image *image;
 
     DWORD64 image_base_vma;
 
+    // DWARF debugging information is only loaded on the first query that
+    // lands on the module, as most modules never appear in a stack trace
+    LONG volatile dwarf_loaded;
     dwarf_module dwarf;
+
+    // Held shared while the DWARF state is in use, and exclusively to evict
+    // it, along with the use clock value of the last use
+    SRWLOCK dwarf_use_lock;
+    LONG64 volatile dwarf_last_use;
+
+    struct mgwhelp_stats stats;
+
+    // Call frame information, for unwinding, indexed on first use
+    LONG volatile frames_indexed;
+    struct dwarf_frame_table *frames;
+
+    // x64 function table, for unwinding, indexed on first use
+    LONG volatile functions_indexed;
+    struct pe_function_table *functions;
+
+    // Symbols by name, indexed on first use, and whether any came from DWARF
+    // or COFF symbols, as otherwise only the exports are indexed
+    LONG volatile names_indexed;
+    struct name_index *names;
+    bool names_debug_info;
 };
 
 
 struct mgwhelp_process {
-    struct mgwhelp_process *next;
-
     HANDLE hProcess;
 
-    struct mgwhelp_module *modules;
+    // Modules keyed by base address, so that the module containing an
+    // address can be found in logarithmic time
+    std::map<DWORD64, struct mgwhelp_module *> modules;
+
+    // Cache of module image ranges [Base, End), keyed by Base, to avoid
+    // querying the (possibly remote) process for every address
+    std::map<DWORD64, DWORD64> ranges;
+
+    // Results of DWARF lookups, by address
+    struct result_cache results;
 };
 
 
-struct mgwhelp_process *processes = NULL;
+/*
+ * Lookups may happen concurrently from several threads, so the process table
+ * and the processes' module and range tables are guarded by a reader/writer
+ * lock, which is only held exclusively while they are modified.
+ *
+ * Modules found in the tables are referenced before the lock is released,
+ * and must be unreferenced with mgwhelp_module_unref once done with.
+ *
+ * It's up to the caller to not clean up while other threads are still
+ * querying the same process.
+ */
+static SRWLOCK processes_lock = SRWLOCK_INIT;
+static std::unordered_map<HANDLE, struct mgwhelp_process *> processes;
 
+// DbgHelp functions are all single threaded
+static SRWLOCK dbghelp_lock = SRWLOCK_INIT;
 
-static DWORD64 WINAPI
-GetModuleBase(HANDLE hProcess, DWORD64 dwAddress);
+// Clock of DWARF state uses, for LRU eviction
+static LONG64 volatile dwarf_use_clock;
 
 
-/* We must use a memory map of the file, not read memory directly, as the
- * value of ImageBase in memory changes.
- */
 static DWORD64
-PEGetImageBase(PBYTE lpFileBase)
-{
-    PIMAGE_DOS_HEADER pDosHeader;
-    PIMAGE_NT_HEADERS pNtHeaders;
-    PIMAGE_OPTIONAL_HEADER pOptionalHeader;
-    PIMAGE_OPTIONAL_HEADER32 pOptionalHeader32;
-    PIMAGE_OPTIONAL_HEADER64 pOptionalHeader64;
-    DWORD64 ImageBase = 0;
-
-    pDosHeader = (PIMAGE_DOS_HEADER)lpFileBase;
-
-    pNtHeaders = (PIMAGE_NT_HEADERS)(lpFileBase + pDosHeader->e_lfanew);
-
-    pOptionalHeader = &pNtHeaders->OptionalHeader;
-    pOptionalHeader32 = (PIMAGE_OPTIONAL_HEADER32)pOptionalHeader;
-    pOptionalHeader64 = (PIMAGE_OPTIONAL_HEADER64)pOptionalHeader;
-
-    switch (pOptionalHeader->Magic) {
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
-        ImageBase = pOptionalHeader32->ImageBase;
-        break;
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
-        ImageBase = pOptionalHeader64->ImageBase;
-        break;
-    default:
-        assert(0);
-    }
+GetModuleBase(struct mgwhelp_process *process, DWORD64 dwAddress);
 
-    return ImageBase;
-}
+static const struct dwarf_frame_table *
+mgwhelp_module_frames(struct mgwhelp_module *module);
 
+static const struct pe_function_table *
+mgwhelp_module_functions(struct mgwhelp_module *module);
 
-/*
- * Search for the symbol on PE's symbol table.
- *
- * Symbols for which there's no DWARF debugging information might still appear there, put by MinGW
- * linker.
- *
- * - https://msdn.microsoft.com/en-gb/library/ms809762.aspx
- *   - https://www.microsoft.com/msj/backissues86.aspx
- * - http://go.microsoft.com/fwlink/p/?linkid=84140
- */
-[[maybe_unused]] static BOOL
-pe_find_symbol(struct mgwhelp_module *module,
-               DWORD64 Addr,
-               ULONG MaxSymbolNameLen,
-               LPSTR pSymbolName,
-               PDWORD64 pDisplacement)
-{
-    PBYTE lpFileBase = module->lpFileBase;
-    PIMAGE_DOS_HEADER pDosHeader;
-    PIMAGE_NT_HEADERS pNtHeaders;
-    PIMAGE_OPTIONAL_HEADER pOptionalHeader;
-    PIMAGE_OPTIONAL_HEADER32 pOptionalHeader32;
-    PIMAGE_OPTIONAL_HEADER64 pOptionalHeader64;
-    DWORD64 ImageBase = 0;
-    BOOL bUnderscore = TRUE;
-
-    pDosHeader = (PIMAGE_DOS_HEADER)lpFileBase;
-    pNtHeaders = (PIMAGE_NT_HEADERS)(lpFileBase + pDosHeader->e_lfanew);
-    PIMAGE_SECTION_HEADER Sections =
-        (PIMAGE_SECTION_HEADER)((PBYTE)pNtHeaders + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER) +
-                                pNtHeaders->FileHeader.SizeOfOptionalHeader);
-    PIMAGE_SYMBOL pSymbolTable =
-        (PIMAGE_SYMBOL)(lpFileBase + pNtHeaders->FileHeader.PointerToSymbolTable);
-    PSTR pStringTable = (PSTR)&pSymbolTable[pNtHeaders->FileHeader.NumberOfSymbols];
-    pOptionalHeader = &pNtHeaders->OptionalHeader;
-    pOptionalHeader32 = (PIMAGE_OPTIONAL_HEADER32)pOptionalHeader;
-    pOptionalHeader64 = (PIMAGE_OPTIONAL_HEADER64)pOptionalHeader;
-
-    if (pNtHeaders->FileHeader.PointerToSymbolTable +
-            pNtHeaders->FileHeader.NumberOfSymbols * sizeof pSymbolTable[0] >
-        module->nFileSize) {
-        OutputDebug("MGWHELP: %ls - symbol table extends beyond image size\n",
-                    module->LoadedImageName);
-        return FALSE;
-    }
 
-    switch (pOptionalHeader->Magic) {
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
-        ImageBase = pOptionalHeader32->ImageBase;
-        break;
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
-        ImageBase = pOptionalHeader64->ImageBase;
-        bUnderscore = FALSE;
-        break;
-    default:
-        assert(0);
-        return FALSE;
+// Must be called with processes_lock held exclusively
+static void
+mgwhelp_range_insert(struct mgwhelp_process *process, DWORD64 Base, DWORD64 Size)
+{
+    DWORD64 End = Base + Size;
+
+    // Drop stale ranges overlapping the new one
+    auto it = process->ranges.upper_bound(Base);
+    if (it != process->ranges.begin() && std::prev(it)->second > Base) {
+        --it;
+    }
+    while (it != process->ranges.end() && it->first < End) {
+        it = process->ranges.erase(it);
     }
 
-    DWORD64 Displacement = ~(DWORD64)0;
-    BOOL bRet = FALSE;
+    process->ranges[Base] = End;
+}
 
-    DWORD i;
-    for (i = 0; i < pNtHeaders->FileHeader.NumberOfSymbols; ++i) {
-        PIMAGE_SYMBOL pSymbol = &pSymbolTable[i];
 
-        if (ISFCN(pSymbol->Type)) {
-            DWORD64 SymbolAddr = pSymbol->Value;
-            SHORT SectionNumber = pSymbol->SectionNumber;
-            if (SectionNumber > 0) {
-                PIMAGE_SECTION_HEADER pSection = Sections + SectionNumber - 1;
-                SymbolAddr += ImageBase + pSection->VirtualAddress;
-            }
+static DWORD64
+mgwhelp_range_lookup(struct mgwhelp_process *process, DWORD64 Address)
+{
+    DWORD64 Base = 0;
+
+    AcquireSRWLockShared(&processes_lock);
+    auto it = process->ranges.upper_bound(Address);
+    if (it != process->ranges.begin()) {
+        --it;
+        if (Address < it->second) {
+            Base = it->first;
+        }
+    }
+    ReleaseSRWLockShared(&processes_lock);
 
-            LPCSTR SymbolName;
-            char ShortName[9];
-            if (pSymbol->N.Name.Short != 0) {
-                strncpy(ShortName, (LPCSTR)pSymbol->N.ShortName, 8);
-                ShortName[8] = '\0';
-                SymbolName = ShortName;
-            } else {
-                SymbolName = &pStringTable[pSymbol->N.Name.Long];
-            }
+    return Base;
+}
 
-            if (bUnderscore && SymbolName[0] == '_') {
-                SymbolName = &SymbolName[1];
-            }
 
-            if (0) {
-                OutputDebug("%04lu: 0x%08I64X %s\n", i, SymbolAddr, SymbolName);
-            }
+/*
+ * Search for the nearest symbol on PE's symbol table, and on its exports,
+ * which is all there is for most system and third-party DLLs short of their
+ * PDBs.
+ */
+static BOOL
+pe_find_nearest_symbol(struct mgwhelp_module *module,
+                       DWORD64 Addr,
+                       PCSTR *pName,
+                       PDWORD64 pDisplacement)
+{
+    BOOL bFound = pe_image_find_symbol(module->image, Addr, pName, pDisplacement);
+    PCSTR ExportName;
+    DWORD64 ExportDisplacement;
+    if (pe_image_find_export(module->image, Addr, &ExportName, &ExportDisplacement) &&
+        (!bFound || ExportDisplacement < *pDisplacement)) {
+        *pName = ExportName;
+        *pDisplacement = ExportDisplacement;
+        bFound = TRUE;
+    }
+    return bFound;
+}
 
-            if (SymbolAddr <= Addr && SymbolName[0] != '.') {
-                DWORD64 SymbolDisp = Addr - SymbolAddr;
-                if (SymbolDisp < Displacement) {
-                    strncpy(pSymbolName, SymbolName, MaxSymbolNameLen);
 
-                    bRet = TRUE;
+/*
+ * Find the extents of the function containing an address, from the x64
+ * function table, or else from the call frame information, both of which
+ * survive stripping.
+ */
+static bool
+mgwhelp_find_function_bounds(struct mgwhelp_module *module,
+                             DWORD Rva,
+                             DWORD *pBeginRva,
+                             DWORD *pEndRva)
+{
+    const struct pe_function_table *functions = mgwhelp_module_functions(module);
+    if (functions) {
+        const struct pe_function *function = pe_function_table_find_primary(functions, Rva);
+        if (function) {
+            *pBeginRva = function->BeginRva;
+            *pEndRva = function->EndRva;
+            return true;
+        }
+    }
 
-                    Displacement = SymbolDisp;
+    const struct dwarf_frame_table *frames = mgwhelp_module_frames(module);
+    if (frames) {
+        const struct dwarf_fde *fde = dwarf_frame_find_fde(frames, Rva);
+        if (fde) {
+            *pBeginRva = fde->BeginRva;
+            *pEndRva = fde->EndRva;
+            return true;
+        }
+    }
 
-                    if (Displacement == 0) {
-                        break;
-                    }
-                }
-            }
+    return false;
+}
+
+
+/*
+ * Search for the symbol on the image.
+ *
+ * The nearest symbol is misleading when the function containing the address
+ * has no symbol of its own, as with static functions in stripped images, so
+ * when the function extents are known, an unnamed function is reported as
+ * "sub_<address>", the way disassemblers do.  Otherwise the nearest symbol
+ * is reported, along with the displacement from it.
+ */
+static BOOL
+pe_find_symbol(struct mgwhelp_module *module,
+               DWORD64 Addr,
+               ULONG MaxSymbolNameLen,
+               LPSTR pSymbolName,
+               PDWORD64 pDisplacement,
+               PULONG pSize)
+{
+    LONG64 start = mgwhelp_stats_clock();
+
+    PCSTR SymbolName = NULL;
+    DWORD64 Displacement = 0;
+    BOOL bFound = pe_find_nearest_symbol(module, Addr, &SymbolName, &Displacement);
+    ULONG Size = 0;
+
+    DWORD BeginRva, EndRva;
+    DWORD64 Rva = Addr - module->image_base_vma;
+    if (Rva < module->SizeOfImage &&
+        mgwhelp_find_function_bounds(module, (DWORD)Rva, &BeginRva, &EndRva)) {
+        DWORD64 Begin = module->image_base_vma + BeginRva;
+        Size = EndRva - BeginRva;
+
+        // The address may lie in a part of the function apart from its entry
+        PCSTR EntryName;
+        DWORD64 EntryDisplacement;
+        if (pe_find_nearest_symbol(module, Begin, &EntryName, &EntryDisplacement) &&
+            EntryDisplacement == 0) {
+            SymbolName = EntryName;
+            Displacement = Addr - Begin;
+        } else if (!bFound || Addr - Displacement < Begin) {
+            snprintf(pSymbolName, MaxSymbolNameLen, "sub_%I64X", Begin);
+            SymbolName = pSymbolName;
+            Displacement = Addr - Begin;
+            bFound = TRUE;
+        } else {
+            // A symbol within the function, other than at its entry
+            Size = 0;
         }
+    }
 
-        i += pSymbol->NumberOfAuxSymbols;
+    mgwhelp_stats_add(&module->stats, MGWHELP_STAT_PE_LOOKUPS, 1);
+    mgwhelp_stats_add(&module->stats, MGWHELP_STAT_PE_HITS, bFound);
+    mgwhelp_stats_add_time(&module->stats, MGWHELP_STAT_PE_LOOKUP_TIME, start);
+    if (!bFound) {
+        return FALSE;
     }
 
+    if (SymbolName != pSymbolName) {
+        strncpy(pSymbolName, SymbolName, MaxSymbolNameLen);
+    }
     if (pDisplacement) {
         *pDisplacement = Displacement;
     }
+    if (pSize) {
+        *pSize = Size;
+    }
+    return TRUE;
+}
 
-    return bRet;
+
+static void
+mgwhelp_count_dwarf_lookups(struct mgwhelp_module *module,
+                            size_t nLookups,
+                            size_t nHits,
+                            LONG64 start)
+{
+    mgwhelp_stats_add(&module->stats, MGWHELP_STAT_DWARF_LOOKUPS, nLookups);
+    mgwhelp_stats_add(&module->stats, MGWHELP_STAT_DWARF_HITS, nHits);
+    mgwhelp_stats_add_time(&module->stats, MGWHELP_STAT_DWARF_LOOKUP_TIME, start);
+}
+
+
+static void
+mgwhelp_count_dbghelp_lookup(struct mgwhelp_module *module, BOOL bFound, LONG64 start)
+{
+    struct mgwhelp_stats *stats = module ? &module->stats : NULL;
+    mgwhelp_stats_add(stats, MGWHELP_STAT_DBGHELP_LOOKUPS, 1);
+    mgwhelp_stats_add(stats, MGWHELP_STAT_DBGHELP_HITS, bFound);
+    mgwhelp_stats_add_time(stats, MGWHELP_STAT_DBGHELP_LOOKUP_TIME, start);
 }
 
 
@@ -230,15 +345,14 @@ mgwhelp_module_create(struct mgwhelp_process *process, HANDLE hFile, PCWSTR Imag
 {
     struct mgwhelp_module *module;
     BOOL bOwnFile;
-    DWORD dwFileSizeHi;
-    DWORD dwFileSizeLo;
-    Dwarf_Error error;
 
     module = (struct mgwhelp_module *)calloc(1, sizeof *module);
     if (!module) {
         goto no_module;
     }
 
+    module->refcount = 1;
+    module->process = process;
     module->Base = Base;
 
     if (ImageName) {
@@ -268,45 +382,26 @@ mgwhelp_module_create(struct mgwhelp_process *process, HANDLE hFile, PCWSTR Imag
         bOwnFile = TRUE;
     }
 
-    module->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (!module->hFileMapping) {
-        goto no_file_mapping;
-    }
+    module->bFileInfo = GetFileInformationByHandle(hFile, &module->FileInfo);
 
-    module->lpFileBase = (PBYTE)MapViewOfFile(module->hFileMapping, FILE_MAP_READ, 0, 0, 0);
-    if (!module->lpFileBase) {
-        goto no_view_of_file;
+    module->image = pe_image_create(hFile, module->LoadedImageName);
+    if (!module->image) {
+        goto no_image;
     }
 
-    dwFileSizeHi = 0;
-    dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
-    module->nFileSize = dwFileSizeLo;
-#ifdef _WIN64
-    module->nFileSize |= (SIZE_T)dwFileSizeHi << 32;
-#else
-    assert(dwFileSizeHi == 0);
-#endif
-
-    module->image_base_vma = PEGetImageBase(module->lpFileBase);
+    module->image_base_vma = module->image->ImageBase;
+    module->SizeOfImage = module->image->SizeOfImage;
 
-    error = 0;
-    if (mgwhelp_dwarf_pe_init(hFile, module->LoadedImageName, 0, 0, &module->dwarf.dbg, &error) ==
-        DW_DLV_OK) {
-        dwstReadCUs(module->dwarf.dbg, &module->dwarf.cuArr, &module->dwarf.cuQty);
-    }
+    module->dwarf.stats = &module->stats;
+    mgwhelp_stats_add(&module->stats, MGWHELP_STAT_BYTES_MAPPED, module->image->nFileSize);
 
     if (bOwnFile) {
         CloseHandle(hFile);
     }
 
-    module->next = process->modules;
-    process->modules = module;
-
     return module;
 
-no_view_of_file:
-    CloseHandle(module->hFileMapping);
-no_file_mapping:
+no_image:
     if (bOwnFile) {
         CloseHandle(hFile);
     }
@@ -317,442 +412,3063 @@ no_module:
 }
 
 
-static void
-mgwhelp_module_destroy(struct mgwhelp_module *module)
+static int
+mgwhelp_module_open_dwarf(void *arg, Dwarf_Debug *ret_dbg)
 {
-    if (module->dwarf.dbg) {
-        Dwarf_Error error = 0;
-        dwstFreeCUs(module->dwarf.dbg, module->dwarf.cuArr, module->dwarf.cuQty);
-        mgwhelp_dwarf_pe_finish(module->dwarf.dbg, &error);
-    }
-
-    UnmapViewOfFile(module->lpFileBase);
-    free(module);
+    struct mgwhelp_module *module = (struct mgwhelp_module *)arg;
+    Dwarf_Error error = 0;
+    return mgwhelp_dwarf_pe_init(module->image, module->LoadedImageName, 0, 0, ret_dbg, &error);
 }
 
 
-static struct mgwhelp_process *
-mgwhelp_process_lookup(HANDLE hProcess);
+static void
+mgwhelp_module_close_dwarf(void *arg, Dwarf_Debug dbg)
+{
+    Dwarf_Error error = 0;
+    mgwhelp_dwarf_pe_finish(dbg, &error);
+}
 
-static struct mgwhelp_module *
-mgwhelp_module_lookup(HANDLE hProcess, HANDLE hFile, PCWSTR ImageName, DWORD64 Base)
+
+static void
+mgwhelp_module_read_dwarf(struct mgwhelp_module *module)
 {
-    struct mgwhelp_process *process;
-    struct mgwhelp_module *module;
+    module->dwarf.opener.open = mgwhelp_module_open_dwarf;
+    module->dwarf.opener.close = mgwhelp_module_close_dwarf;
+    module->dwarf.opener.arg = module;
+
+    module->dwarf.index = dwarf_cache_load(module->image, module->LoadedImageName);
+    if (module->dwarf.index) {
+        mgwhelp_stats_add(&module->stats, MGWHELP_STAT_INDEX_CACHE_HITS, 1);
+        return;
+    }
 
-    process = mgwhelp_process_lookup(hProcess);
-    if (!process) {
-        return NULL;
+    Dwarf_Error error = 0;
+    if (mgwhelp_dwarf_pe_init(module->image, module->LoadedImageName, 0, 0, &module->dwarf.dbg,
+                              &error) != DW_DLV_OK) {
+        module->dwarf.dbg = NULL;
+        return;
     }
 
-    module = process->modules;
-    while (module) {
-        if (module->Base == Base)
-            return module;
+    mgwhelp_stats_add(&module->stats, MGWHELP_STAT_INDEX_CACHE_MISSES, 1);
 
-        module = module->next;
+    module->dwarf.index = dwarf_index_create(module->dwarf.dbg, module->image_base_vma,
+                                             module->SizeOfImage, &module->dwarf.opener);
+    if (!module->dwarf.index) {
+        OutputDebug("MGWHELP: %ls - failed to index DWARF, falling back to dwarfstack\n",
+                    module->LoadedImageName);
+        dwstReadCUs(module->dwarf.dbg, &module->dwarf.cuArr, &module->dwarf.cuQty);
     }
-
-    return mgwhelp_module_create(process, hFile, ImageName, Base);
 }
 
 
-static struct mgwhelp_process *
-mgwhelp_process_lookup(HANDLE hProcess)
+static void
+mgwhelp_module_free_dwarf(struct mgwhelp_module *module)
 {
-    struct mgwhelp_process *process;
-
-    process = processes;
-    while (process) {
-        if (process->hProcess == hProcess)
-            return process;
-
-        process = process->next;
+    if (module->dwarf.index) {
+        // Saved only now, so that the line tables decoded meanwhile are saved
+        // too, without decoding the others
+        dwarf_cache_release(module->image, module->LoadedImageName, module->dwarf.index);
+    } else if (module->dwarf.dbg) {
+        dwstFreeCUs(module->dwarf.dbg, module->dwarf.cuArr, module->dwarf.cuQty);
+    }
+    if (module->dwarf.dbg) {
+        Dwarf_Error error = 0;
+        mgwhelp_dwarf_pe_finish(module->dwarf.dbg, &error);
     }
 
-    return NULL;
+    module->dwarf.dbg = NULL;
+    module->dwarf.index = NULL;
+    module->dwarf.cuArr = NULL;
+    module->dwarf.cuQty = 0;
+    module->dwarf.open_failed = false;
+    InterlockedExchange(&module->dwarf_loaded, FALSE);
 }
 
 
-static struct mgwhelp_module *
-mgwhelp_find_module(HANDLE hProcess, DWORD64 Address, PDWORD64 pOffset)
+/*
+ * Approximate memory used by the module's DWARF state.  libdwarf reads the
+ * sections in place from the image mapping, so when there's no index, the
+ * size of the debug sections stands for the memory of its own structures.
+ */
+static SIZE_T
+mgwhelp_module_dwarf_size(struct mgwhelp_module *module)
 {
-    DWORD64 Base;
-    struct mgwhelp_module *module;
-
-    Base = GetModuleBase(hProcess, Address);
-    if (!Base) {
-        return FALSE;
+    if (module->dwarf.index) {
+        return dwarf_index_memory_usage(module->dwarf.index);
     }
 
-    module = mgwhelp_module_lookup(hProcess, 0, NULL, Base);
-    if (!module) {
-        return NULL;
+    SIZE_T size = 0;
+    if (module->dwarf.dbg) {
+        struct pe_image *image = module->image;
+        for (WORD i = 0; i < image->NumberOfSections; ++i) {
+            if (image->SectionNames[i].compare(0, 7, ".debug_") == 0) {
+                size += image->Sections[i].SizeOfRawData;
+            }
+        }
     }
+    return size;
+}
 
-    *pOffset = module->image_base_vma + Address - (DWORD64)module->Base;
 
-    return module;
+/*
+ * Memory budget for DWARF state, in bytes, from the MGWHELP_MEMORY_BUDGET
+ * environment variable, in megabytes.  Zero means unlimited.
+ */
+static DWORD64
+mgwhelp_memory_budget(void)
+{
+    static DWORD64 budget = []() -> DWORD64 {
+        const wchar_t *szBudget = _wgetenv(L"MGWHELP_MEMORY_BUDGET");
+        if (szBudget) {
+            return _wcstoui64(szBudget, nullptr, 10) << 20;
+        }
+        return DWORD64(MGWHELP_DEFAULT_MEMORY_BUDGET) << 20;
+    }();
+    return budget;
 }
 
 
+/*
+ * Evict the DWARF state of the least recently used modules, across all
+ * processes, until the total is within the memory budget.  Modules in use
+ * are skipped, and so is the given module, whose state was just loaded.
+ */
 static void
-mgwhelp_initialize(HANDLE hProcess)
+mgwhelp_evict_dwarf(struct mgwhelp_module *current)
 {
-    struct mgwhelp_process *process;
+    DWORD64 budget = mgwhelp_memory_budget();
+    if (!budget) {
+        return;
+    }
 
-    process = (struct mgwhelp_process *)calloc(1, sizeof *process);
-    if (process) {
-        process->hProcess = hProcess;
+    struct candidate {
+        LONG64 last_use;
+        struct mgwhelp_module *module;
+        SIZE_T size;
+    };
+    std::vector<candidate> candidates;
+    DWORD64 total = mgwhelp_module_dwarf_size(current);
+
+    // Modules can't be destroyed while the process table is locked
+    AcquireSRWLockShared(&processes_lock);
+
+    for (auto &process : processes) {
+        for (auto &entry : process.second->modules) {
+            struct mgwhelp_module *module = entry.second;
+            if (module == current || !TryAcquireSRWLockShared(&module->dwarf_use_lock)) {
+                continue;
+            }
+            if (InterlockedCompareExchange(&module->dwarf_loaded, FALSE, FALSE)) {
+                SIZE_T size = mgwhelp_module_dwarf_size(module);
+                total += size;
+                candidates.push_back({module->dwarf_last_use, module, size});
+            }
+            ReleaseSRWLockShared(&module->dwarf_use_lock);
+        }
+    }
+
+    if (total > budget) {
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const candidate &a, const candidate &b) { return a.last_use < b.last_use; });
 
-        process->next = processes;
-        processes = process;
+        for (auto &c : candidates) {
+            if (total <= budget) {
+                break;
+            }
+            if (!TryAcquireSRWLockExclusive(&c.module->dwarf_use_lock)) {
+                continue;
+            }
+            if (c.module->dwarf_loaded) {
+                OutputDebug("MGWHELP: %ls - evicting DWARF state\n", c.module->LoadedImageName);
+                mgwhelp_module_free_dwarf(c.module);
+                mgwhelp_stats_add(&c.module->stats, MGWHELP_STAT_DWARF_EVICTIONS, 1);
+                total -= c.size;
+            }
+            ReleaseSRWLockExclusive(&c.module->dwarf_use_lock);
+        }
     }
+
+    ReleaseSRWLockShared(&processes_lock);
 }
 
 
-BOOL WINAPI
-MgwSymInitialize(HANDLE hProcess, PCSTR UserSearchPath, BOOL fInvadeProcess)
+/*
+ * Load the module's DWARF debugging information, if not done yet, and
+ * return whether there is any.  On success the DWARF state must be
+ * released with mgwhelp_module_release_dwarf once done with it, so that it
+ * isn't evicted meanwhile.
+ */
+static bool
+mgwhelp_module_acquire_dwarf(struct mgwhelp_module *module)
 {
-    BOOL ret;
-
-    ret = SymInitialize(hProcess, UserSearchPath, fInvadeProcess);
+    AcquireSRWLockShared(&module->dwarf_use_lock);
+    InterlockedExchange64(&module->dwarf_last_use, InterlockedIncrement64(&dwarf_use_clock));
+
+    bool bRead = false;
+    if (!InterlockedCompareExchange(&module->dwarf_loaded, FALSE, FALSE)) {
+        AcquireSRWLockExclusive(&module->dwarf.lock);
+        if (!module->dwarf_loaded) {
+            LONG64 start = mgwhelp_stats_clock();
+            mgwhelp_module_read_dwarf(module);
+            mgwhelp_stats_add(&module->stats, MGWHELP_STAT_DWARF_LOADS, 1);
+            mgwhelp_stats_add_time(&module->stats, MGWHELP_STAT_DWARF_LOAD_TIME, start);
+            InterlockedExchange(&module->dwarf_loaded, TRUE);
+            bRead = true;
+        }
+        ReleaseSRWLockExclusive(&module->dwarf.lock);
+    }
 
-    if (ret) {
-        mgwhelp_initialize(hProcess);
+    if (module->dwarf.dbg != NULL || module->dwarf.index != NULL) {
+        if (bRead) {
+            mgwhelp_evict_dwarf(module);
+        }
+        return true;
     }
 
-    return ret;
+    ReleaseSRWLockShared(&module->dwarf_use_lock);
+    return false;
 }
 
 
-BOOL WINAPI
-MgwSymInitializeW(HANDLE hProcess, PCWSTR UserSearchPath, BOOL fInvadeProcess)
+static void
+mgwhelp_module_release_dwarf(struct mgwhelp_module *module)
 {
-    BOOL ret;
+    ReleaseSRWLockShared(&module->dwarf_use_lock);
+}
 
-    ret = SymInitializeW(hProcess, UserSearchPath, fInvadeProcess);
 
-    if (ret) {
-        mgwhelp_initialize(hProcess);
-    }
+static void
+mgwhelp_module_destroy(struct mgwhelp_module *module)
+{
+    mgwhelp_module_free_dwarf(module);
+    dwarf_frame_table_destroy(module->frames);
+    pe_function_table_destroy(module->functions);
+    name_index_destroy(module->names);
 
-    return ret;
+    pe_image_unref(module->image);
+    free(module);
 }
 
 
-DWORD WINAPI
-MgwSymSetOptions(DWORD SymOptions)
+static struct mgwhelp_module *
+mgwhelp_module_ref(struct mgwhelp_module *module)
 {
-    return SymSetOptions(SymOptions);
+    InterlockedIncrement(&module->refcount);
+    return module;
 }
 
 
-DWORD64 WINAPI
-MgwSymLoadModuleEx(HANDLE hProcess,
-                   HANDLE hFile,
-                   PCSTR ImageName,
-                   PCSTR ModuleName,
-                   DWORD64 BaseOfDll,
-                   DWORD DllSize,
-                   PMODLOAD_DATA Data,
-                   DWORD Flags)
+static void
+mgwhelp_module_unref(struct mgwhelp_module *module)
 {
-    DWORD dwRet;
-
-    dwRet =
-        SymLoadModuleEx(hProcess, hFile, ImageName, ModuleName, BaseOfDll, DllSize, Data, Flags);
-
-    if (BaseOfDll) {
-        wchar_t ImageNameBuf[MAX_PATH];
-        PCWSTR ImageNameW = nullptr;
-        if (ImageName) {
-            MultiByteToWideChar(CP_ACP, 0, ImageName, -1, ImageNameBuf, _countof(ImageNameBuf));
-            ImageNameW = ImageNameBuf;
-        }
-        mgwhelp_module_lookup(hProcess, hFile, ImageNameW, BaseOfDll);
+    if (!module || InterlockedDecrement(&module->refcount) != 0) {
+        return;
     }
 
-    return dwRet;
+    mgwhelp_module_destroy(module);
 }
 
 
-DWORD64 WINAPI
-MgwSymLoadModuleExW(HANDLE hProcess,
-                    HANDLE hFile,
-                    PCWSTR ImageName,
-                    PCWSTR ModuleName,
-                    DWORD64 BaseOfDll,
-                    DWORD DllSize,
-                    PMODLOAD_DATA Data,
-                    DWORD Flags)
+static void
+mgwhelp_modules_unref(const std::vector<struct mgwhelp_module *> &modules)
 {
-    DWORD dwRet;
+    for (struct mgwhelp_module *module : modules) {
+        mgwhelp_module_unref(module);
+    }
+}
 
-    dwRet =
-        SymLoadModuleExW(hProcess, hFile, ImageName, ModuleName, BaseOfDll, DllSize, Data, Flags);
 
-    if (BaseOfDll) {
-        mgwhelp_module_lookup(hProcess, hFile, ImageName, BaseOfDll);
+static struct mgwhelp_process *
+mgwhelp_process_lookup(HANDLE hProcess)
+{
+    auto it = processes.find(hProcess);
+    if (it == processes.end()) {
+        return NULL;
     }
 
-    return dwRet;
+    return it->second;
 }
 
 
 /*
- * The GetModuleBase function retrieves the base address of the module that
- * contains the specified address.
- *
- * Same as SymGetModuleBase64, but that seems to often cause problems.
+ * Whether the module was created from a different file than the image now
+ * being loaded at its base address, as happens when a DLL is unloaded and
+ * another loaded at the same address without the unload being notified.
  */
-static DWORD64 WINAPI
-GetModuleBase(HANDLE hProcess, DWORD64 dwAddress)
+static bool
+mgwhelp_module_is_stale(struct mgwhelp_process *process,
+                        struct mgwhelp_module *module,
+                        HANDLE hFile,
+                        PCWSTR ImageName)
 {
-    if (hProcess == GetCurrentProcess()) {
-        HMODULE hModule = NULL;
-        BOOL bRet = GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
-                                           GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
-                                       (LPCWSTR)(UINT_PTR)dwAddress, &hModule);
-        if (bRet) {
-            return (DWORD64)(UINT_PTR)hModule;
+    wchar_t ImageNameBuf[MAX_PATH];
+    if (!ImageName) {
+        if (!GetModuleFileNameExW(process->hProcess, (HMODULE)(UINT_PTR)module->Base,
+                                  ImageNameBuf, _countof(ImageNameBuf))) {
+            return false;
+        }
+        ImageName = ImageNameBuf;
+    }
+
+    // Without the file identities, only the names can be compared
+    bool bNameDiffers = _wcsicmp(ImageName, module->LoadedImageName) != 0;
+    if (!module->bFileInfo) {
+        return bNameDiffers;
+    }
+
+    BOOL bOwnFile = FALSE;
+    if (!hFile) {
+        hFile = CreateFileW(ImageName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, 0);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return bNameDiffers;
         }
+        bOwnFile = TRUE;
+    }
+
+    bool bStale = bNameDiffers;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    if (GetFileInformationByHandle(hFile, &FileInfo)) {
+        const BY_HANDLE_FILE_INFORMATION *pCached = &module->FileInfo;
+        bStale = FileInfo.dwVolumeSerialNumber != pCached->dwVolumeSerialNumber ||
+                 FileInfo.nFileIndexHigh != pCached->nFileIndexHigh ||
+                 FileInfo.nFileIndexLow != pCached->nFileIndexLow ||
+                 CompareFileTime(&FileInfo.ftLastWriteTime, &pCached->ftLastWriteTime) != 0;
+    }
+
+    if (bOwnFile) {
+        CloseHandle(hFile);
     }
 
-    MEMORY_BASIC_INFORMATION Buffer;
-    if (VirtualQueryEx(hProcess, (LPCVOID)(UINT_PTR)dwAddress, &Buffer, sizeof Buffer) != 0) {
-        return (DWORD64)(UINT_PTR)Buffer.AllocationBase;
+    return bStale;
+}
+
+
+/*
+ * Remove a module from the process, unless another thread did so already,
+ * and drop the process's reference to it, so that it's destroyed once no
+ * other thread is using it.
+ */
+static void
+mgwhelp_module_remove(struct mgwhelp_process *process, struct mgwhelp_module *module)
+{
+    bool bRemoved = false;
+
+    AcquireSRWLockExclusive(&processes_lock);
+    auto it = process->modules.find(module->Base);
+    if (it != process->modules.end() && it->second == module) {
+        process->modules.erase(it);
+        process->ranges.erase(module->Base);
+        bRemoved = true;
     }
+    ReleaseSRWLockExclusive(&processes_lock);
 
-    return SymGetModuleBase64(hProcess, dwAddress);
+    if (bRemoved) {
+        result_cache_remove(&process->results, module->Base, module->SizeOfImage);
+        mgwhelp_module_unref(module);
+    }
 }
 
 
-static char *
-demangle(const char *mangled, DWORD Flags)
+/*
+ * Find or create the module at the given base address.  When bValidate is
+ * set, an existing module is replaced if it's no longer backed by the same
+ * file.  The module returned must be unreferenced once done with.
+ */
+static struct mgwhelp_module *
+mgwhelp_module_lookup(HANDLE hProcess,
+                      HANDLE hFile,
+                      PCWSTR ImageName,
+                      DWORD64 Base,
+                      bool bValidate)
 {
-    assert(mangled);
+    struct mgwhelp_process *process;
+    struct mgwhelp_module *module = NULL;
 
-    // There can be false negatives, such as "_ZwTerminateProcess@8"
-    if (mangled[0] != '_' || mangled[1] != 'Z') {
+    AcquireSRWLockShared(&processes_lock);
+    process = mgwhelp_process_lookup(hProcess);
+    if (process) {
+        auto it = process->modules.find(Base);
+        if (it != process->modules.end()) {
+            module = mgwhelp_module_ref(it->second);
+        }
+    }
+    ReleaseSRWLockShared(&processes_lock);
+
+    if (module && bValidate && mgwhelp_module_is_stale(process, module, hFile, ImageName)) {
+        OutputDebug("MGWHELP: %ls - replaced by another image at the same address\n",
+                    module->LoadedImageName);
+        mgwhelp_module_remove(process, module);
+        mgwhelp_module_unref(module);
+        module = NULL;
+    }
+
+    if (!process || module) {
+        return module;
+    }
+
+    // The lock is not held while creating the module, as that involves I/O
+    module = mgwhelp_module_create(process, hFile, ImageName, Base);
+    if (!module) {
         return NULL;
     }
 
-    int options = DMGL_PARAMS | DMGL_TYPES;
-    if (Flags & UNDNAME_NAME_ONLY) {
-        options = DMGL_NO_OPTS;
+    struct mgwhelp_module *existing = NULL;
+    AcquireSRWLockExclusive(&processes_lock);
+    auto result = process->modules.emplace(Base, module);
+    if (result.second) {
+        mgwhelp_range_insert(process, Base, module->SizeOfImage);
+        mgwhelp_module_ref(module);
+    } else {
+        existing = mgwhelp_module_ref(result.first->second);
     }
-    if (Flags & UNDNAME_NO_ARGUMENTS) {
-        options &= ~DMGL_PARAMS;
+    ReleaseSRWLockExclusive(&processes_lock);
+
+    // Another thread created it meanwhile
+    if (existing) {
+        mgwhelp_module_destroy(module);
+        module = existing;
     }
 
-    return cplus_demangle_v3(mangled, options);
+    return module;
 }
 
 
-BOOL WINAPI
-MgwSymFromAddr(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_INFO Symbol)
+/*
+ * Find the loaded module whose image contains the address.
+ */
+static struct mgwhelp_module *
+mgwhelp_module_from_address(struct mgwhelp_process *process, DWORD64 Address)
 {
-    char buffer[1024];
-    PSYMBOL_INFOW SymbolW = (PSYMBOL_INFOW)buffer;
-    SymbolW->SizeOfStruct = sizeof *SymbolW;
-    SymbolW->MaxNameLen = ((sizeof(buffer) - sizeof *SymbolW) / sizeof(WCHAR)) - 1;
-    if (MgwSymFromAddrW(hProcess, Address, Displacement, SymbolW)) {
-        WideCharToMultiByte(CP_ACP, 0, SymbolW->Name, -1, Symbol->Name, Symbol->MaxNameLen, nullptr,
-                            nullptr);
-        return TRUE;
-    } else {
-        return FALSE;
+    auto it = process->modules.upper_bound(Address);
+    if (it == process->modules.begin()) {
+        return NULL;
+    }
+    --it;
+
+    struct mgwhelp_module *module = it->second;
+    if (Address - module->Base >= module->SizeOfImage) {
+        return NULL;
     }
+
+    return module;
 }
 
 
-BOOL WINAPI
-MgwSymGetLineFromAddr64(HANDLE hProcess,
-                        DWORD64 dwAddr,
-                        PDWORD pdwDisplacement,
-                        PIMAGEHLP_LINE64 Line)
+/*
+ * Find the module containing the address, which must be unreferenced once
+ * done with.
+ */
+static struct mgwhelp_module *
+mgwhelp_find_module(HANDLE hProcess, DWORD64 Address, PDWORD64 pOffset)
 {
-    IMAGEHLP_LINEW64 LineW;
-    ZeroMemory(&LineW, sizeof LineW);
-    LineW.SizeOfStruct = sizeof LineW;
-    if (MgwSymGetLineFromAddrW64(hProcess, dwAddr, pdwDisplacement, &LineW)) {
-        // https://msdn.microsoft.com/en-us/library/windows/desktop/ms681330.aspx
-        // states that SymGetLineFromAddrW64 "returns a pointer to a buffer
-        // that may be reused by another function" and that callers should be
-        // "sure to copy the data returned to another buffer immediately",
-        // therefore the static buffer should be safe.
-        static CHAR FileName[1024];
-        Line->FileName = FileName;
-        WideCharToMultiByte(CP_ACP, 0, LineW.FileName, -1, Line->FileName, sizeof(FileName),
-                            nullptr, nullptr);
-        Line->LineNumber = LineW.LineNumber;
-        return TRUE;
-    } else {
-        return FALSE;
+    struct mgwhelp_process *process;
+    struct mgwhelp_module *module;
+
+    AcquireSRWLockShared(&processes_lock);
+    process = mgwhelp_process_lookup(hProcess);
+    module = process ? mgwhelp_module_from_address(process, Address) : NULL;
+    if (module) {
+        mgwhelp_module_ref(module);
+    }
+    ReleaseSRWLockShared(&processes_lock);
+
+    if (!process) {
+        return NULL;
     }
+
+    if (!module) {
+        DWORD64 Base = GetModuleBase(process, Address);
+        if (!Base) {
+            return NULL;
+        }
+
+        module = mgwhelp_module_lookup(hProcess, 0, NULL, Base, false);
+        if (!module) {
+            return NULL;
+        }
+    }
+
+    *pOffset = module->image_base_vma + Address - (DWORD64)module->Base;
+
+    return module;
 }
 
 
-DWORD WINAPI
-MgwUnDecorateSymbolName(PCSTR DecoratedName,
-                        PSTR UnDecoratedName,
-                        DWORD UndecoratedLength,
-                        DWORD Flags)
+static void
+mgwhelp_initialize(HANDLE hProcess)
 {
-    wchar_t DecoratedNameW[1024];
-    wchar_t UnDecoratedNameW[1024];
+    AcquireSRWLockExclusive(&processes_lock);
+    if (processes.find(hProcess) == processes.end()) {
+        struct mgwhelp_process *process = new mgwhelp_process;
+        process->hProcess = hProcess;
 
-    MultiByteToWideChar(CP_ACP, 0, DecoratedName, -1, DecoratedNameW, _countof(DecoratedNameW));
-    int len = MgwUnDecorateSymbolNameW(DecoratedNameW, UnDecoratedNameW, _countof(UnDecoratedNameW),
-                                       Flags);
-    len = WideCharToMultiByte(CP_ACP, 0, UnDecoratedNameW, len, UnDecoratedName, UndecoratedLength,
-                              nullptr, nullptr);
-    return len;
+        processes[hProcess] = process;
+    }
+    ReleaseSRWLockExclusive(&processes_lock);
 }
 
 
 BOOL WINAPI
-MgwSymCleanup(HANDLE hProcess)
+MgwSymInitialize(HANDLE hProcess, PCSTR UserSearchPath, BOOL fInvadeProcess)
 {
-    struct mgwhelp_process **link;
-    struct mgwhelp_process *process;
-    struct mgwhelp_module *module;
+    BOOL ret;
 
-    link = &processes;
-    process = *link;
-    while (process) {
-        if (process->hProcess == hProcess) {
-            module = process->modules;
-            while (module) {
-                struct mgwhelp_module *next = module->next;
+    ret = SymInitialize(hProcess, UserSearchPath, fInvadeProcess);
 
-                mgwhelp_module_destroy(module);
+    if (ret) {
+        mgwhelp_initialize(hProcess);
+    }
 
-                module = next;
-            }
+    return ret;
+}
 
-            *link = process->next;
-            free(process);
-            break;
-        }
 
-        link = &process->next;
-        process = *link;
+BOOL WINAPI
+MgwSymInitializeW(HANDLE hProcess, PCWSTR UserSearchPath, BOOL fInvadeProcess)
+{
+    BOOL ret;
+
+    ret = SymInitializeW(hProcess, UserSearchPath, fInvadeProcess);
+
+    if (ret) {
+        mgwhelp_initialize(hProcess);
     }
 
-    return SymCleanup(hProcess);
+    return ret;
 }
 
 
-// Unicode stubs
+DWORD WINAPI
+MgwSymSetOptions(DWORD SymOptions)
+{
+    return SymSetOptions(SymOptions);
+}
 
 
-BOOL WINAPI
-MgwSymFromAddrW(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_INFOW Symbol)
+DWORD64 WINAPI
+MgwSymLoadModuleEx(HANDLE hProcess,
+                   HANDLE hFile,
+                   PCSTR ImageName,
+                   PCSTR ModuleName,
+                   DWORD64 BaseOfDll,
+                   DWORD DllSize,
+                   PMODLOAD_DATA Data,
+                   DWORD Flags)
 {
-    DWORD dwOptions = SymGetOptions();
+    DWORD dwRet;
 
-    // search DWARF symbols first, since we support modules without .debug_aranges
-    DWORD64 Offset;
-    mgwhelp_module *module = mgwhelp_find_module(hProcess, Address, &Offset);
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    dwRet =
+        SymLoadModuleEx(hProcess, hFile, ImageName, ModuleName, BaseOfDll, DllSize, Data, Flags);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
 
-    if (module && module->dwarf.dbg) {
-        struct dwarf_symbol_info info;
-        if (dwarf_find_symbol(module->dwarf.dbg, module->dwarf.cuArr, module->dwarf.cuQty,
-                              module->image_base_vma, module->LoadedImageName, module->Base,
-                              Address, &info)) {
-            const char *name = info.functionname.c_str();
-            if (dwOptions & SYMOPT_UNDNAME) {
-                char *output_buffer = demangle(name, UNDNAME_NAME_ONLY);
-                if (output_buffer) {
-                    name = output_buffer;
-                }
-            }
-            Symbol->NameLen =
-                MultiByteToWideChar(CP_UTF8, 0, name, -1, Symbol->Name, Symbol->MaxNameLen);
-            if (name != info.functionname.c_str()) {
-                free((void *)name);
-            }
-            if (Displacement) {
-                *Displacement = info.offset_addr;
+    if (BaseOfDll) {
+        if (DllSize) {
+            AcquireSRWLockExclusive(&processes_lock);
+            struct mgwhelp_process *process = mgwhelp_process_lookup(hProcess);
+            if (process) {
+                mgwhelp_range_insert(process, BaseOfDll, DllSize);
             }
-            return TRUE;
+            ReleaseSRWLockExclusive(&processes_lock);
+        }
+
+        wchar_t ImageNameBuf[MAX_PATH];
+        PCWSTR ImageNameW = nullptr;
+        if (ImageName) {
+            MultiByteToWideChar(CP_ACP, 0, ImageName, -1, ImageNameBuf, _countof(ImageNameBuf));
+            ImageNameW = ImageNameBuf;
         }
+        mgwhelp_module_unref(mgwhelp_module_lookup(hProcess, hFile, ImageNameW, BaseOfDll, true));
     }
 
-    if (module && module->lpFileBase) {
-        char symbol_name[1024];
-        if (pe_find_symbol(module, Offset, _countof(symbol_name), symbol_name, Displacement)) {
-            const char *name = symbol_name;
-            if (dwOptions & SYMOPT_UNDNAME) {
-                char *output_buffer = demangle(symbol_name, UNDNAME_NAME_ONLY);
-                if (output_buffer) {
-                    name = output_buffer;
-                }
-            }
-            Symbol->NameLen =
-                MultiByteToWideChar(CP_ACP, 0, name, -1, Symbol->Name, Symbol->MaxNameLen);
-            if (name != symbol_name) {
-                free((void *)name);
+    return dwRet;
+}
+
+
+DWORD64 WINAPI
+MgwSymLoadModuleExW(HANDLE hProcess,
+                    HANDLE hFile,
+                    PCWSTR ImageName,
+                    PCWSTR ModuleName,
+                    DWORD64 BaseOfDll,
+                    DWORD DllSize,
+                    PMODLOAD_DATA Data,
+                    DWORD Flags)
+{
+    DWORD dwRet;
+
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    dwRet =
+        SymLoadModuleExW(hProcess, hFile, ImageName, ModuleName, BaseOfDll, DllSize, Data, Flags);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+
+    if (BaseOfDll) {
+        if (DllSize) {
+            AcquireSRWLockExclusive(&processes_lock);
+            struct mgwhelp_process *process = mgwhelp_process_lookup(hProcess);
+            if (process) {
+                mgwhelp_range_insert(process, BaseOfDll, DllSize);
             }
-            return TRUE;
+            ReleaseSRWLockExclusive(&processes_lock);
         }
+
+        mgwhelp_module_unref(mgwhelp_module_lookup(hProcess, hFile, ImageName, BaseOfDll, true));
     }
 
-    return SymFromAddrW(hProcess, Address, Displacement, Symbol);
+    return dwRet;
 }
 
 
-BOOL WINAPI
-MgwSymGetLineFromAddrW64(HANDLE hProcess,
-                         DWORD64 dwAddr,
-                         PDWORD pdwDisplacement,
-                         PIMAGEHLP_LINEW64 Line)
+/*
+ * The GetModuleBase function retrieves the base address of the module that
+ * contains the specified address.
+ *
+ * Same as SymGetModuleBase64, but that seems to often cause problems.
+ *
+ * Module ranges are cached, so that the process is only queried on the first
+ * address of every module.
+ */
+static DWORD64
+GetModuleBase(struct mgwhelp_process *process, DWORD64 dwAddress)
 {
-    DWORD64 Offset;
-    mgwhelp_module *module = mgwhelp_find_module(hProcess, dwAddr, &Offset);
+    HANDLE hProcess = process->hProcess;
 
-    if (module && module->dwarf.dbg) {
-        static struct dwarf_line_info info;
-        if (dwarf_find_line(module->dwarf.dbg, module->dwarf.cuArr, module->dwarf.cuQty,
-                            module->image_base_vma, module->LoadedImageName, module->Base, dwAddr,
-                            &info)) {
-            static wchar_t buf[1024];
-            Line->FileName = buf;
-            wcsncpy(buf, info.filename.c_str(), _countof(buf));
-            Line->LineNumber = info.line;
+    DWORD64 Base = mgwhelp_range_lookup(process, dwAddress);
+    if (Base) {
+        return Base;
+    }
 
-            if (pdwDisplacement) {
-                *pdwDisplacement = info.offset_addr;
-            }
-            return TRUE;
+    if (hProcess == GetCurrentProcess()) {
+        HMODULE hModule = NULL;
+        BOOL bRet = GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                                           GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                                       (LPCWSTR)(UINT_PTR)dwAddress, &hModule);
+        if (bRet) {
+            Base = (DWORD64)(UINT_PTR)hModule;
+        }
+    }
+
+    if (!Base) {
+        MEMORY_BASIC_INFORMATION Buffer;
+        if (VirtualQueryEx(hProcess, (LPCVOID)(UINT_PTR)dwAddress, &Buffer, sizeof Buffer) != 0) {
+            Base = (DWORD64)(UINT_PTR)Buffer.AllocationBase;
         }
     }
 
-    return SymGetLineFromAddrW64(hProcess, dwAddr, pdwDisplacement, Line);
+    if (!Base) {
+        AcquireSRWLockExclusive(&dbghelp_lock);
+        Base = SymGetModuleBase64(hProcess, dwAddress);
+        ReleaseSRWLockExclusive(&dbghelp_lock);
+        return Base;
+    }
+
+    // Only cache ranges of actual modules, as other allocations may change
+    MODULEINFO ModuleInfo;
+    if (GetModuleInformation(hProcess, (HMODULE)(UINT_PTR)Base, &ModuleInfo, sizeof ModuleInfo)) {
+        AcquireSRWLockExclusive(&processes_lock);
+        mgwhelp_range_insert(process, Base, ModuleInfo.SizeOfImage);
+        ReleaseSRWLockExclusive(&processes_lock);
+    }
+
+    return Base;
 }
 
-EXTERN_C DWORD WINAPI
-MgwUnDecorateSymbolNameW(PCWSTR DecoratedName,
-                         PWSTR UnDecoratedName,
-                         DWORD UndecoratedLength,
-                         DWORD Flags)
+
+// Large enough for all but the most extreme template instantiations
+#define DEMANGLE_BUFFER_SIZE 4096
+
+
+struct demangle_output {
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+};
+
+
+static void
+demangle_append(const char *s, size_t length, void *opaque)
 {
-    assert(DecoratedName != NULL);
+    struct demangle_output *output = (struct demangle_output *)opaque;
+    if (output->overflow || length >= output->size - output->length) {
+        output->overflow = true;
+        return;
+    }
+    memcpy(output->buffer + output->length, s, length);
+    output->length += length;
+    output->buffer[output->length] = '\0';
+}
 
-    char DecoratedNameA[1024];
 
-    WideCharToMultiByte(CP_UTF8, 0, DecoratedName, -1, DecoratedNameA, sizeof(DecoratedNameA),
-                        nullptr, nullptr);
+/*
+ * Demangle a name into the given buffer.  libiberty's callback interface
+ * keeps its working state on the stack, so this never touches the heap,
+ * which may well be corrupted when called from a crash handler.
+ *
+ * Returns false if the name isn't mangled, or doesn't fit in the buffer.
+ */
+static bool
+demangle(const char *mangled, DWORD Flags, char *buffer, size_t size)
+{
+    assert(mangled);
+    assert(size > 0);
+
+    // There can be false negatives, such as "_ZwTerminateProcess@8"
+    if (mangled[0] != '_' || mangled[1] != 'Z') {
+        return false;
+    }
 
-    char *output_buffer = demangle(DecoratedNameA, Flags);
-    if (output_buffer) {
-        int len =
-            MultiByteToWideChar(CP_UTF8, 0, output_buffer, -1, UnDecoratedName, UndecoratedLength);
-        free(output_buffer);
-        return len;
+    int options = DMGL_PARAMS | DMGL_TYPES;
+    if (Flags & UNDNAME_NAME_ONLY) {
+        options = DMGL_NO_OPTS;
+    }
+    if (Flags & UNDNAME_NO_ARGUMENTS) {
+        options &= ~DMGL_PARAMS;
     }
 
-    return UnDecorateSymbolNameW(DecoratedName, UnDecoratedName, UndecoratedLength, Flags);
+    struct demangle_output output = {buffer, size, 0, false};
+    buffer[0] = '\0';
+
+    LONG64 start = mgwhelp_stats_clock();
+    bool ok = cplus_demangle_v3_callback(mangled, options, demangle_append, &output) &&
+              !output.overflow;
+    mgwhelp_stats_add(NULL, MGWHELP_STAT_DEMANGLES, 1);
+    mgwhelp_stats_add_time(NULL, MGWHELP_STAT_DEMANGLE_TIME, start);
+    return ok;
+}
+
+
+/*
+ * Copy a symbol name, truncating it to the buffer size.  Returns the length
+ * including the terminator, as MultiByteToWideChar would.
+ */
+template <typename Char>
+static ULONG
+mgwhelp_copy_name(Char *Name, ULONG MaxNameLen, const Char *name)
+{
+    size_t len = std::char_traits<Char>::length(name);
+    if (!MaxNameLen) {
+        return 0;
+    }
+    if (len >= MaxNameLen) {
+        len = MaxNameLen - 1;
+    }
+    memcpy(Name, name, len * sizeof *name);
+    Name[len] = 0;
+    return (ULONG)len;
+}
+
+
+/*
+ * Convert a name to UTF-16, returning its length without the terminator, as
+ * DbgHelp does.
+ */
+static ULONG
+mgwhelp_convert_name(PWSTR Name, ULONG MaxNameLen, const char *name, UINT CodePage)
+{
+    int len = MultiByteToWideChar(CodePage, 0, name, -1, Name, MaxNameLen);
+    if (len <= 0) {
+        if (MaxNameLen) {
+            Name[0] = L'\0';
+        }
+        return 0;
+    }
+    return (ULONG)len - 1;
+}
+
+
+static bool
+mgwhelp_wide_to_utf8(PCWSTR s, std::string &utf8)
+{
+    int len = WideCharToMultiByte(CP_UTF8, 0, s, -1, nullptr, 0, nullptr, nullptr);
+    if (len <= 0) {
+        return false;
+    }
+    utf8.resize(len - 1);
+    WideCharToMultiByte(CP_UTF8, 0, s, -1, &utf8[0], len, nullptr, nullptr);
+    return true;
+}
+
+
+static bool
+mgwhelp_utf8_to_wide(const char *s, std::wstring &wide)
+{
+    int len = MultiByteToWideChar(CP_UTF8, 0, s, -1, nullptr, 0);
+    if (len <= 0) {
+        return false;
+    }
+    wide.resize(len - 1);
+    MultiByteToWideChar(CP_UTF8, 0, s, -1, &wide[0], len);
+    return true;
+}
+
+
+static ULONG
+mgwhelp_convert_name(PSTR Name, ULONG MaxNameLen, PCWSTR name)
+{
+    int len = WideCharToMultiByte(CP_UTF8, 0, name, -1, Name, MaxNameLen, nullptr, nullptr);
+    if (len <= 0) {
+        if (MaxNameLen) {
+            Name[0] = '\0';
+        }
+        return 0;
+    }
+    return (ULONG)len - 1;
+}
+
+
+DWORD WINAPI
+MgwUnDecorateSymbolName(PCSTR DecoratedName,
+                        PSTR UnDecoratedName,
+                        DWORD UndecoratedLength,
+                        DWORD Flags)
+{
+    assert(DecoratedName != NULL);
+
+    char demangled[DEMANGLE_BUFFER_SIZE];
+    if (demangle(DecoratedName, Flags, demangled, sizeof demangled)) {
+        return mgwhelp_copy_name(UnDecoratedName, UndecoratedLength, demangled);
+    }
+
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    DWORD dwRet = UnDecorateSymbolName(DecoratedName, UnDecoratedName, UndecoratedLength, Flags);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+
+    return dwRet;
+}
+
+
+BOOL WINAPI
+MgwSymUnloadModule64(HANDLE hProcess, DWORD64 BaseOfDll)
+{
+    struct mgwhelp_module *module = NULL;
+
+    AcquireSRWLockExclusive(&processes_lock);
+    struct mgwhelp_process *process = mgwhelp_process_lookup(hProcess);
+    if (process) {
+        process->ranges.erase(BaseOfDll);
+
+        auto it = process->modules.find(BaseOfDll);
+        if (it != process->modules.end()) {
+            module = it->second;
+            process->modules.erase(it);
+        }
+    }
+    ReleaseSRWLockExclusive(&processes_lock);
+
+    if (module) {
+        result_cache_remove(&process->results, module->Base, module->SizeOfImage);
+        mgwhelp_module_unref(module);
+    }
+
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymUnloadModule64(hProcess, BaseOfDll);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+
+    return bRet;
+}
+
+
+BOOL WINAPI
+MgwSymCleanup(HANDLE hProcess)
+{
+    struct mgwhelp_process *process = NULL;
+
+    AcquireSRWLockExclusive(&processes_lock);
+    auto it = processes.find(hProcess);
+    if (it != processes.end()) {
+        process = it->second;
+        processes.erase(it);
+    }
+    ReleaseSRWLockExclusive(&processes_lock);
+
+    if (process) {
+        bool bDumpStats = _wgetenv(L"MGWHELP_STATS") != nullptr;
+        for (auto &entry : process->modules) {
+            if (bDumpStats) {
+                mgwhelp_stats_dump(entry.second->LoadedImageName, &entry.second->stats);
+            }
+            mgwhelp_module_unref(entry.second);
+        }
+        if (bDumpStats) {
+            mgwhelp_stats_dump(L"total", NULL);
+        }
+
+        delete process;
+    }
+
+    return SymCleanup(hProcess);
+}
+
+
+// Unicode stubs
+
+
+/*
+ * Names from the images, be it from DWARF, COFF symbols or exports, are
+ * taken to be UTF-8, which is what GCC emits.
+ */
+static void
+mgwhelp_set_symbol_name(PSYMBOL_INFOW Symbol, const char *name)
+{
+    char demangled[DEMANGLE_BUFFER_SIZE];
+    if ((SymGetOptions() & SYMOPT_UNDNAME) &&
+        demangle(name, UNDNAME_NAME_ONLY, demangled, sizeof demangled)) {
+        name = demangled;
+    }
+    Symbol->NameLen = mgwhelp_convert_name(Symbol->Name, Symbol->MaxNameLen, name, CP_UTF8);
+}
+
+
+static void
+mgwhelp_set_symbol_name(PSYMBOL_INFO Symbol, const char *name)
+{
+    char demangled[DEMANGLE_BUFFER_SIZE];
+    if ((SymGetOptions() & SYMOPT_UNDNAME) &&
+        demangle(name, UNDNAME_NAME_ONLY, demangled, sizeof demangled)) {
+        name = demangled;
+    }
+    Symbol->NameLen = mgwhelp_copy_name(Symbol->Name, Symbol->MaxNameLen, name);
+}
+
+
+static void
+mgwhelp_set_symbol_result(PSYMBOL_INFOW Symbol, const struct result_cache_entry *result)
+{
+    const wchar_t *name = SymGetOptions() & SYMOPT_UNDNAME ? result->UndName : result->Name;
+    Symbol->NameLen = mgwhelp_copy_name(Symbol->Name, Symbol->MaxNameLen, name);
+}
+
+
+static void
+mgwhelp_set_symbol_result(PSYMBOL_INFO Symbol, const struct result_cache_entry *result)
+{
+    const char *name = SymGetOptions() & SYMOPT_UNDNAME ? result->UndNameA : result->NameA;
+    Symbol->NameLen = mgwhelp_copy_name(Symbol->Name, Symbol->MaxNameLen, name);
+}
+
+
+/*
+ * Convert the result of a DWARF lookup, and cache it.  Strings that didn't
+ * make it into the cache are kept in thread local buffers, which are only
+ * valid until the next lookup.
+ */
+static void
+mgwhelp_cache_result(struct mgwhelp_module *module,
+                     DWORD64 Address,
+                     const struct dwarf_symbol_info *symbol,
+                     const struct dwarf_line_info *line,
+                     struct result_cache_entry *result)
+{
+    static thread_local struct {
+        wchar_t Name[DEMANGLE_BUFFER_SIZE];
+        wchar_t UndName[DEMANGLE_BUFFER_SIZE];
+        wchar_t FileName[MAX_PATH * 4];
+        char NameA[DEMANGLE_BUFFER_SIZE];
+        char UndNameA[DEMANGLE_BUFFER_SIZE];
+        char FileNameA[MAX_PATH * 4 * 3];
+    } buffers;
+
+    ZeroMemory(result, sizeof *result);
+
+    // DWARF names are UTF-8 already, so only the wide ones need transcoding
+    if (symbol) {
+        mgwhelp_copy_name(buffers.NameA, _countof(buffers.NameA),
+                          symbol->functionname.c_str());
+        result->NameA = buffers.NameA;
+        result->UndNameA = buffers.NameA;
+        if (demangle(buffers.NameA, UNDNAME_NAME_ONLY, buffers.UndNameA,
+                     sizeof buffers.UndNameA)) {
+            result->UndNameA = buffers.UndNameA;
+        }
+
+        if (!MultiByteToWideChar(CP_UTF8, 0, result->NameA, -1, buffers.Name,
+                                 _countof(buffers.Name))) {
+            buffers.Name[0] = L'\0';
+        }
+        result->Name = buffers.Name;
+        result->UndName = buffers.Name;
+        if (result->UndNameA != result->NameA &&
+            MultiByteToWideChar(CP_UTF8, 0, result->UndNameA, -1, buffers.UndName,
+                                _countof(buffers.UndName))) {
+            result->UndName = buffers.UndName;
+        }
+
+        result->Displacement = symbol->offset_addr;
+    }
+
+    if (line && !line->filename.empty()) {
+        mgwhelp_copy_name(buffers.FileName, _countof(buffers.FileName), line->filename.c_str());
+        if (!WideCharToMultiByte(CP_UTF8, 0, buffers.FileName, -1, buffers.FileNameA,
+                                 sizeof buffers.FileNameA, nullptr, nullptr)) {
+            buffers.FileNameA[0] = '\0';
+        }
+        result->FileName = buffers.FileName;
+        result->FileNameA = buffers.FileNameA;
+        result->LineNumber = line->line;
+        result->ColumnNumber = line->column;
+        result->LineDisplacement = line->offset_addr;
+    }
+
+    result_cache_insert(&module->process->results, Address, result);
+}
+
+
+/*
+ * Resolve an address from the result cache, or else from the DWARF
+ * debugging information of its module.  Returns false if the module has
+ * none, otherwise the result tells whether the symbol and line were found.
+ */
+static bool
+mgwhelp_find_result(struct mgwhelp_module *module,
+                    DWORD64 Address,
+                    struct result_cache_entry *result)
+{
+    if (result_cache_lookup(&module->process->results, Address, result)) {
+        return true;
+    }
+
+    if (!mgwhelp_module_acquire_dwarf(module)) {
+        return false;
+    }
+
+    struct dwarf_symbol_info symbol;
+    struct dwarf_line_info line;
+    LONG64 start = mgwhelp_stats_clock();
+    bool found = dwarf_find_symbol_line(&module->dwarf, module->image_base_vma,
+                                        module->LoadedImageName, module->Base, Address, &symbol,
+                                        &line);
+    if (!found) {
+        // There may be line information outside of any function
+        line = dwarf_line_info();
+        dwarf_find_line(&module->dwarf, module->image_base_vma, module->LoadedImageName,
+                        module->Base, Address, &line);
+    }
+    mgwhelp_module_release_dwarf(module);
+    mgwhelp_count_dwarf_lookups(module, 1, found, start);
+
+    mgwhelp_cache_result(module, Address, found ? &symbol : NULL, &line, result);
+    return true;
+}
+
+
+/*
+ * Symbol lookup on the image, for modules without DWARF debugging
+ * information.
+ */
+template <typename SymbolInfo>
+static BOOL
+mgwhelp_sym_from_pe(struct mgwhelp_module *module,
+                    DWORD64 Offset,
+                    PDWORD64 Displacement,
+                    SymbolInfo *Symbol)
+{
+    char symbol_name[1024];
+    DWORD64 dwDisplacement;
+    if (!module || !module->image ||
+        !pe_find_symbol(module, Offset, _countof(symbol_name), symbol_name, &dwDisplacement,
+                        &Symbol->Size)) {
+        return FALSE;
+    }
+
+    mgwhelp_set_symbol_name(Symbol, symbol_name);
+    Symbol->Address = module->Base + (Offset - module->image_base_vma) - dwDisplacement;
+    if (Displacement) {
+        *Displacement = dwDisplacement;
+    }
+    return TRUE;
+}
+
+
+static BOOL
+mgwhelp_dbghelp_sym_from_addr(HANDLE hProcess,
+                              DWORD64 Address,
+                              PDWORD64 Displacement,
+                              PSYMBOL_INFOW Symbol)
+{
+    return SymFromAddrW(hProcess, Address, Displacement, Symbol);
+}
+
+
+/*
+ * Narrow DbgHelp lookups go through the wide variants, and have their names
+ * converted to UTF-8, so that the narrow entry points return UTF-8 names
+ * whichever way they were resolved, rather than DbgHelp's ANSI ones.
+ */
+struct mgwhelp_symbol_infow {
+    SYMBOL_INFOW Symbol;
+    WCHAR Name[MAX_SYM_NAME];
+};
+
+
+static void
+mgwhelp_init_symbol(struct mgwhelp_symbol_infow *SymbolW)
+{
+    ZeroMemory(&SymbolW->Symbol, sizeof SymbolW->Symbol);
+    SymbolW->Symbol.SizeOfStruct = sizeof SymbolW->Symbol;
+    SymbolW->Symbol.MaxNameLen = _countof(SymbolW->Symbol.Name) + _countof(SymbolW->Name);
+}
+
+
+static void
+mgwhelp_symbol_to_utf8(PSYMBOL_INFO Symbol, const SYMBOL_INFOW *SymbolW)
+{
+    Symbol->TypeIndex = SymbolW->TypeIndex;
+    Symbol->Index = SymbolW->Index;
+    Symbol->Size = SymbolW->Size;
+    Symbol->ModBase = SymbolW->ModBase;
+    Symbol->Flags = SymbolW->Flags;
+    Symbol->Value = SymbolW->Value;
+    Symbol->Address = SymbolW->Address;
+    Symbol->Register = SymbolW->Register;
+    Symbol->Scope = SymbolW->Scope;
+    Symbol->Tag = SymbolW->Tag;
+    Symbol->NameLen = mgwhelp_convert_name(Symbol->Name, Symbol->MaxNameLen, SymbolW->Name);
+}
+
+
+static BOOL
+mgwhelp_dbghelp_sym_from_addr(HANDLE hProcess,
+                              DWORD64 Address,
+                              PDWORD64 Displacement,
+                              PSYMBOL_INFO Symbol)
+{
+    struct mgwhelp_symbol_infow SymbolW;
+    mgwhelp_init_symbol(&SymbolW);
+    if (!SymFromAddrW(hProcess, Address, Displacement, &SymbolW.Symbol)) {
+        return FALSE;
+    }
+    mgwhelp_symbol_to_utf8(Symbol, &SymbolW.Symbol);
+    return TRUE;
+}
+
+
+template <typename SymbolInfo>
+static BOOL
+mgwhelp_sym_from_dbghelp(HANDLE hProcess,
+                         struct mgwhelp_module *module,
+                         DWORD64 Address,
+                         PDWORD64 Displacement,
+                         SymbolInfo *Symbol)
+{
+    LONG64 start = mgwhelp_stats_clock();
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = mgwhelp_dbghelp_sym_from_addr(hProcess, Address, Displacement, Symbol);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    mgwhelp_count_dbghelp_lookup(module, bRet, start);
+
+    return bRet;
+}
+
+
+/*
+ * Whether DbgHelp has loaded a PDB for the module containing the address.
+ * Deferred symbols aren't loaded to find out.
+ */
+static bool
+mgwhelp_dbghelp_has_pdb(HANDLE hProcess, DWORD64 Address)
+{
+    IMAGEHLP_MODULEW64 ModuleInfo;
+    ZeroMemory(&ModuleInfo, sizeof ModuleInfo);
+    ModuleInfo.SizeOfStruct = sizeof ModuleInfo;
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymGetModuleInfoW64(hProcess, Address, &ModuleInfo);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    return bRet && ModuleInfo.SymType == SymPdb;
+}
+
+
+/*
+ * Symbol lookup for modules without DWARF debugging information.  DbgHelp
+ * is asked first for modules it has a PDB for, as those name every function,
+ * such as those of MSVC built and system DLLs, whereas the exports and
+ * sub_XXX names are only the nearest approximation.  Otherwise DbgHelp is
+ * the last resort, as it may go looking for PDBs, possibly on symbol servers.
+ */
+template <typename SymbolInfo>
+static BOOL
+mgwhelp_sym_from_addr_fallback(HANDLE hProcess,
+                               struct mgwhelp_module *module,
+                               DWORD64 Offset,
+                               DWORD64 Address,
+                               PDWORD64 Displacement,
+                               SymbolInfo *Symbol)
+{
+    if (mgwhelp_dbghelp_has_pdb(hProcess, Address)) {
+        return mgwhelp_sym_from_dbghelp(hProcess, module, Address, Displacement, Symbol) ||
+               mgwhelp_sym_from_pe(module, Offset, Displacement, Symbol);
+    }
+
+    return mgwhelp_sym_from_pe(module, Offset, Displacement, Symbol) ||
+           mgwhelp_sym_from_dbghelp(hProcess, module, Address, Displacement, Symbol);
+}
+
+
+BOOL WINAPI
+MgwSymFromAddrW(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_INFOW Symbol)
+{
+    // search DWARF symbols first, since we support modules without .debug_aranges
+    DWORD64 Offset;
+    mgwhelp_module *module = mgwhelp_find_module(hProcess, Address, &Offset);
+
+    BOOL bRet;
+    struct result_cache_entry result;
+    if (module && mgwhelp_find_result(module, Address, &result) && result.Name) {
+        mgwhelp_set_symbol_result(Symbol, &result);
+        if (Displacement) {
+            *Displacement = result.Displacement;
+        }
+        bRet = TRUE;
+    } else {
+        bRet = mgwhelp_sym_from_addr_fallback(hProcess, module, Offset, Address, Displacement,
+                                              Symbol);
+    }
+
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+BOOL WINAPI
+MgwSymGetLineFromAddrW64(HANDLE hProcess,
+                         DWORD64 dwAddr,
+                         PDWORD pdwDisplacement,
+                         PIMAGEHLP_LINEW64 Line)
+{
+    DWORD64 Offset;
+    mgwhelp_module *module = mgwhelp_find_module(hProcess, dwAddr, &Offset);
+
+    struct result_cache_entry result;
+    if (module && mgwhelp_find_result(module, dwAddr, &result) && result.FileName) {
+        // Interned, so valid for at least as long as DbgHelp's buffer would be
+        Line->FileName = (PWSTR)result.FileName;
+        Line->LineNumber = result.LineNumber;
+
+        if (pdwDisplacement) {
+            *pdwDisplacement = result.LineDisplacement;
+        }
+        mgwhelp_module_unref(module);
+        return TRUE;
+    }
+
+    LONG64 start = mgwhelp_stats_clock();
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymGetLineFromAddrW64(hProcess, dwAddr, pdwDisplacement, Line);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    mgwhelp_count_dbghelp_lookup(module, bRet, start);
+
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+EXTERN_C DWORD WINAPI
+MgwUnDecorateSymbolNameW(PCWSTR DecoratedName,
+                         PWSTR UnDecoratedName,
+                         DWORD UndecoratedLength,
+                         DWORD Flags)
+{
+    assert(DecoratedName != NULL);
+
+    char DecoratedNameA[DEMANGLE_BUFFER_SIZE];
+
+    WideCharToMultiByte(CP_UTF8, 0, DecoratedName, -1, DecoratedNameA, sizeof(DecoratedNameA),
+                        nullptr, nullptr);
+
+    char demangled[DEMANGLE_BUFFER_SIZE];
+    if (demangle(DecoratedNameA, Flags, demangled, sizeof demangled)) {
+        return mgwhelp_convert_name(UnDecoratedName, UndecoratedLength, demangled, CP_UTF8);
+    }
+
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    DWORD dwRet = UnDecorateSymbolNameW(DecoratedName, UnDecoratedName, UndecoratedLength, Flags);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+
+    return dwRet;
+}
+
+
+// Narrow entry points
+//
+// These resolve from the UTF-8 strings of the result cache directly, rather
+// than through the wide entry points.
+
+
+BOOL WINAPI
+MgwSymFromAddr(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_INFO Symbol)
+{
+    DWORD64 Offset;
+    mgwhelp_module *module = mgwhelp_find_module(hProcess, Address, &Offset);
+
+    BOOL bRet;
+    struct result_cache_entry result;
+    if (module && mgwhelp_find_result(module, Address, &result) && result.NameA) {
+        mgwhelp_set_symbol_result(Symbol, &result);
+        if (Displacement) {
+            *Displacement = result.Displacement;
+        }
+        bRet = TRUE;
+    } else {
+        bRet = mgwhelp_sym_from_addr_fallback(hProcess, module, Offset, Address, Displacement,
+                                              Symbol);
+    }
+
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+BOOL WINAPI
+MgwSymGetLineFromAddr64(HANDLE hProcess,
+                        DWORD64 dwAddr,
+                        PDWORD pdwDisplacement,
+                        PIMAGEHLP_LINE64 Line)
+{
+    DWORD64 Offset;
+    mgwhelp_module *module = mgwhelp_find_module(hProcess, dwAddr, &Offset);
+
+    struct result_cache_entry result;
+    if (module && mgwhelp_find_result(module, dwAddr, &result) && result.FileNameA) {
+        // https://msdn.microsoft.com/en-us/library/windows/desktop/ms681330.aspx
+        // states that callers should copy the file name immediately, so
+        // pointing into the cache, which evicts it only later, is fine
+        Line->FileName = (PSTR)result.FileNameA;
+        Line->LineNumber = result.LineNumber;
+
+        if (pdwDisplacement) {
+            *pdwDisplacement = result.LineDisplacement;
+        }
+        mgwhelp_module_unref(module);
+        return TRUE;
+    }
+
+    // Through the wide variant, for a UTF-8 file name, which must be
+    // converted before DbgHelp reuses its buffer
+    static thread_local std::string FileName;
+    IMAGEHLP_LINEW64 LineW;
+    ZeroMemory(&LineW, sizeof LineW);
+    LineW.SizeOfStruct = sizeof LineW;
+    LONG64 start = mgwhelp_stats_clock();
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymGetLineFromAddrW64(hProcess, dwAddr, pdwDisplacement, &LineW);
+    if (bRet && !mgwhelp_wide_to_utf8(LineW.FileName, FileName)) {
+        FileName.clear();
+    }
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    mgwhelp_count_dbghelp_lookup(module, bRet, start);
+    mgwhelp_module_unref(module);
+
+    if (bRet) {
+        Line->Key = LineW.Key;
+        Line->LineNumber = LineW.LineNumber;
+        Line->FileName = (PSTR)FileName.c_str();
+        Line->Address = LineW.Address;
+    }
+
+    return bRet;
+}
+
+
+// Lookups by name
+
+
+static void
+mgwhelp_index_name(void *arg, const char *name, uint32_t rva, uint32_t size)
+{
+    struct name_index *names = (struct name_index *)arg;
+
+    char demangled[DEMANGLE_BUFFER_SIZE];
+    bool bDemangled = demangle(name, UNDNAME_NAME_ONLY, demangled, sizeof demangled);
+    name_index_add(names, rva, size, name, bDemangled ? demangled : NULL);
+}
+
+
+static void
+mgwhelp_index_pe_symbols(struct mgwhelp_module *module,
+                         struct name_index *names,
+                         const std::vector<pe_symbol> &symbols)
+{
+    for (const pe_symbol &symbol : symbols) {
+        // Skip absolute symbols
+        DWORD64 Rva = symbol.Addr - module->image_base_vma;
+        if (symbol.Addr < module->image_base_vma || Rva >= module->SizeOfImage) {
+            continue;
+        }
+        mgwhelp_index_name(names, symbol.Name, (uint32_t)Rva, 0);
+    }
+}
+
+
+/*
+ * Get the name index of a module, building it on first use from the DWARF
+ * functions, and the COFF symbols and exports of the image.
+ */
+static const struct name_index *
+mgwhelp_module_names(struct mgwhelp_module *module)
+{
+    if (!InterlockedCompareExchange(&module->names_indexed, FALSE, FALSE)) {
+        struct name_index *names = name_index_create();
+        bool bDebugInfo = false;
+
+        if (mgwhelp_module_acquire_dwarf(module)) {
+            dwarf_enum_functions(&module->dwarf, mgwhelp_index_name, names);
+            mgwhelp_module_release_dwarf(module);
+            bDebugInfo = true;
+        }
+        const std::vector<pe_symbol> &FunctionSymbols = pe_image_function_symbols(module->image);
+        mgwhelp_index_pe_symbols(module, names, FunctionSymbols);
+        mgwhelp_index_pe_symbols(module, names, pe_image_export_symbols(module->image));
+        if (!FunctionSymbols.empty()) {
+            bDebugInfo = true;
+        }
+
+        name_index_finish(names);
+        module->names_debug_info = bDebugInfo;
+
+        // Another thread may have indexed it meanwhile
+        if (InterlockedCompareExchangePointer((PVOID volatile *)&module->names, names, NULL)) {
+            name_index_destroy(names);
+        }
+        InterlockedExchange(&module->names_indexed, TRUE);
+    }
+
+    return module->names;
+}
+
+
+struct mgwhelp_loaded_module {
+    DWORD64 Base;
+    std::string Name; // UTF-8
+};
+
+
+static BOOL CALLBACK
+mgwhelp_enum_modules_callback(PCWSTR ModuleName, DWORD64 BaseOfDll, PVOID UserContext)
+{
+    auto loaded = (std::vector<struct mgwhelp_loaded_module> *)UserContext;
+
+    char Name[MAX_PATH * 3];
+    if (!WideCharToMultiByte(CP_UTF8, 0, ModuleName, -1, Name, sizeof Name, nullptr, nullptr)) {
+        Name[0] = '\0';
+    }
+    loaded->push_back({BaseOfDll, Name});
+    return TRUE;
+}
+
+
+/*
+ * Get the module at BaseOfDll, or else the modules loaded into DbgHelp whose
+ * name matches the mask, or all when the mask is NULL.  The modules must be
+ * unreferenced with mgwhelp_modules_unref once done with.
+ */
+static void
+mgwhelp_find_modules(HANDLE hProcess,
+                     DWORD64 BaseOfDll,
+                     const char *ModuleMask,
+                     std::vector<struct mgwhelp_module *> *modules)
+{
+    modules->clear();
+
+    if (BaseOfDll) {
+        struct mgwhelp_module *module =
+            mgwhelp_module_lookup(hProcess, 0, NULL, BaseOfDll, false);
+        if (module) {
+            modules->push_back(module);
+        }
+        return;
+    }
+
+    std::vector<struct mgwhelp_loaded_module> loaded;
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    SymEnumerateModulesW64(hProcess, mgwhelp_enum_modules_callback, &loaded);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+
+    for (const struct mgwhelp_loaded_module &entry : loaded) {
+        if (ModuleMask && !name_glob_match(ModuleMask, entry.Name.c_str(), false)) {
+            continue;
+        }
+        struct mgwhelp_module *module =
+            mgwhelp_module_lookup(hProcess, 0, NULL, entry.Base, false);
+        if (module) {
+            modules->push_back(module);
+        }
+    }
+}
+
+
+struct mgwhelp_name_match {
+    struct mgwhelp_module *module;
+    const struct name_index *names;
+    const struct name_symbol *symbol;
+};
+
+
+/*
+ * Split a "module!symbol" name or mask, returning the symbol part.
+ */
+static const char *
+mgwhelp_split_module(const char *Name, std::string *ModuleMask, bool *pbModule)
+{
+    const char *bang = strchr(Name, '!');
+    *pbModule = bang != NULL;
+    if (!bang) {
+        return Name;
+    }
+    ModuleMask->assign(Name, bang - Name);
+    return bang + 1;
+}
+
+
+// Bound on the forwarded exports followed, as forwarders may form cycles
+#define MGWHELP_MAX_FORWARDS 4
+
+
+/*
+ * Find a symbol by name, decorated or not, optionally qualified with the
+ * module name, in the modules in DbgHelp's load order.  Forwarded exports
+ * are followed to the module they are forwarded to.  The module of the match
+ * must be unreferenced once done with.
+ */
+static bool
+mgwhelp_find_name(HANDLE hProcess,
+                  const char *Name,
+                  unsigned nForwards,
+                  struct mgwhelp_name_match *match)
+{
+    std::string ModuleMask;
+    bool bModule;
+    const char *SymbolName = mgwhelp_split_module(Name, &ModuleMask, &bModule);
+
+    std::vector<struct mgwhelp_module *> modules;
+    mgwhelp_find_modules(hProcess, 0, bModule ? ModuleMask.c_str() : NULL, &modules);
+
+    bool bFound = false;
+    bool bCaseSensitive = !(SymGetOptions() & SYMOPT_CASE_INSENSITIVE);
+    for (struct mgwhelp_module *module : modules) {
+        const struct name_index *names = mgwhelp_module_names(module);
+        const struct name_symbol *symbol = name_index_find(names, SymbolName, bCaseSensitive);
+        if (symbol) {
+            match->module = mgwhelp_module_ref(module);
+            match->names = names;
+            match->symbol = symbol;
+            bFound = true;
+            break;
+        }
+    }
+
+    if (!bFound && nForwards < MGWHELP_MAX_FORWARDS) {
+        for (struct mgwhelp_module *module : modules) {
+            // "MODULE.Name", as forwards by ordinal aren't supported
+            PCSTR Target = pe_image_find_forwarder(module->image, SymbolName);
+            const char *dot = Target ? strrchr(Target, '.') : NULL;
+            if (dot && dot[1] != '#') {
+                std::string TargetName(Target);
+                TargetName[dot - Target] = '!';
+                if (mgwhelp_find_name(hProcess, TargetName.c_str(), nForwards + 1, match)) {
+                    bFound = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    mgwhelp_modules_unref(modules);
+    return bFound;
+}
+
+
+/*
+ * Find the symbols matching a mask, optionally qualified with a module mask,
+ * along with the modules that have no DWARF or COFF symbols, whose remaining
+ * symbols only DbgHelp can enumerate.  Returns false if none of the modules
+ * is known to mgwhelp.  The modules of the matches are returned too, to be
+ * unreferenced once done with the matches.
+ */
+static bool
+mgwhelp_match_names(HANDLE hProcess,
+                    DWORD64 BaseOfDll,
+                    const char *Mask,
+                    std::vector<struct mgwhelp_name_match> *matches,
+                    std::vector<DWORD64> *dbghelp_modules,
+                    std::vector<struct mgwhelp_module *> *modules)
+{
+    std::string ModuleMask;
+    bool bModule = false;
+    const char *SymbolMask = Mask ? mgwhelp_split_module(Mask, &ModuleMask, &bModule) : NULL;
+
+    mgwhelp_find_modules(hProcess, BaseOfDll, bModule ? ModuleMask.c_str() : NULL, modules);
+    if (modules->empty()) {
+        return false;
+    }
+
+    bool bCaseSensitive = !(SymGetOptions() & SYMOPT_CASE_INSENSITIVE);
+    std::vector<const struct name_symbol *> symbols;
+    for (struct mgwhelp_module *module : *modules) {
+        const struct name_index *names = mgwhelp_module_names(module);
+        name_index_match(names, SymbolMask, bCaseSensitive, &symbols);
+        for (const struct name_symbol *symbol : symbols) {
+            matches->push_back({module, names, symbol});
+        }
+        if (!module->names_debug_info) {
+            dbghelp_modules->push_back(module->Base);
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Fill in a symbol found by name, except for the name itself, which is
+ * returned instead, as UTF-8.
+ */
+template <typename SymbolInfo>
+static const char *
+mgwhelp_set_symbol_match(SymbolInfo *Symbol, const struct mgwhelp_name_match *match)
+{
+    Symbol->TypeIndex = 0;
+    Symbol->Index = 0;
+    Symbol->Size = match->symbol->Size;
+    Symbol->ModBase = match->module->Base;
+    Symbol->Flags = 0;
+    Symbol->Value = 0;
+    Symbol->Address = match->module->Base + match->symbol->Rva;
+    Symbol->Register = 0;
+    Symbol->Scope = 0;
+    Symbol->Tag = SymTagFunction;
+
+    DWORD Name = SymGetOptions() & SYMOPT_UNDNAME ? match->symbol->UndName : match->symbol->Name;
+    return name_index_string(match->names, Name);
+}
+
+
+static void
+mgwhelp_set_symbol_match_name(PSYMBOL_INFO Symbol, const char *name)
+{
+    Symbol->NameLen = mgwhelp_copy_name(Symbol->Name, Symbol->MaxNameLen, name);
+}
+
+
+static void
+mgwhelp_set_symbol_match_name(PSYMBOL_INFOW Symbol, const char *name)
+{
+    Symbol->NameLen = mgwhelp_convert_name(Symbol->Name, Symbol->MaxNameLen, name, CP_UTF8);
+}
+
+
+BOOL WINAPI
+MgwSymFromName(HANDLE hProcess, PCSTR Name, PSYMBOL_INFO Symbol)
+{
+    struct mgwhelp_name_match match;
+    if (Name && mgwhelp_find_name(hProcess, Name, 0, &match)) {
+        mgwhelp_set_symbol_match_name(Symbol, mgwhelp_set_symbol_match(Symbol, &match));
+        mgwhelp_module_unref(match.module);
+        return TRUE;
+    }
+
+    std::wstring NameW;
+    if (Name && !mgwhelp_utf8_to_wide(Name, NameW)) {
+        SetLastError(ERROR_NO_UNICODE_TRANSLATION);
+        return FALSE;
+    }
+
+    struct mgwhelp_symbol_infow SymbolW;
+    mgwhelp_init_symbol(&SymbolW);
+    LONG64 start = mgwhelp_stats_clock();
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymFromNameW(hProcess, Name ? NameW.c_str() : NULL, &SymbolW.Symbol);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    mgwhelp_count_dbghelp_lookup(NULL, bRet, start);
+
+    if (bRet) {
+        mgwhelp_symbol_to_utf8(Symbol, &SymbolW.Symbol);
+    }
+
+    return bRet;
+}
+
+
+BOOL WINAPI
+MgwSymFromNameW(HANDLE hProcess, PCWSTR Name, PSYMBOL_INFOW Symbol)
+{
+    std::string NameA;
+    struct mgwhelp_name_match match;
+    if (Name && mgwhelp_wide_to_utf8(Name, NameA) &&
+        mgwhelp_find_name(hProcess, NameA.c_str(), 0, &match)) {
+        mgwhelp_set_symbol_match_name(Symbol, mgwhelp_set_symbol_match(Symbol, &match));
+        mgwhelp_module_unref(match.module);
+        return TRUE;
+    }
+
+    LONG64 start = mgwhelp_stats_clock();
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymFromNameW(hProcess, Name, Symbol);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    mgwhelp_count_dbghelp_lookup(NULL, bRet, start);
+
+    return bRet;
+}
+
+
+/*
+ * Symbols enumerated by DbgHelp are copied, and only passed on to the
+ * caller's callback once the DbgHelp lock is released, as the callback may
+ * well call back into mgwhelp.
+ */
+typedef std::vector<std::pair<std::vector<BYTE>, ULONG>> mgwhelp_collected_symbols;
+
+
+template <typename SymbolInfo>
+static BOOL CALLBACK
+mgwhelp_collect_symbol(SymbolInfo *pSymInfo, ULONG SymbolSize, PVOID UserContext)
+{
+    auto symbols = (mgwhelp_collected_symbols *)UserContext;
+
+    const BYTE *data = (const BYTE *)pSymInfo;
+    size_t size = sizeof *pSymInfo + pSymInfo->NameLen * sizeof pSymInfo->Name[0];
+    symbols->emplace_back(std::vector<BYTE>(data, data + size), SymbolSize);
+    return TRUE;
+}
+
+
+static BOOL CALLBACK
+mgwhelp_collect_symbol_utf8(PSYMBOL_INFOW pSymInfo, ULONG SymbolSize, PVOID UserContext)
+{
+    auto symbols = (mgwhelp_collected_symbols *)UserContext;
+
+    int len = WideCharToMultiByte(CP_UTF8, 0, pSymInfo->Name, -1, nullptr, 0, nullptr, nullptr);
+    if (len <= 0) {
+        len = 1;
+    }
+    std::vector<BYTE> data(sizeof(SYMBOL_INFO) + len);
+    PSYMBOL_INFO Symbol = (PSYMBOL_INFO)data.data();
+    Symbol->SizeOfStruct = sizeof *Symbol;
+    Symbol->MaxNameLen = len;
+    mgwhelp_symbol_to_utf8(Symbol, pSymInfo);
+    symbols->emplace_back(std::move(data), SymbolSize);
+    return TRUE;
+}
+
+
+static BOOL
+mgwhelp_dbghelp_enum_symbols(HANDLE hProcess,
+                             ULONG64 BaseOfDll,
+                             PCWSTR Mask,
+                             mgwhelp_collected_symbols *symbols)
+{
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymEnumSymbolsW(hProcess, BaseOfDll, Mask, mgwhelp_collect_symbol<SYMBOL_INFOW>,
+                                symbols);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    return bRet;
+}
+
+
+// Through the wide variant, for UTF-8 names, as with SymFromAddr
+static BOOL
+mgwhelp_dbghelp_enum_symbols(HANDLE hProcess,
+                             ULONG64 BaseOfDll,
+                             PCSTR Mask,
+                             mgwhelp_collected_symbols *symbols)
+{
+    std::wstring MaskW;
+    if (Mask && !mgwhelp_utf8_to_wide(Mask, MaskW)) {
+        SetLastError(ERROR_NO_UNICODE_TRANSLATION);
+        return FALSE;
+    }
+
+    AcquireSRWLockExclusive(&dbghelp_lock);
+    BOOL bRet = SymEnumSymbolsW(hProcess, BaseOfDll, Mask ? MaskW.c_str() : NULL,
+                                mgwhelp_collect_symbol_utf8, symbols);
+    ReleaseSRWLockExclusive(&dbghelp_lock);
+    return bRet;
+}
+
+
+/*
+ * Pass the collected symbols on to the callback, skipping the addresses
+ * already reported, if given.  Returns false if the callback stopped the
+ * enumeration.
+ */
+template <typename SymbolInfo, typename Callback>
+static bool
+mgwhelp_report_symbols(const mgwhelp_collected_symbols &symbols,
+                       std::unordered_set<DWORD64> *reported,
+                       Callback EnumSymbolsCallback,
+                       PVOID UserContext)
+{
+    for (auto &symbol : symbols) {
+        SymbolInfo *pSymInfo = (SymbolInfo *)symbol.first.data();
+        if (reported && !reported->insert(pSymInfo->Address).second) {
+            continue;
+        }
+        if (!EnumSymbolsCallback(pSymInfo, symbol.second, UserContext)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+template <typename SymbolInfo, typename Char, typename Callback>
+static BOOL
+mgwhelp_enum_symbols_fallback(HANDLE hProcess,
+                              ULONG64 BaseOfDll,
+                              const Char *Mask,
+                              Callback EnumSymbolsCallback,
+                              PVOID UserContext)
+{
+    mgwhelp_collected_symbols symbols;
+    BOOL bRet = mgwhelp_dbghelp_enum_symbols(hProcess, BaseOfDll, Mask, &symbols);
+    mgwhelp_report_symbols<SymbolInfo>(symbols, NULL, EnumSymbolsCallback, UserContext);
+    return bRet;
+}
+
+
+static const char *
+mgwhelp_symbol_mask(const char *Mask)
+{
+    const char *bang = Mask ? strchr(Mask, '!') : NULL;
+    return bang ? bang + 1 : Mask;
+}
+
+
+static const wchar_t *
+mgwhelp_symbol_mask(const wchar_t *Mask)
+{
+    const wchar_t *bang = Mask ? wcschr(Mask, L'!') : NULL;
+    return bang ? bang + 1 : Mask;
+}
+
+
+/*
+ * Enumerate the symbols found in the name indices, followed by the ones
+ * DbgHelp finds in the modules without DWARF or COFF symbols -- PDB and data
+ * symbols, notably -- except for the addresses already enumerated.
+ */
+template <typename SymbolInfo, typename Char, typename Callback>
+static void
+mgwhelp_enum_matches(HANDLE hProcess,
+                     const Char *Mask,
+                     const std::vector<struct mgwhelp_name_match> &matches,
+                     const std::vector<DWORD64> &dbghelp_modules,
+                     Callback EnumSymbolsCallback,
+                     PVOID UserContext)
+{
+    union {
+        SymbolInfo Symbol;
+        BYTE Buffer[sizeof(SymbolInfo) + MAX_SYM_NAME * sizeof(SymbolInfo::Name[0])];
+    } u;
+    SymbolInfo *Symbol = &u.Symbol;
+    ZeroMemory(Symbol, sizeof *Symbol);
+    Symbol->SizeOfStruct = sizeof *Symbol;
+    Symbol->MaxNameLen = MAX_SYM_NAME;
+
+    std::unordered_set<DWORD64> reported;
+    for (const struct mgwhelp_name_match &match : matches) {
+        mgwhelp_set_symbol_match_name(Symbol, mgwhelp_set_symbol_match(Symbol, &match));
+        if (!EnumSymbolsCallback(Symbol, Symbol->Size, UserContext)) {
+            return;
+        }
+        reported.insert(Symbol->Address);
+    }
+
+    const Char *SymbolMask = mgwhelp_symbol_mask(Mask);
+    for (DWORD64 Base : dbghelp_modules) {
+        mgwhelp_collected_symbols symbols;
+        mgwhelp_dbghelp_enum_symbols(hProcess, Base, SymbolMask, &symbols);
+        if (!mgwhelp_report_symbols<SymbolInfo>(symbols, &reported, EnumSymbolsCallback,
+                                                UserContext)) {
+            return;
+        }
+    }
+}
+
+
+/*
+ * Enumerate the symbols matching a mask with '*' and '?' wildcards, which
+ * may be qualified with a module mask, as in "module!symbol".
+ *
+ * Symbols are looked up in the name index of the modules, and in DbgHelp
+ * for the modules without DWARF or COFF symbols, whereas, as with DbgHelp,
+ * when neither a module base address nor a module mask are given, the mask
+ * applies to the local symbols of the scope set with SymSetContext, which
+ * are enumerated by DbgHelp.
+ */
+BOOL WINAPI
+MgwSymEnumSymbols(HANDLE hProcess,
+                  ULONG64 BaseOfDll,
+                  PCSTR Mask,
+                  PSYM_ENUMERATESYMBOLS_CALLBACK EnumSymbolsCallback,
+                  PVOID UserContext)
+{
+    std::vector<struct mgwhelp_name_match> matches;
+    std::vector<DWORD64> dbghelp_modules;
+    std::vector<struct mgwhelp_module *> modules;
+    if ((BaseOfDll || (Mask && strchr(Mask, '!'))) &&
+        mgwhelp_match_names(hProcess, BaseOfDll, Mask, &matches, &dbghelp_modules, &modules)) {
+        mgwhelp_enum_matches<SYMBOL_INFO>(hProcess, Mask, matches, dbghelp_modules,
+                                          EnumSymbolsCallback, UserContext);
+        mgwhelp_modules_unref(modules);
+        return TRUE;
+    }
+
+    return mgwhelp_enum_symbols_fallback<SYMBOL_INFO>(hProcess, BaseOfDll, Mask,
+                                                      EnumSymbolsCallback, UserContext);
+}
+
+
+BOOL WINAPI
+MgwSymEnumSymbolsW(HANDLE hProcess,
+                   ULONG64 BaseOfDll,
+                   PCWSTR Mask,
+                   PSYM_ENUMERATESYMBOLS_CALLBACKW EnumSymbolsCallback,
+                   PVOID UserContext)
+{
+    std::string MaskA;
+    std::vector<struct mgwhelp_name_match> matches;
+    std::vector<DWORD64> dbghelp_modules;
+    std::vector<struct mgwhelp_module *> modules;
+    if ((BaseOfDll || (Mask && wcschr(Mask, L'!'))) &&
+        (!Mask || mgwhelp_wide_to_utf8(Mask, MaskA)) &&
+        mgwhelp_match_names(hProcess, BaseOfDll, Mask ? MaskA.c_str() : NULL, &matches,
+                            &dbghelp_modules, &modules)) {
+        mgwhelp_enum_matches<SYMBOL_INFOW>(hProcess, Mask, matches, dbghelp_modules,
+                                           EnumSymbolsCallback, UserContext);
+        mgwhelp_modules_unref(modules);
+        return TRUE;
+    }
+
+    return mgwhelp_enum_symbols_fallback<SYMBOL_INFOW>(hProcess, BaseOfDll, Mask,
+                                                       EnumSymbolsCallback, UserContext);
+}
+
+
+// Extensions
+
+
+static void
+mgwhelp_set_line(PMGW_LINEW64 Line, const struct result_cache_entry *result)
+{
+    wcsncpy(Line->FileName, result->FileName, _countof(Line->FileName));
+    Line->FileName[_countof(Line->FileName) - 1] = L'\0';
+    Line->LineNumber = result->LineNumber;
+    Line->ColumnNumber = result->ColumnNumber;
+}
+
+static void
+mgwhelp_set_line(PMGW_LINE64 Line, const struct result_cache_entry *result)
+{
+    strncpy(Line->FileName, result->FileNameA, _countof(Line->FileName));
+    Line->FileName[_countof(Line->FileName) - 1] = '\0';
+    Line->LineNumber = result->LineNumber;
+    Line->ColumnNumber = result->ColumnNumber;
+}
+
+
+static BOOL
+mgwhelp_dbghelp_get_line(HANDLE hProcess, DWORD64 Address, PMGW_LINEW64 Line)
+{
+    IMAGEHLP_LINEW64 LineW;
+    DWORD dwDisplacement = 0;
+    ZeroMemory(&LineW, sizeof LineW);
+    LineW.SizeOfStruct = sizeof LineW;
+    if (!SymGetLineFromAddrW64(hProcess, Address, &dwDisplacement, &LineW)) {
+        return FALSE;
+    }
+    wcsncpy(Line->FileName, LineW.FileName, _countof(Line->FileName));
+    Line->FileName[_countof(Line->FileName) - 1] = L'\0';
+    Line->LineNumber = LineW.LineNumber;
+    return TRUE;
+}
+
+static BOOL
+mgwhelp_dbghelp_get_line(HANDLE hProcess, DWORD64 Address, PMGW_LINE64 Line)
+{
+    MGW_LINEW64 LineW;
+    ZeroMemory(&LineW, sizeof LineW);
+    if (!mgwhelp_dbghelp_get_line(hProcess, Address, &LineW)) {
+        return FALSE;
+    }
+    if (!WideCharToMultiByte(CP_UTF8, 0, LineW.FileName, -1, Line->FileName,
+                             _countof(Line->FileName), nullptr, nullptr)) {
+        Line->FileName[0] = '\0';
+    }
+    Line->LineNumber = LineW.LineNumber;
+    return TRUE;
+}
+
+
+/*
+ * Symbol and line lookup for modules without DWARF debugging information.
+ */
+template <typename SymbolInfo, typename MgwLine>
+static BOOL
+mgwhelp_sym_line_from_addr_fallback(HANDLE hProcess,
+                                    struct mgwhelp_module *module,
+                                    DWORD64 Offset,
+                                    DWORD64 Address,
+                                    PDWORD64 Displacement,
+                                    SymbolInfo *Symbol,
+                                    MgwLine *Line)
+{
+    if (!mgwhelp_sym_from_addr_fallback(hProcess, module, Offset, Address, Displacement,
+                                        Symbol)) {
+        return FALSE;
+    }
+
+    // Only DbgHelp can find lines without DWARF, whichever way the symbol
+    // was found
+    if (Line) {
+        LONG64 start = mgwhelp_stats_clock();
+        AcquireSRWLockExclusive(&dbghelp_lock);
+        BOOL bRet = mgwhelp_dbghelp_get_line(hProcess, Address, Line);
+        ReleaseSRWLockExclusive(&dbghelp_lock);
+        mgwhelp_count_dbghelp_lookup(module, bRet, start);
+    }
+
+    return TRUE;
+}
+
+
+template <typename SymbolInfo, typename MgwLine>
+static BOOL
+mgwhelp_sym_from_addr_ex(HANDLE hProcess,
+                         DWORD64 Address,
+                         PDWORD64 Displacement,
+                         SymbolInfo *Symbol,
+                         MgwLine *Line)
+{
+    if (Line) {
+        Line->LineNumber = 0;
+        Line->ColumnNumber = 0;
+        Line->FileName[0] = 0;
+    }
+
+    DWORD64 Offset;
+    mgwhelp_module *module = mgwhelp_find_module(hProcess, Address, &Offset);
+
+    BOOL bRet;
+    struct result_cache_entry result;
+    if (module && mgwhelp_find_result(module, Address, &result) && result.Name) {
+        mgwhelp_set_symbol_result(Symbol, &result);
+        if (Displacement) {
+            *Displacement = result.Displacement;
+        }
+        if (Line && result.FileName && result.LineNumber) {
+            mgwhelp_set_line(Line, &result);
+        }
+        bRet = TRUE;
+    } else {
+        bRet = mgwhelp_sym_line_from_addr_fallback(hProcess, module, Offset, Address,
+                                                   Displacement, Symbol, Line);
+    }
+
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+/*
+ * Equivalent to SymFromAddrW followed by SymGetLineFromAddrW64, but with
+ * a single lookup of the DWARF debugging information.
+ */
+EXTERN_C BOOL WINAPI
+MgwSymFromAddrEx(HANDLE hProcess,
+                 DWORD64 Address,
+                 PDWORD64 Displacement,
+                 PSYMBOL_INFOW Symbol,
+                 PMGW_LINEW64 Line)
+{
+    return mgwhelp_sym_from_addr_ex(hProcess, Address, Displacement, Symbol, Line);
+}
+
+
+EXTERN_C BOOL WINAPI
+MgwSymFromAddrExA(HANDLE hProcess,
+                  DWORD64 Address,
+                  PDWORD64 Displacement,
+                  PSYMBOL_INFO Symbol,
+                  PMGW_LINE64 Line)
+{
+    return mgwhelp_sym_from_addr_ex(hProcess, Address, Displacement, Symbol, Line);
+}
+
+
+/*
+ * Batch version of MgwSymFromAddrEx.
+ *
+ * Addresses are grouped by module and sorted, so that each module's debugging
+ * information is swept once.  Returns the number of resolved addresses.
+ */
+EXTERN_C ULONG WINAPI
+MgwSymFromAddrs(HANDLE hProcess, ULONG Count, const DWORD64 *Addresses, PMGW_SYMBOLW64 Symbols)
+{
+    struct entry {
+        struct mgwhelp_module *module;
+        DWORD64 Address;
+        DWORD64 Offset;
+        ULONG Index;
+    };
+
+    std::vector<entry> entries(Count);
+    for (ULONG i = 0; i < Count; ++i) {
+        entries[i].Address = Addresses[i];
+        entries[i].Index = i;
+        entries[i].module = mgwhelp_find_module(hProcess, Addresses[i], &entries[i].Offset);
+
+        PMGW_SYMBOLW64 Symbol = &Symbols[i];
+        Symbol->Found = FALSE;
+        Symbol->Displacement = 0;
+        Symbol->Name[0] = L'\0';
+        Symbol->Line.SizeOfStruct = sizeof Symbol->Line;
+        Symbol->Line.LineNumber = 0;
+        Symbol->Line.ColumnNumber = 0;
+        Symbol->Line.FileName[0] = L'\0';
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const entry &a, const entry &b) {
+        if (a.module != b.module) {
+            return a.module < b.module;
+        }
+        return a.Address < b.Address;
+    });
+
+    struct {
+        SYMBOL_INFOW Symbol;
+        WCHAR Name[MGW_MAX_SYM_NAME];
+    } s;
+
+    ULONG nFound = 0;
+    size_t first = 0;
+    while (first < entries.size()) {
+        struct mgwhelp_module *module = entries[first].module;
+        size_t last = first + 1;
+        while (last < entries.size() && entries[last].module == module) {
+            ++last;
+        }
+
+        // Only addresses missing from the result cache are looked up in DWARF
+        std::vector<struct result_cache_entry> results(last - first);
+        std::vector<bool> cached(last - first);
+        std::vector<Dwarf_Addr> addrs;
+        for (size_t j = first; j < last; ++j) {
+            cached[j - first] = module && result_cache_lookup(&module->process->results,
+                                                              entries[j].Address,
+                                                              &results[j - first]);
+            if (!cached[j - first]) {
+                addrs.push_back(entries[j].Address);
+            }
+        }
+
+        std::vector<struct dwarf_symbol_line_info> infos;
+        if (module && !addrs.empty() && mgwhelp_module_acquire_dwarf(module)) {
+            infos.resize(addrs.size());
+            LONG64 start = mgwhelp_stats_clock();
+            dwarf_find_symbol_lines(&module->dwarf, module->image_base_vma,
+                                    module->LoadedImageName, module->Base, addrs.data(),
+                                    addrs.size(), infos.data());
+            mgwhelp_module_release_dwarf(module);
+            size_t nHits = std::count_if(infos.begin(), infos.end(),
+                                         [](const dwarf_symbol_line_info &info) {
+                                             return info.found;
+                                         });
+            mgwhelp_count_dwarf_lookups(module, infos.size(), nHits, start);
+        }
+
+        size_t k = 0;
+        for (size_t j = first; j < last; ++j) {
+            PMGW_SYMBOLW64 Symbol = &Symbols[entries[j].Index];
+
+            memset(&s.Symbol, 0, sizeof s.Symbol);
+            s.Symbol.SizeOfStruct = sizeof s.Symbol;
+            s.Symbol.MaxNameLen = _countof(s.Symbol.Name) + _countof(s.Name);
+
+            struct result_cache_entry *result = &results[j - first];
+            bool bResult = cached[j - first];
+            if (!bResult && !infos.empty()) {
+                const struct dwarf_symbol_line_info *info = &infos[k++];
+                mgwhelp_cache_result(module, entries[j].Address,
+                                     info->found ? &info->symbol : NULL, &info->line, result);
+                bResult = true;
+            }
+
+            if (bResult && result->Name) {
+                mgwhelp_set_symbol_result(&s.Symbol, result);
+                Symbol->Displacement = result->Displacement;
+                if (result->FileName && result->LineNumber) {
+                    mgwhelp_set_line(&Symbol->Line, result);
+                }
+            } else if (!mgwhelp_sym_line_from_addr_fallback(
+                           hProcess, module, entries[j].Offset, entries[j].Address,
+                           &Symbol->Displacement, &s.Symbol, &Symbol->Line)) {
+                continue;
+            }
+
+            wcsncpy(Symbol->Name, s.Symbol.Name, _countof(Symbol->Name));
+            Symbol->Name[_countof(Symbol->Name) - 1] = L'\0';
+            Symbol->Found = TRUE;
+            ++nFound;
+        }
+
+        first = last;
+    }
+
+    for (const entry &e : entries) {
+        mgwhelp_module_unref(e.module);
+    }
+
+    return nFound;
+}
+
+
+/*
+ * Get the lookup counters of a module, or the global ones when BaseOfDll is
+ * zero.
+ */
+EXTERN_C BOOL WINAPI
+MgwSymGetStats(HANDLE hProcess, DWORD64 BaseOfDll, PMGW_STATS Stats)
+{
+    if (!Stats || Stats->SizeOfStruct < sizeof(DWORD)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if (!BaseOfDll) {
+        mgwhelp_stats_get_global(Stats);
+        return TRUE;
+    }
+
+    struct mgwhelp_module *module = NULL;
+    AcquireSRWLockShared(&processes_lock);
+    struct mgwhelp_process *process = mgwhelp_process_lookup(hProcess);
+    if (process) {
+        auto it = process->modules.find(BaseOfDll);
+        if (it != process->modules.end()) {
+            module = it->second;
+            mgwhelp_stats_get(&module->stats, Stats);
+        }
+    }
+    ReleaseSRWLockShared(&processes_lock);
+
+    if (!module) {
+        SetLastError(ERROR_MOD_NOT_FOUND);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Load the DWARF debugging information of a module ahead of the first
+ * lookup, typically from a background thread, so that lookups don't have to
+ * wait for it.  Returns whether the module has DWARF debugging information.
+ */
+EXTERN_C BOOL WINAPI
+MgwSymPrewarmModule(HANDLE hProcess, DWORD64 BaseOfDll)
+{
+    struct mgwhelp_module *module = mgwhelp_module_lookup(hProcess, 0, NULL, BaseOfDll, false);
+    BOOL bRet = module && mgwhelp_module_acquire_dwarf(module);
+    if (bRet) {
+        mgwhelp_module_release_dwarf(module);
+    }
+
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+// Stack unwinding
+
+
+/*
+ * Get the call frame information of a module, indexing it on first use.
+ */
+static const struct dwarf_frame_table *
+mgwhelp_module_frames(struct mgwhelp_module *module)
+{
+    if (!InterlockedCompareExchange(&module->frames_indexed, FALSE, FALSE)) {
+        struct dwarf_frame_table *frames = dwarf_frame_table_create(module->image);
+        // Another thread may have indexed it meanwhile
+        if (InterlockedCompareExchangePointer((PVOID volatile *)&module->frames, frames, NULL)) {
+            dwarf_frame_table_destroy(frames);
+        }
+        InterlockedExchange(&module->frames_indexed, TRUE);
+    }
+
+    return module->frames;
+}
+
+
+/*
+ * Get the x64 function table of a module, indexing it on first use.
+ */
+static const struct pe_function_table *
+mgwhelp_module_functions(struct mgwhelp_module *module)
+{
+    if (!InterlockedCompareExchange(&module->functions_indexed, FALSE, FALSE)) {
+        struct pe_function_table *functions = pe_function_table_create(module->image);
+        // Another thread may have indexed it meanwhile
+        if (InterlockedCompareExchangePointer((PVOID volatile *)&module->functions, functions,
+                                              NULL)) {
+            pe_function_table_destroy(functions);
+        }
+        InterlockedExchange(&module->functions_indexed, TRUE);
+    }
+
+    return module->functions;
+}
+
+
+struct mgwhelp_memory {
+    HANDLE hProcess;
+    PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine;
+};
+
+
+static bool
+mgwhelp_read_dword(void *arg, DWORD64 Address, DWORD *pValue)
+{
+    struct mgwhelp_memory *memory = (struct mgwhelp_memory *)arg;
+
+    if (memory->ReadMemoryRoutine) {
+        DWORD cbRead = 0;
+        return memory->ReadMemoryRoutine(memory->hProcess, Address, pValue, sizeof *pValue,
+                                         &cbRead) &&
+               cbRead == sizeof *pValue;
+    }
+
+    SIZE_T cbRead = 0;
+    return ReadProcessMemory(memory->hProcess, (LPCVOID)(UINT_PTR)Address, pValue,
+                             sizeof *pValue, &cbRead) &&
+           cbRead == sizeof *pValue;
+}
+
+
+static bool
+mgwhelp_read_qword(void *arg, DWORD64 Address, DWORD64 *pValue)
+{
+    struct mgwhelp_memory *memory = (struct mgwhelp_memory *)arg;
+
+    if (memory->ReadMemoryRoutine) {
+        DWORD cbRead = 0;
+        return memory->ReadMemoryRoutine(memory->hProcess, Address, pValue, sizeof *pValue,
+                                         &cbRead) &&
+               cbRead == sizeof *pValue;
+    }
+
+    SIZE_T cbRead = 0;
+    return ReadProcessMemory(memory->hProcess, (LPCVOID)(UINT_PTR)Address, pValue,
+                             sizeof *pValue, &cbRead) &&
+           cbRead == sizeof *pValue;
+}
+
+
+/*
+ * Get the number of frames returned so far by a walk.  It is kept in the
+ * reserved fields of the frame, along with the program counter and stack
+ * pointer of the frame last returned, so that a STACKFRAME64 reused for
+ * another walk without being zeroed, which StackWalk64 allows, is recognized
+ * as a fresh walk.
+ */
+static DWORD64
+mgwhelp_stack_walk_frames(const STACKFRAME64 *StackFrame, DWORD64 PC, DWORD64 SP)
+{
+    if (StackFrame->Reserved[0] && StackFrame->Reserved[1] == PC &&
+        StackFrame->Reserved[2] == SP && StackFrame->AddrPC.Offset == PC &&
+        StackFrame->AddrStack.Offset == SP) {
+        return StackFrame->Reserved[0];
+    }
+    return 0;
+}
+
+
+static void
+mgwhelp_stack_walk_set_frames(LPSTACKFRAME64 StackFrame, DWORD64 nFrames)
+{
+    StackFrame->Reserved[0] = nFrames;
+    StackFrame->Reserved[1] = StackFrame->AddrPC.Offset;
+    StackFrame->Reserved[2] = StackFrame->AddrStack.Offset;
+}
+
+
+static void
+mgwhelp_context_to_regs(const WOW64_CONTEXT *pContext, DWORD Regs[DWARF_X86_REGS])
+{
+    Regs[DWARF_X86_EAX] = pContext->Eax;
+    Regs[DWARF_X86_ECX] = pContext->Ecx;
+    Regs[DWARF_X86_EDX] = pContext->Edx;
+    Regs[DWARF_X86_EBX] = pContext->Ebx;
+    Regs[DWARF_X86_ESP] = pContext->Esp;
+    Regs[DWARF_X86_EBP] = pContext->Ebp;
+    Regs[DWARF_X86_ESI] = pContext->Esi;
+    Regs[DWARF_X86_EDI] = pContext->Edi;
+    Regs[DWARF_X86_EIP] = pContext->Eip;
+}
+
+
+static void
+mgwhelp_regs_to_context(const DWORD Regs[DWARF_X86_REGS], WOW64_CONTEXT *pContext)
+{
+    pContext->Eax = Regs[DWARF_X86_EAX];
+    pContext->Ecx = Regs[DWARF_X86_ECX];
+    pContext->Edx = Regs[DWARF_X86_EDX];
+    pContext->Ebx = Regs[DWARF_X86_EBX];
+    pContext->Esp = Regs[DWARF_X86_ESP];
+    pContext->Ebp = Regs[DWARF_X86_EBP];
+    pContext->Esi = Regs[DWARF_X86_ESI];
+    pContext->Edi = Regs[DWARF_X86_EDI];
+    pContext->Eip = Regs[DWARF_X86_EIP];
+}
+
+
+/*
+ * Unwind a 32-bit frame with the call frame information of the module
+ * containing it, if any.
+ */
+static bool
+mgwhelp_unwind_x86(HANDLE hProcess,
+                   DWORD Regs[DWARF_X86_REGS],
+                   bool bReturnAddress,
+                   struct mgwhelp_memory *memory)
+{
+    DWORD64 Offset;
+    struct mgwhelp_module *module = mgwhelp_find_module(hProcess, Regs[DWARF_X86_EIP], &Offset);
+    if (!module) {
+        return false;
+    }
+
+    const struct dwarf_frame_table *frames = mgwhelp_module_frames(module);
+    bool bRet = frames && dwarf_frame_unwind_x86(frames, module->Base, bReturnAddress, Regs,
+                                                 mgwhelp_read_dword, memory);
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+/*
+ * Walk a 32-bit frame with StackWalk64, from scratch, as the state it keeps
+ * in STACKFRAME64 isn't valid for frames it didn't unwind itself.  The first
+ * call returns the frame of the registers, and the second its caller.
+ */
+static BOOL
+mgwhelp_stack_walk_x86(HANDLE hProcess,
+                       HANDLE hThread,
+                       const WOW64_CONTEXT *pContext,
+                       const DWORD Regs[DWARF_X86_REGS],
+                       unsigned nCalls,
+                       PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+                       PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine,
+                       PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+                       PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress,
+                       LPSTACKFRAME64 StackFrame)
+{
+    WOW64_CONTEXT Context = *pContext;
+    mgwhelp_regs_to_context(Regs, &Context);
+
+    ZeroMemory(StackFrame, sizeof *StackFrame);
+    StackFrame->AddrPC.Offset = Regs[DWARF_X86_EIP];
+    StackFrame->AddrPC.Mode = AddrModeFlat;
+    StackFrame->AddrStack.Offset = Regs[DWARF_X86_ESP];
+    StackFrame->AddrStack.Mode = AddrModeFlat;
+    StackFrame->AddrFrame.Offset = Regs[DWARF_X86_EBP];
+    StackFrame->AddrFrame.Mode = AddrModeFlat;
+
+    for (unsigned i = 0; i < nCalls; ++i) {
+        if (!StackWalk64(IMAGE_FILE_MACHINE_I386, hProcess, hThread, StackFrame, &Context,
+                         ReadMemoryRoutine, FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                         TranslateAddress)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Walk a 32-bit frame, with call frame information where available.
+ */
+static BOOL
+mgwhelp_stack_walk_cfi_x86(HANDLE hProcess,
+                           HANDLE hThread,
+                           LPSTACKFRAME64 StackFrame,
+                           PVOID ContextRecord,
+                           PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+                           PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine,
+                           PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+                           PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress)
+{
+    // x86 contexts, either native or of WOW64 processes, share the layout
+    PWOW64_CONTEXT pContext = (PWOW64_CONTEXT)ContextRecord;
+    struct mgwhelp_memory memory = {hProcess, ReadMemoryRoutine};
+    STACKFRAME64 Frame;
+
+    DWORD Regs[DWARF_X86_REGS];
+    mgwhelp_context_to_regs(pContext, Regs);
+
+    DWORD64 nFrames =
+        mgwhelp_stack_walk_frames(StackFrame, Regs[DWARF_X86_EIP], Regs[DWARF_X86_ESP]);
+
+    // Only the first frame's program counter is not a return address
+    if (nFrames && !mgwhelp_unwind_x86(hProcess, Regs, nFrames > 1, &memory)) {
+        if (!mgwhelp_stack_walk_x86(hProcess, hThread, pContext, Regs, 2, ReadMemoryRoutine,
+                                    FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                                    TranslateAddress, &Frame)) {
+            return FALSE;
+        }
+        Regs[DWARF_X86_EIP] = (DWORD)Frame.AddrPC.Offset;
+        Regs[DWARF_X86_ESP] = (DWORD)Frame.AddrStack.Offset;
+        Regs[DWARF_X86_EBP] = (DWORD)Frame.AddrFrame.Offset;
+    }
+
+    if (Regs[DWARF_X86_EIP] == 0) {
+        return FALSE;
+    }
+
+    ZeroMemory(StackFrame, sizeof *StackFrame);
+    StackFrame->AddrPC.Offset = Regs[DWARF_X86_EIP];
+    StackFrame->AddrPC.Mode = AddrModeFlat;
+    StackFrame->AddrStack.Offset = Regs[DWARF_X86_ESP];
+    StackFrame->AddrStack.Mode = AddrModeFlat;
+    StackFrame->AddrFrame.Offset = Regs[DWARF_X86_EBP];
+    StackFrame->AddrFrame.Mode = AddrModeFlat;
+    mgwhelp_stack_walk_set_frames(StackFrame, nFrames + 1);
+
+    // Peek at the caller for the return address and the parameters, which
+    // lie just above it
+    DWORD CallerRegs[DWARF_X86_REGS];
+    memcpy(CallerRegs, Regs, sizeof CallerRegs);
+    if (mgwhelp_unwind_x86(hProcess, CallerRegs, nFrames > 0, &memory)) {
+        StackFrame->AddrReturn.Offset = CallerRegs[DWARF_X86_EIP];
+        for (unsigned i = 0; i < 4; ++i) {
+            DWORD Param = 0;
+            mgwhelp_read_dword(&memory, CallerRegs[DWARF_X86_ESP] + i * sizeof(DWORD), &Param);
+            StackFrame->Params[i] = Param;
+        }
+    } else if (mgwhelp_stack_walk_x86(hProcess, hThread, pContext, Regs, 1, ReadMemoryRoutine,
+                                      FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                                      TranslateAddress, &Frame)) {
+        StackFrame->AddrReturn.Offset = Frame.AddrReturn.Offset;
+        memcpy(StackFrame->Params, Frame.Params, sizeof StackFrame->Params);
+    }
+    StackFrame->AddrReturn.Mode = AddrModeFlat;
+
+    mgwhelp_regs_to_context(Regs, pContext);
+
+    return TRUE;
+}
+
+
+#if defined(_M_X64)
+
+
+static void
+mgwhelp_context_to_regs(const CONTEXT *pContext, DWORD64 Regs[PE_X64_REGS])
+{
+    Regs[PE_X64_RAX] = pContext->Rax;
+    Regs[PE_X64_RCX] = pContext->Rcx;
+    Regs[PE_X64_RDX] = pContext->Rdx;
+    Regs[PE_X64_RBX] = pContext->Rbx;
+    Regs[PE_X64_RSP] = pContext->Rsp;
+    Regs[PE_X64_RBP] = pContext->Rbp;
+    Regs[PE_X64_RSI] = pContext->Rsi;
+    Regs[PE_X64_RDI] = pContext->Rdi;
+    Regs[PE_X64_R8] = pContext->R8;
+    Regs[PE_X64_R9] = pContext->R9;
+    Regs[PE_X64_R10] = pContext->R10;
+    Regs[PE_X64_R11] = pContext->R11;
+    Regs[PE_X64_R12] = pContext->R12;
+    Regs[PE_X64_R13] = pContext->R13;
+    Regs[PE_X64_R14] = pContext->R14;
+    Regs[PE_X64_R15] = pContext->R15;
+    Regs[PE_X64_RIP] = pContext->Rip;
+}
+
+
+static void
+mgwhelp_regs_to_context(const DWORD64 Regs[PE_X64_REGS], CONTEXT *pContext)
+{
+    pContext->Rax = Regs[PE_X64_RAX];
+    pContext->Rcx = Regs[PE_X64_RCX];
+    pContext->Rdx = Regs[PE_X64_RDX];
+    pContext->Rbx = Regs[PE_X64_RBX];
+    pContext->Rsp = Regs[PE_X64_RSP];
+    pContext->Rbp = Regs[PE_X64_RBP];
+    pContext->Rsi = Regs[PE_X64_RSI];
+    pContext->Rdi = Regs[PE_X64_RDI];
+    pContext->R8 = Regs[PE_X64_R8];
+    pContext->R9 = Regs[PE_X64_R9];
+    pContext->R10 = Regs[PE_X64_R10];
+    pContext->R11 = Regs[PE_X64_R11];
+    pContext->R12 = Regs[PE_X64_R12];
+    pContext->R13 = Regs[PE_X64_R13];
+    pContext->R14 = Regs[PE_X64_R14];
+    pContext->R15 = Regs[PE_X64_R15];
+    pContext->Rip = Regs[PE_X64_RIP];
+}
+
+
+/*
+ * Unwind a 64-bit frame with the function table of the module containing
+ * it, if any.
+ */
+static bool
+mgwhelp_unwind_x64(HANDLE hProcess,
+                   DWORD64 Regs[PE_X64_REGS],
+                   bool bReturnAddress,
+                   struct mgwhelp_memory *memory)
+{
+    DWORD64 Offset;
+    struct mgwhelp_module *module = mgwhelp_find_module(hProcess, Regs[PE_X64_RIP], &Offset);
+    if (!module) {
+        return false;
+    }
+
+    const struct pe_function_table *functions = mgwhelp_module_functions(module);
+    bool bRet = functions && pe_unwind_x64(functions, module->Base, bReturnAddress, Regs,
+                                           mgwhelp_read_qword, memory);
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+/*
+ * Walk a 64-bit frame with StackWalk64, from scratch, like
+ * mgwhelp_stack_walk_x86.
+ */
+static BOOL
+mgwhelp_stack_walk_x64(HANDLE hProcess,
+                       HANDLE hThread,
+                       const CONTEXT *pContext,
+                       const DWORD64 Regs[PE_X64_REGS],
+                       unsigned nCalls,
+                       PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+                       PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine,
+                       PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+                       PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress,
+                       LPSTACKFRAME64 StackFrame)
+{
+    CONTEXT Context = *pContext;
+    mgwhelp_regs_to_context(Regs, &Context);
+
+    ZeroMemory(StackFrame, sizeof *StackFrame);
+    StackFrame->AddrPC.Offset = Regs[PE_X64_RIP];
+    StackFrame->AddrPC.Mode = AddrModeFlat;
+    StackFrame->AddrStack.Offset = Regs[PE_X64_RSP];
+    StackFrame->AddrStack.Mode = AddrModeFlat;
+    StackFrame->AddrFrame.Offset = Regs[PE_X64_RBP];
+    StackFrame->AddrFrame.Mode = AddrModeFlat;
+
+    for (unsigned i = 0; i < nCalls; ++i) {
+        if (!StackWalk64(IMAGE_FILE_MACHINE_AMD64, hProcess, hThread, StackFrame, &Context,
+                         ReadMemoryRoutine, FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                         TranslateAddress)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Walk a 64-bit frame, with the function tables (.pdata and .xdata) mapped
+ * from the image files, rather than those registered in the process.
+ */
+static BOOL
+mgwhelp_stack_walk_pdata_x64(HANDLE hProcess,
+                             HANDLE hThread,
+                             LPSTACKFRAME64 StackFrame,
+                             PVOID ContextRecord,
+                             PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+                             PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine,
+                             PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+                             PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress)
+{
+    PCONTEXT pContext = (PCONTEXT)ContextRecord;
+    struct mgwhelp_memory memory = {hProcess, ReadMemoryRoutine};
+    STACKFRAME64 Frame;
+
+    DWORD64 Regs[PE_X64_REGS];
+    mgwhelp_context_to_regs(pContext, Regs);
+
+    DWORD64 nFrames = mgwhelp_stack_walk_frames(StackFrame, Regs[PE_X64_RIP], Regs[PE_X64_RSP]);
+
+    // Only the first frame's program counter is not a return address
+    if (nFrames && !mgwhelp_unwind_x64(hProcess, Regs, nFrames > 1, &memory)) {
+        if (!mgwhelp_stack_walk_x64(hProcess, hThread, pContext, Regs, 2, ReadMemoryRoutine,
+                                    FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                                    TranslateAddress, &Frame)) {
+            return FALSE;
+        }
+        Regs[PE_X64_RIP] = Frame.AddrPC.Offset;
+        Regs[PE_X64_RSP] = Frame.AddrStack.Offset;
+        Regs[PE_X64_RBP] = Frame.AddrFrame.Offset;
+    }
+
+    if (Regs[PE_X64_RIP] == 0) {
+        return FALSE;
+    }
+
+    ZeroMemory(StackFrame, sizeof *StackFrame);
+    StackFrame->AddrPC.Offset = Regs[PE_X64_RIP];
+    StackFrame->AddrPC.Mode = AddrModeFlat;
+    StackFrame->AddrStack.Offset = Regs[PE_X64_RSP];
+    StackFrame->AddrStack.Mode = AddrModeFlat;
+    StackFrame->AddrFrame.Offset = Regs[PE_X64_RBP];
+    StackFrame->AddrFrame.Mode = AddrModeFlat;
+    mgwhelp_stack_walk_set_frames(StackFrame, nFrames + 1);
+
+    // Peek at the caller for the return address and the parameters, whose
+    // home space lies just above it
+    DWORD64 CallerRegs[PE_X64_REGS];
+    memcpy(CallerRegs, Regs, sizeof CallerRegs);
+    if (mgwhelp_unwind_x64(hProcess, CallerRegs, nFrames > 0, &memory)) {
+        StackFrame->AddrReturn.Offset = CallerRegs[PE_X64_RIP];
+        for (unsigned i = 0; i < 4; ++i) {
+            DWORD64 Param = 0;
+            mgwhelp_read_qword(&memory, CallerRegs[PE_X64_RSP] + i * sizeof(DWORD64), &Param);
+            StackFrame->Params[i] = Param;
+        }
+    } else if (mgwhelp_stack_walk_x64(hProcess, hThread, pContext, Regs, 1, ReadMemoryRoutine,
+                                      FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                                      TranslateAddress, &Frame)) {
+        StackFrame->AddrReturn.Offset = Frame.AddrReturn.Offset;
+        memcpy(StackFrame->Params, Frame.Params, sizeof StackFrame->Params);
+    }
+    StackFrame->AddrReturn.Mode = AddrModeFlat;
+
+    mgwhelp_regs_to_context(Regs, pContext);
+
+    return TRUE;
+}
+
+
+#endif /* _M_X64 */
+
+
+/*
+ * Replacement for StackWalk64, which unwinds frames from the image files
+ * themselves: 32-bit code with DWARF call frame information (from .eh_frame
+ * or .debug_frame), as StackWalk64 can't unwind MinGW code built without
+ * frame pointers, and 64-bit code with the .pdata function table, sorted and
+ * cached per module.  Other frames, and other architectures, are left to
+ * StackWalk64.
+ *
+ * As with StackWalk64, the first call returns the frame of the context, and
+ * the following ones its callers, updating the context as it goes.  The
+ * callee-saved registers are only tracked through frames with unwind
+ * information.
+ */
+EXTERN_C BOOL WINAPI
+MgwStackWalk64(DWORD MachineType,
+               HANDLE hProcess,
+               HANDLE hThread,
+               LPSTACKFRAME64 StackFrame,
+               PVOID ContextRecord,
+               PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+               PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine,
+               PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+               PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress)
+{
+    switch (MachineType) {
+    case IMAGE_FILE_MACHINE_I386:
+        return mgwhelp_stack_walk_cfi_x86(hProcess, hThread, StackFrame, ContextRecord,
+                                          ReadMemoryRoutine, FunctionTableAccessRoutine,
+                                          GetModuleBaseRoutine, TranslateAddress);
+#if defined(_M_X64)
+    case IMAGE_FILE_MACHINE_AMD64:
+        return mgwhelp_stack_walk_pdata_x64(hProcess, hThread, StackFrame, ContextRecord,
+                                            ReadMemoryRoutine, FunctionTableAccessRoutine,
+                                            GetModuleBaseRoutine, TranslateAddress);
+#endif
+    default:
+        return StackWalk64(MachineType, hProcess, hThread, StackFrame, ContextRecord,
+                           ReadMemoryRoutine, FunctionTableAccessRoutine, GetModuleBaseRoutine,
+                           TranslateAddress);
+    }
+}
+
+
+// Inline frames
+//
+// The inline contexts of an address are numbered consecutively from 1, for
+// its innermost inlined subroutine, up to N + 1 for the function they were
+// all inlined into, whose line is then the outermost call site.
+
+
+/*
+ * Look up the inline frames of an address.  Returns the number of inlined
+ * subroutines, or zero when the module has no indexed DWARF debugging
+ * information.  The module is returned if pModule is given, to be
+ * unreferenced once done with.
+ */
+static DWORD
+mgwhelp_find_inline_frames(HANDLE hProcess,
+                           DWORD64 Address,
+                           std::vector<struct dwarf_frame_info> &frames,
+                           struct mgwhelp_module **pModule)
+{
+    DWORD64 Offset;
+    mgwhelp_module *module = mgwhelp_find_module(hProcess, Address, &Offset);
+
+    bool found = false;
+    if (module && mgwhelp_module_acquire_dwarf(module)) {
+        LONG64 start = mgwhelp_stats_clock();
+        found = dwarf_find_inline_frames(&module->dwarf, module->Base, Address, &frames);
+        mgwhelp_module_release_dwarf(module);
+        mgwhelp_count_dwarf_lookups(module, 1, found, start);
+    }
+
+    if (pModule) {
+        *pModule = module;
+    } else {
+        mgwhelp_module_unref(module);
+    }
+
+    if (!found) {
+        frames.clear();
+        return 0;
+    }
+
+    return frames.size() - 1;
+}
+
+
+static bool
+mgwhelp_is_inline_context(ULONG InlineContext)
+{
+    return InlineContext != INLINE_FRAME_CONTEXT_INIT &&
+           InlineContext != INLINE_FRAME_CONTEXT_IGNORE;
+}
+
+
+EXTERN_C DWORD WINAPI
+MgwSymAddrIncludeInlineTrace(HANDLE hProcess, DWORD64 Address)
+{
+    std::vector<struct dwarf_frame_info> frames;
+    return mgwhelp_find_inline_frames(hProcess, Address, frames, NULL);
+}
+
+
+EXTERN_C BOOL WINAPI
+MgwSymQueryInlineTrace(HANDLE hProcess,
+                       DWORD64 StartAddress,
+                       DWORD StartContext,
+                       DWORD64 StartRetAddress,
+                       DWORD64 CurAddress,
+                       LPDWORD CurContext,
+                       LPDWORD CurFrameIndex)
+{
+    if (!CurContext || !CurFrameIndex) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    std::vector<struct dwarf_frame_info> frames;
+    DWORD dwInlineFrames = mgwhelp_find_inline_frames(hProcess, CurAddress, frames, NULL);
+    if (dwInlineFrames == 0) {
+        *CurContext = INLINE_FRAME_CONTEXT_INIT;
+        *CurFrameIndex = 0;
+        return TRUE;
+    }
+
+    // Resume from the given context, if it's one of this address' own
+    if (StartAddress == CurAddress && mgwhelp_is_inline_context(StartContext) &&
+        StartContext <= dwInlineFrames + 1) {
+        *CurContext = StartContext;
+        *CurFrameIndex = StartContext - 1;
+    } else {
+        *CurContext = 1;
+        *CurFrameIndex = 0;
+    }
+    return TRUE;
+}
+
+
+static BOOL
+mgwhelp_sym_from_addr(HANDLE hProcess,
+                      DWORD64 Address,
+                      PDWORD64 Displacement,
+                      PSYMBOL_INFOW Symbol)
+{
+    return MgwSymFromAddrW(hProcess, Address, Displacement, Symbol);
+}
+
+
+static BOOL
+mgwhelp_sym_from_addr(HANDLE hProcess,
+                      DWORD64 Address,
+                      PDWORD64 Displacement,
+                      PSYMBOL_INFO Symbol)
+{
+    return MgwSymFromAddr(hProcess, Address, Displacement, Symbol);
+}
+
+
+template <typename SymbolInfo>
+static BOOL
+mgwhelp_sym_from_inline_context(HANDLE hProcess,
+                                DWORD64 Address,
+                                ULONG InlineContext,
+                                PDWORD64 Displacement,
+                                SymbolInfo *Symbol)
+{
+    if (!mgwhelp_is_inline_context(InlineContext)) {
+        return mgwhelp_sym_from_addr(hProcess, Address, Displacement, Symbol);
+    }
+
+    std::vector<struct dwarf_frame_info> frames;
+    DWORD dwInlineFrames = mgwhelp_find_inline_frames(hProcess, Address, frames, NULL);
+    if (InlineContext > dwInlineFrames + 1) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if (dwInlineFrames == 0) {
+        return mgwhelp_sym_from_addr(hProcess, Address, Displacement, Symbol);
+    }
+
+    const struct dwarf_symbol_info *info = &frames[InlineContext - 1].symbol;
+    if (info->functionname.empty()) {
+        return FALSE;
+    }
+    mgwhelp_set_symbol_name(Symbol, info->functionname.c_str());
+    if (Displacement) {
+        *Displacement = info->offset_addr;
+    }
+    return TRUE;
+}
+
+
+EXTERN_C BOOL WINAPI
+MgwSymFromInlineContextW(HANDLE hProcess,
+                         DWORD64 Address,
+                         ULONG InlineContext,
+                         PDWORD64 Displacement,
+                         PSYMBOL_INFOW Symbol)
+{
+    return mgwhelp_sym_from_inline_context(hProcess, Address, InlineContext, Displacement, Symbol);
+}
+
+
+EXTERN_C BOOL WINAPI
+MgwSymFromInlineContext(HANDLE hProcess,
+                        DWORD64 Address,
+                        ULONG InlineContext,
+                        PDWORD64 Displacement,
+                        PSYMBOL_INFO Symbol)
+{
+    return mgwhelp_sym_from_inline_context(hProcess, Address, InlineContext, Displacement, Symbol);
+}
+
+
+static BOOL
+mgwhelp_sym_get_line_from_addr(HANDLE hProcess,
+                               DWORD64 dwAddr,
+                               PDWORD pdwDisplacement,
+                               PIMAGEHLP_LINEW64 Line)
+{
+    return MgwSymGetLineFromAddrW64(hProcess, dwAddr, pdwDisplacement, Line);
+}
+
+
+static BOOL
+mgwhelp_sym_get_line_from_addr(HANDLE hProcess,
+                               DWORD64 dwAddr,
+                               PDWORD pdwDisplacement,
+                               PIMAGEHLP_LINE64 Line)
+{
+    return MgwSymGetLineFromAddr64(hProcess, dwAddr, pdwDisplacement, Line);
+}
+
+
+/*
+ * File names of inline frames are interned in the result cache, as those of
+ * SymGetLineFromAddr64.
+ */
+static void
+mgwhelp_set_inline_file_name(struct mgwhelp_module *module,
+                             PIMAGEHLP_LINEW64 Line,
+                             const std::wstring &filename)
+{
+    Line->FileName = (PWSTR)result_cache_intern_string(&module->process->results,
+                                                       filename.c_str());
+}
+
+
+static void
+mgwhelp_set_inline_file_name(struct mgwhelp_module *module,
+                             PIMAGEHLP_LINE64 Line,
+                             const std::wstring &filename)
+{
+    std::string buffer;
+    if (!mgwhelp_wide_to_utf8(filename.c_str(), buffer)) {
+        buffer.clear();
+    }
+    Line->FileName = (PSTR)result_cache_intern_string(&module->process->results, buffer.c_str());
+}
+
+
+template <typename ImagehlpLine>
+static BOOL
+mgwhelp_sym_get_line_from_inline_context(HANDLE hProcess,
+                                         DWORD64 dwAddr,
+                                         ULONG InlineContext,
+                                         PDWORD pdwDisplacement,
+                                         ImagehlpLine *Line)
+{
+    if (!mgwhelp_is_inline_context(InlineContext)) {
+        return mgwhelp_sym_get_line_from_addr(hProcess, dwAddr, pdwDisplacement, Line);
+    }
+
+    std::vector<struct dwarf_frame_info> frames;
+    struct mgwhelp_module *module;
+    DWORD dwInlineFrames = mgwhelp_find_inline_frames(hProcess, dwAddr, frames, &module);
+    BOOL bRet = FALSE;
+    if (InlineContext > dwInlineFrames + 1) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+    } else if (dwInlineFrames == 0) {
+        bRet = mgwhelp_sym_get_line_from_addr(hProcess, dwAddr, pdwDisplacement, Line);
+    } else {
+        const struct dwarf_line_info *info = &frames[InlineContext - 1].line;
+        if (!info->filename.empty() && info->line) {
+            mgwhelp_set_inline_file_name(module, Line, info->filename);
+            Line->LineNumber = info->line;
+            if (pdwDisplacement) {
+                *pdwDisplacement = info->offset_addr;
+            }
+            bRet = TRUE;
+        }
+    }
+
+    mgwhelp_module_unref(module);
+    return bRet;
+}
+
+
+EXTERN_C BOOL WINAPI
+MgwSymGetLineFromInlineContextW(HANDLE hProcess,
+                                DWORD64 dwAddr,
+                                ULONG InlineContext,
+                                DWORD64 qwModuleBaseAddress,
+                                PDWORD pdwDisplacement,
+                                PIMAGEHLP_LINEW64 Line)
+{
+    return mgwhelp_sym_get_line_from_inline_context(hProcess, dwAddr, InlineContext,
+                                                    pdwDisplacement, Line);
+}
+
+
+EXTERN_C BOOL WINAPI
+MgwSymGetLineFromInlineContext(HANDLE hProcess,
+                               DWORD64 qwAddr,
+                               ULONG InlineContext,
+                               DWORD64 qwModuleBaseAddress,
+                               PDWORD pdwDisplacement,
+                               PIMAGEHLP_LINE64 Line64)
+{
+    return mgwhelp_sym_get_line_from_inline_context(hProcess, qwAddr, InlineContext,
+                                                    pdwDisplacement, Line64);
 }
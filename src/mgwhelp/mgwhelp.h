@@ -50,6 +50,9 @@ MgwSymLoadModuleExW(HANDLE hProcess,
                     PMODLOAD_DATA Data,
                     DWORD Flags);
 
+EXTERN_C BOOL WINAPI
+MgwSymUnloadModule64(HANDLE hProcess, DWORD64 BaseOfDll);
+
 EXTERN_C BOOL WINAPI
 MgwSymFromAddr(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_INFO Symbol);
 
@@ -65,6 +68,16 @@ MgwUnDecorateSymbolName(PCSTR DecoratedName,
                         DWORD UndecoratedLength,
                         DWORD Flags);
 
+EXTERN_C BOOL WINAPI
+MgwSymFromName(HANDLE hProcess, PCSTR Name, PSYMBOL_INFO Symbol);
+
+EXTERN_C BOOL WINAPI
+MgwSymEnumSymbols(HANDLE hProcess,
+                  ULONG64 BaseOfDll,
+                  PCSTR Mask,
+                  PSYM_ENUMERATESYMBOLS_CALLBACK EnumSymbolsCallback,
+                  PVOID UserContext);
+
 EXTERN_C BOOL WINAPI
 MgwSymInitializeW(HANDLE hProcess, PCWSTR UserSearchPath, BOOL fInvadeProcess);
 
@@ -82,3 +95,186 @@ MgwUnDecorateSymbolNameW(PCWSTR DecoratedName,
                          PWSTR UnDecoratedName,
                          DWORD UndecoratedLength,
                          DWORD Flags);
+
+EXTERN_C BOOL WINAPI
+MgwSymFromNameW(HANDLE hProcess, PCWSTR Name, PSYMBOL_INFOW Symbol);
+
+EXTERN_C BOOL WINAPI
+MgwSymEnumSymbolsW(HANDLE hProcess,
+                   ULONG64 BaseOfDll,
+                   PCWSTR Mask,
+                   PSYM_ENUMERATESYMBOLS_CALLBACKW EnumSymbolsCallback,
+                   PVOID UserContext);
+
+
+/*
+ * Extensions
+ */
+
+typedef struct _MGW_LINEW64 {
+    DWORD SizeOfStruct;
+    DWORD LineNumber; // zero when there's no line information
+    DWORD ColumnNumber; // zero when unknown
+    WCHAR FileName[MAX_PATH];
+} MGW_LINEW64, *PMGW_LINEW64;
+
+EXTERN_C BOOL WINAPI
+MgwSymFromAddrEx(HANDLE hProcess,
+                 DWORD64 Address,
+                 PDWORD64 Displacement,
+                 PSYMBOL_INFOW Symbol,
+                 PMGW_LINEW64 Line);
+
+typedef struct _MGW_LINE64 {
+    DWORD SizeOfStruct;
+    DWORD LineNumber; // zero when there's no line information
+    DWORD ColumnNumber; // zero when unknown
+    CHAR FileName[MAX_PATH * 3]; // UTF-8
+} MGW_LINE64, *PMGW_LINE64;
+
+// Narrow variant of MgwSymFromAddrEx, with UTF-8 symbol and file names
+EXTERN_C BOOL WINAPI
+MgwSymFromAddrExA(HANDLE hProcess,
+                  DWORD64 Address,
+                  PDWORD64 Displacement,
+                  PSYMBOL_INFO Symbol,
+                  PMGW_LINE64 Line);
+
+#define MGW_MAX_SYM_NAME 512
+
+typedef struct _MGW_SYMBOLW64 {
+    BOOL Found; // FALSE when the address could not be resolved
+    DWORD64 Displacement;
+    WCHAR Name[MGW_MAX_SYM_NAME];
+    MGW_LINEW64 Line;
+} MGW_SYMBOLW64, *PMGW_SYMBOLW64;
+
+EXTERN_C ULONG WINAPI
+MgwSymFromAddrs(HANDLE hProcess, ULONG Count, const DWORD64 *Addresses, PMGW_SYMBOLW64 Symbols);
+
+EXTERN_C BOOL WINAPI
+MgwSymPrewarmModule(HANDLE hProcess, DWORD64 BaseOfDll);
+
+
+/*
+ * Stack unwinding
+ *
+ * Same as StackWalk64, but unwinding 32-bit frames with DWARF call frame
+ * information when available, so that code built without frame pointers is
+ * unwound correctly, and 64-bit frames with the function tables of the
+ * image files.  As with StackWalk64, the reserved fields of the frame are
+ * used to track the walk, and a frame reused for a new walk need not be
+ * zeroed beforehand.
+ */
+
+EXTERN_C BOOL WINAPI
+MgwStackWalk64(DWORD MachineType,
+               HANDLE hProcess,
+               HANDLE hThread,
+               LPSTACKFRAME64 StackFrame,
+               PVOID ContextRecord,
+               PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+               PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine,
+               PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+               PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress);
+
+
+/*
+ * Instrumentation
+ *
+ * Counters and cumulative times (in microseconds) of the work done to
+ * resolve symbols, either for a single module, or, when BaseOfDll is zero,
+ * for all modules of all processes since mgwhelp was loaded.
+ *
+ * Setting the MGWHELP_STATS environment variable dumps them with
+ * OutputDebugString on SymCleanup.
+ */
+
+typedef struct _MGW_STATS {
+    DWORD SizeOfStruct;
+    DWORD64 DwarfLoads;        // DWARF debugging information loads
+    DWORD64 DwarfEvictions;    // DWARF state discarded to stay within budget
+    DWORD64 IndexCacheHits;    // indices mapped from the on-disk cache
+    DWORD64 IndexCacheMisses;  // indices built from DWARF
+    DWORD64 CuReads;           // compilation unit line tables decoded
+    DWORD64 DwarfLookups;      // addresses looked up in DWARF
+    DWORD64 DwarfHits;         // addresses resolved from DWARF
+    DWORD64 PeLookups;         // addresses looked up in the PE symbol table and exports
+    DWORD64 PeHits;            // addresses resolved from the PE symbol table or exports
+    DWORD64 DbgHelpLookups;    // lookups delegated to DbgHelp
+    DWORD64 DbgHelpHits;       // lookups resolved by DbgHelp
+    DWORD64 Demangles;         // C++ names demangled
+    DWORD64 BytesMapped;       // size of the image files mapped
+    DWORD64 DwarfLoadTime;
+    DWORD64 CuReadTime;
+    DWORD64 DwarfLookupTime;
+    DWORD64 PeLookupTime;
+    DWORD64 DbgHelpLookupTime;
+    DWORD64 DemangleTime;
+} MGW_STATS, *PMGW_STATS;
+
+EXTERN_C BOOL WINAPI
+MgwSymGetStats(HANDLE hProcess, DWORD64 BaseOfDll, PMGW_STATS Stats);
+
+
+/*
+ * Inline frames
+ *
+ * The inline contexts of an address are numbered consecutively from 1, for
+ * the innermost inlined subroutine, up to N + 1, where N is the value
+ * returned by MgwSymAddrIncludeInlineTrace, for the function they were all
+ * inlined into.  The line of each context is the call site of the previous
+ * one.
+ *
+ * Inline frames are only reported for modules with DWARF debugging
+ * information.
+ */
+
+#ifndef INLINE_FRAME_CONTEXT_INIT
+#define INLINE_FRAME_CONTEXT_INIT 0
+#endif
+#ifndef INLINE_FRAME_CONTEXT_IGNORE
+#define INLINE_FRAME_CONTEXT_IGNORE 0xFFFFFFFF
+#endif
+
+EXTERN_C DWORD WINAPI
+MgwSymAddrIncludeInlineTrace(HANDLE hProcess, DWORD64 Address);
+
+EXTERN_C BOOL WINAPI
+MgwSymQueryInlineTrace(HANDLE hProcess,
+                       DWORD64 StartAddress,
+                       DWORD StartContext,
+                       DWORD64 StartRetAddress,
+                       DWORD64 CurAddress,
+                       LPDWORD CurContext,
+                       LPDWORD CurFrameIndex);
+
+EXTERN_C BOOL WINAPI
+MgwSymFromInlineContext(HANDLE hProcess,
+                        DWORD64 Address,
+                        ULONG InlineContext,
+                        PDWORD64 Displacement,
+                        PSYMBOL_INFO Symbol);
+
+EXTERN_C BOOL WINAPI
+MgwSymFromInlineContextW(HANDLE hProcess,
+                         DWORD64 Address,
+                         ULONG InlineContext,
+                         PDWORD64 Displacement,
+                         PSYMBOL_INFOW Symbol);
+
+EXTERN_C BOOL WINAPI
+MgwSymGetLineFromInlineContext(HANDLE hProcess,
+                               DWORD64 qwAddr,
+                               ULONG InlineContext,
+                               DWORD64 qwModuleBaseAddress,
+                               PDWORD pdwDisplacement,
+                               PIMAGEHLP_LINE64 Line64);
+
+EXTERN_C BOOL WINAPI
+MgwSymGetLineFromInlineContextW(HANDLE hProcess,
+                                DWORD64 dwAddr,
+                                ULONG InlineContext,
+                                DWORD64 qwModuleBaseAddress,
+                                PDWORD pdwDisplacement,
+                                PIMAGEHLP_LINEW64 Line);
@@ -0,0 +1,313 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "name_index.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+
+static inline char
+name_fold(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+
+/*
+ * Compare two names, ignoring the case of ASCII letters.
+ */
+static int
+name_compare(const char *a, const char *b)
+{
+    while (*a && name_fold(*a) == name_fold(*b)) {
+        ++a;
+        ++b;
+    }
+    return (unsigned char)name_fold(*a) - (unsigned char)name_fold(*b);
+}
+
+
+struct name_hash {
+    size_t operator()(std::string_view s) const
+    {
+        // FNV-1a
+        size_t hash = 2166136261U;
+        for (char c : s) {
+            hash = (hash ^ (unsigned char)name_fold(c)) * 16777619U;
+        }
+        return hash;
+    }
+};
+
+
+struct name_equal {
+    bool operator()(std::string_view a, std::string_view b) const
+    {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (name_fold(a[i]) != name_fold(b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+struct name_key {
+    DWORD Name;
+    DWORD Symbol;
+};
+
+
+struct name_index {
+    // Pool of NUL-terminated names
+    std::vector<char> strings;
+
+    // Sorted by address
+    std::vector<struct name_symbol> symbols;
+
+    // Both names of every symbol, sorted ignoring case, so that the names
+    // starting with any given prefix are contiguous
+    std::vector<struct name_key> keys;
+
+    // First key of every name, ignoring case, for exact lookups
+    std::unordered_map<std::string_view, DWORD, name_hash, name_equal> buckets;
+
+    // Only used while building the index
+    std::unordered_map<std::string, DWORD> string_map;
+};
+
+
+struct name_index *
+name_index_create(void)
+{
+    struct name_index *index = new name_index;
+    // Offset zero is the empty string
+    index->strings.push_back('\0');
+    return index;
+}
+
+
+void
+name_index_destroy(struct name_index *index)
+{
+    delete index;
+}
+
+
+static DWORD
+name_index_intern(struct name_index *index, const char *s)
+{
+    auto result = index->string_map.emplace(s, (DWORD)index->strings.size());
+    if (result.second) {
+        index->strings.insert(index->strings.end(), s, s + strlen(s) + 1);
+    }
+    return result.first->second;
+}
+
+
+void
+name_index_add(struct name_index *index,
+               DWORD Rva,
+               DWORD Size,
+               const char *name,
+               const char *undname)
+{
+    struct name_symbol symbol;
+    symbol.Rva = Rva;
+    symbol.Size = Size;
+    symbol.Name = name_index_intern(index, name);
+    symbol.UndName = undname ? name_index_intern(index, undname) : symbol.Name;
+    index->symbols.push_back(symbol);
+}
+
+
+const char *
+name_index_string(const struct name_index *index, DWORD offset)
+{
+    assert(offset < index->strings.size());
+    return &index->strings[offset];
+}
+
+
+/*
+ * Sort the symbols, merging those found in several sources (e.g., DWARF and
+ * the COFF symbol table), and build the name lookup tables.
+ */
+void
+name_index_finish(struct name_index *index)
+{
+    index->string_map = std::unordered_map<std::string, DWORD>();
+
+    // Stable, so that the symbol from the first source is kept
+    std::vector<struct name_symbol> &symbols = index->symbols;
+    std::stable_sort(symbols.begin(), symbols.end(),
+                     [](const name_symbol &a, const name_symbol &b) {
+                         return a.Rva < b.Rva || (a.Rva == b.Rva && a.Name < b.Name);
+                     });
+    size_t count = 0;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        if (count && symbols[count - 1].Rva == symbols[i].Rva &&
+            symbols[count - 1].Name == symbols[i].Name) {
+            if (!symbols[count - 1].Size) {
+                symbols[count - 1].Size = symbols[i].Size;
+            }
+            continue;
+        }
+        symbols[count++] = symbols[i];
+    }
+    symbols.resize(count);
+    symbols.shrink_to_fit();
+
+    std::vector<struct name_key> &keys = index->keys;
+    keys.reserve(count * 2);
+    for (DWORD i = 0; i < count; ++i) {
+        keys.push_back({symbols[i].Name, i});
+        if (symbols[i].UndName != symbols[i].Name) {
+            keys.push_back({symbols[i].UndName, i});
+        }
+    }
+    const char *strings = index->strings.data();
+    std::sort(keys.begin(), keys.end(), [strings](const name_key &a, const name_key &b) {
+        int cmp = name_compare(strings + a.Name, strings + b.Name);
+        return cmp < 0 || (cmp == 0 && a.Symbol < b.Symbol);
+    });
+    keys.shrink_to_fit();
+
+    index->buckets.reserve(keys.size());
+    for (DWORD i = 0; i < keys.size(); ++i) {
+        index->buckets.emplace(strings + keys[i].Name, i);
+    }
+}
+
+
+/*
+ * Find the symbol with the given name, decorated or not.  Of several symbols
+ * with the same name, the one with the lowest address is returned.
+ */
+const struct name_symbol *
+name_index_find(const struct name_index *index, const char *name, bool bCaseSensitive)
+{
+    auto it = index->buckets.find(name);
+    if (it == index->buckets.end()) {
+        return NULL;
+    }
+
+    for (size_t i = it->second; i < index->keys.size(); ++i) {
+        const struct name_key *key = &index->keys[i];
+        const char *s = name_index_string(index, key->Name);
+        if (name_compare(s, name) != 0) {
+            break;
+        }
+        if (!bCaseSensitive || strcmp(s, name) == 0) {
+            return &index->symbols[key->Symbol];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Match a name against a mask with '*' (any sequence of characters) and '?'
+ * (any single character) wildcards.
+ */
+bool
+name_glob_match(const char *mask, const char *name, bool bCaseSensitive)
+{
+    const char *star = NULL;
+    const char *resume = NULL;
+
+    while (*name) {
+        if (*mask == '*') {
+            star = mask++;
+            resume = name;
+        } else if (*mask == '?' ||
+                   (bCaseSensitive ? *mask == *name : name_fold(*mask) == name_fold(*name))) {
+            ++mask;
+            ++name;
+        } else if (star) {
+            // Let the last star absorb one more character
+            mask = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+
+    while (*mask == '*') {
+        ++mask;
+    }
+    return *mask == '\0' && *name == '\0';
+}
+
+
+/*
+ * Get the symbols with a name, decorated or not, matching the mask, sorted
+ * by address.  Only the names starting with the literal prefix of the mask
+ * are visited.
+ */
+void
+name_index_match(const struct name_index *index,
+                 const char *mask,
+                 bool bCaseSensitive,
+                 std::vector<const struct name_symbol *> *symbols)
+{
+    symbols->clear();
+
+    if (!mask || mask[0] == '\0') {
+        mask = "*";
+    }
+    size_t prefix_len = strcspn(mask, "*?");
+    std::string prefix(mask, prefix_len);
+
+    const char *strings = index->strings.data();
+    auto it = std::lower_bound(index->keys.begin(), index->keys.end(), prefix,
+                               [strings](const name_key &key, const std::string &prefix) {
+                                   return name_compare(strings + key.Name, prefix.c_str()) < 0;
+                               });
+
+    std::vector<DWORD> matches;
+    for (; it != index->keys.end(); ++it) {
+        std::string_view name(strings + it->Name);
+        if (!name_equal()(name.substr(0, prefix_len), prefix)) {
+            break;
+        }
+        if (name_glob_match(mask, name.data(), bCaseSensitive)) {
+            matches.push_back(it->Symbol);
+        }
+    }
+
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+    symbols->reserve(matches.size());
+    for (DWORD i : matches) {
+        symbols->push_back(&index->symbols[i]);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+
+struct name_symbol {
+    DWORD Rva;
+    DWORD Size;    // zero when unknown
+    DWORD Name;    // offsets into the string pool
+    DWORD UndName; // same as Name when not decorated
+};
+
+
+/*
+ * Index of the symbols of a module by name, for name to address lookups.
+ * Symbols are added while building the index, and the index is read-only
+ * once finished, so it can be searched without locking.
+ */
+struct name_index;
+
+
+struct name_index *
+name_index_create(void);
+
+void
+name_index_destroy(struct name_index *index);
+
+void
+name_index_add(struct name_index *index,
+               DWORD Rva,
+               DWORD Size,
+               const char *name,
+               const char *undname);
+
+void
+name_index_finish(struct name_index *index);
+
+const char *
+name_index_string(const struct name_index *index, DWORD offset);
+
+const struct name_symbol *
+name_index_find(const struct name_index *index, const char *name, bool bCaseSensitive);
+
+void
+name_index_match(const struct name_index *index,
+                 const char *mask,
+                 bool bCaseSensitive,
+                 std::vector<const struct name_symbol *> *symbols);
+
+bool
+name_glob_match(const char *mask, const char *name, bool bCaseSensitive);
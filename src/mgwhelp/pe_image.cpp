@@ -0,0 +1,640 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "pe_image.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "outdbg.h"
+
+
+static bool
+pe_image_contains(const struct pe_image *image, ULONGLONG offset, ULONGLONG size)
+{
+    return offset <= image->nFileSize && size <= image->nFileSize - offset;
+}
+
+
+static bool
+pe_image_parse(struct pe_image *image, const wchar_t *name)
+{
+    if (!pe_image_contains(image, 0, sizeof(IMAGE_DOS_HEADER))) {
+        OutputDebug("MGWHELP: %ls - too small\n", name);
+        return false;
+    }
+
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)image->lpFileBase;
+    if (pDosHeader->e_magic != IMAGE_DOS_SIGNATURE ||
+        !pe_image_contains(image, pDosHeader->e_lfanew,
+                           sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER))) {
+        OutputDebug("MGWHELP: %ls - not a PE image\n", name);
+        return false;
+    }
+
+    image->pNtHeaders = (PIMAGE_NT_HEADERS)(image->lpFileBase + pDosHeader->e_lfanew);
+    if (image->pNtHeaders->Signature != IMAGE_NT_SIGNATURE) {
+        OutputDebug("MGWHELP: %ls - not a PE image\n", name);
+        return false;
+    }
+
+    PIMAGE_FILE_HEADER pFileHeader = &image->pNtHeaders->FileHeader;
+    ULONGLONG OptionalHeaderOffset =
+        (ULONGLONG)pDosHeader->e_lfanew + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER);
+    if (!pe_image_contains(image, OptionalHeaderOffset, pFileHeader->SizeOfOptionalHeader)) {
+        OutputDebug("MGWHELP: %ls - optional header extends beyond image size\n", name);
+        return false;
+    }
+
+    PIMAGE_OPTIONAL_HEADER pOptionalHeader = &image->pNtHeaders->OptionalHeader;
+    switch (pOptionalHeader->Magic) {
+    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
+        if (pFileHeader->SizeOfOptionalHeader <
+            offsetof(IMAGE_OPTIONAL_HEADER32, SizeOfImage) + sizeof(DWORD)) {
+            return false;
+        }
+        image->b64Bit = FALSE;
+        image->ImageBase = ((PIMAGE_OPTIONAL_HEADER32)pOptionalHeader)->ImageBase;
+        image->SizeOfImage = ((PIMAGE_OPTIONAL_HEADER32)pOptionalHeader)->SizeOfImage;
+        break;
+    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
+        if (pFileHeader->SizeOfOptionalHeader <
+            offsetof(IMAGE_OPTIONAL_HEADER64, SizeOfImage) + sizeof(DWORD)) {
+            return false;
+        }
+        image->b64Bit = TRUE;
+        image->ImageBase = ((PIMAGE_OPTIONAL_HEADER64)pOptionalHeader)->ImageBase;
+        image->SizeOfImage = ((PIMAGE_OPTIONAL_HEADER64)pOptionalHeader)->SizeOfImage;
+        break;
+    default:
+        OutputDebug("MGWHELP: %ls - unexpected optional header magic 0x%04x\n", name,
+                    pOptionalHeader->Magic);
+        return false;
+    }
+
+    ULONGLONG SectionsOffset = OptionalHeaderOffset + pFileHeader->SizeOfOptionalHeader;
+    if (!pe_image_contains(image, SectionsOffset,
+                           (ULONGLONG)pFileHeader->NumberOfSections *
+                               sizeof(IMAGE_SECTION_HEADER))) {
+        OutputDebug("MGWHELP: %ls - section table extends beyond image size\n", name);
+        return false;
+    }
+    image->Sections = (PIMAGE_SECTION_HEADER)(image->lpFileBase + SectionsOffset);
+    image->NumberOfSections = pFileHeader->NumberOfSections;
+
+    // COFF symbol table, followed by the string table
+    if (pFileHeader->PointerToSymbolTable) {
+        ULONGLONG SymbolTableSize = (ULONGLONG)pFileHeader->NumberOfSymbols * IMAGE_SIZEOF_SYMBOL;
+        ULONGLONG StringTableOffset = pFileHeader->PointerToSymbolTable + SymbolTableSize;
+        if (!pe_image_contains(image, pFileHeader->PointerToSymbolTable, SymbolTableSize) ||
+            !pe_image_contains(image, StringTableOffset, sizeof(DWORD))) {
+            OutputDebug("MGWHELP: %ls - symbol table extends beyond image size\n", name);
+        } else {
+            DWORD nStringTableSize =
+                *(const DWORD UNALIGNED *)(image->lpFileBase + StringTableOffset);
+            if (!pe_image_contains(image, StringTableOffset, nStringTableSize)) {
+                OutputDebug("MGWHELP: %ls - string table extends beyond image size\n", name);
+            } else {
+                image->pSymbolTable =
+                    (PIMAGE_SYMBOL)(image->lpFileBase + pFileHeader->PointerToSymbolTable);
+                image->NumberOfSymbols = pFileHeader->NumberOfSymbols;
+                image->pStringTable = (PCSTR)(image->lpFileBase + StringTableOffset);
+                image->nStringTableSize = nStringTableSize;
+            }
+        }
+    }
+
+    // Resolve section names, as long names (e.g., .debug_info) are stored in
+    // the string table
+    image->SectionNames.resize(image->NumberOfSections);
+    for (WORD i = 0; i < image->NumberOfSections; ++i) {
+        PIMAGE_SECTION_HEADER pSection = &image->Sections[i];
+        const char *ShortName = (const char *)pSection->Name;
+        std::string &SectionName = image->SectionNames[i];
+        if (ShortName[0] == '/') {
+            const char *LongName = pe_image_string(image, atoi(&ShortName[1]));
+            if (LongName) {
+                SectionName = LongName;
+                continue;
+            }
+        }
+        SectionName.assign(ShortName, strnlen(ShortName, IMAGE_SIZEOF_SHORT_NAME));
+    }
+
+    return true;
+}
+
+
+struct pe_image *
+pe_image_create(HANDLE hFile, const wchar_t *name)
+{
+    struct pe_image *image;
+    DWORD dwFileSizeHi;
+    DWORD dwFileSizeLo;
+
+    image = new pe_image();
+    image->refcount = 1;
+    InitializeSRWLock(&image->SymbolsLock);
+
+    image->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!image->hFileMapping) {
+        goto no_file_mapping;
+    }
+
+    image->lpFileBase = (PBYTE)MapViewOfFile(image->hFileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!image->lpFileBase) {
+        goto no_view_of_file;
+    }
+
+    dwFileSizeHi = 0;
+    dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
+    image->nFileSize = dwFileSizeLo;
+#ifdef _WIN64
+    image->nFileSize |= (SIZE_T)dwFileSizeHi << 32;
+#else
+    assert(dwFileSizeHi == 0);
+#endif
+
+    if (!pe_image_parse(image, name)) {
+        goto no_parse;
+    }
+
+    return image;
+
+no_parse:
+    UnmapViewOfFile(image->lpFileBase);
+no_view_of_file:
+    CloseHandle(image->hFileMapping);
+no_file_mapping:
+    delete image;
+    return NULL;
+}
+
+
+struct pe_image *
+pe_image_ref(struct pe_image *image)
+{
+    InterlockedIncrement(&image->refcount);
+    return image;
+}
+
+
+void
+pe_image_unref(struct pe_image *image)
+{
+    if (!image || InterlockedDecrement(&image->refcount) != 0) {
+        return;
+    }
+
+    UnmapViewOfFile(image->lpFileBase);
+    CloseHandle(image->hFileMapping);
+    delete image;
+}
+
+
+PIMAGE_SECTION_HEADER
+pe_image_find_section(const struct pe_image *image, const char *name)
+{
+    for (WORD i = 0; i < image->NumberOfSections; ++i) {
+        if (image->SectionNames[i] == name) {
+            return &image->Sections[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Get the raw data of a section, clipped to the file size.
+ */
+const BYTE *
+pe_image_section_data(const struct pe_image *image, PIMAGE_SECTION_HEADER pSection, DWORD *pSize)
+{
+    DWORD Size = pSection->SizeOfRawData;
+    if (pSection->Misc.VirtualSize && pSection->Misc.VirtualSize < Size) {
+        Size = pSection->Misc.VirtualSize;
+    }
+
+    if (pSection->PointerToRawData > image->nFileSize) {
+        *pSize = 0;
+        return NULL;
+    }
+    if (Size > image->nFileSize - pSection->PointerToRawData) {
+        Size = image->nFileSize - pSection->PointerToRawData;
+    }
+
+    *pSize = Size;
+    return image->lpFileBase + pSection->PointerToRawData;
+}
+
+
+/*
+ * Get the raw data at a relative virtual address, or NULL if it is not
+ * entirely backed by a section's data in the file.
+ */
+const BYTE *
+pe_image_rva_data(const struct pe_image *image, DWORD Rva, DWORD Size)
+{
+    for (WORD i = 0; i < image->NumberOfSections; ++i) {
+        PIMAGE_SECTION_HEADER pSection = &image->Sections[i];
+        if (Rva < pSection->VirtualAddress) {
+            continue;
+        }
+        DWORD Offset = Rva - pSection->VirtualAddress;
+        DWORD SectionSize = 0;
+        const BYTE *data = pe_image_section_data(image, pSection, &SectionSize);
+        if (data && Offset < SectionSize && Size <= SectionSize - Offset) {
+            return data + Offset;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Get the data of an optional header data directory entry (e.g.,
+ * IMAGE_DIRECTORY_ENTRY_DEBUG), or NULL if absent.
+ */
+const BYTE *
+pe_image_directory_data(const struct pe_image *image, WORD Entry, DWORD *pSize)
+{
+    PIMAGE_NT_HEADERS pNtHeaders = image->pNtHeaders;
+    WORD SizeOfOptionalHeader = pNtHeaders->FileHeader.SizeOfOptionalHeader;
+    DWORD NumberOfRvaAndSizes;
+    PIMAGE_DATA_DIRECTORY pDataDirectory;
+    size_t DataDirectoryOffset;
+    if (image->b64Bit) {
+        PIMAGE_OPTIONAL_HEADER64 pOptionalHeader =
+            &((PIMAGE_NT_HEADERS64)pNtHeaders)->OptionalHeader;
+        NumberOfRvaAndSizes = pOptionalHeader->NumberOfRvaAndSizes;
+        pDataDirectory = pOptionalHeader->DataDirectory;
+        DataDirectoryOffset = offsetof(IMAGE_OPTIONAL_HEADER64, DataDirectory);
+    } else {
+        PIMAGE_OPTIONAL_HEADER32 pOptionalHeader =
+            &((PIMAGE_NT_HEADERS32)pNtHeaders)->OptionalHeader;
+        NumberOfRvaAndSizes = pOptionalHeader->NumberOfRvaAndSizes;
+        pDataDirectory = pOptionalHeader->DataDirectory;
+        DataDirectoryOffset = offsetof(IMAGE_OPTIONAL_HEADER32, DataDirectory);
+    }
+
+    *pSize = 0;
+    if (DataDirectoryOffset > SizeOfOptionalHeader ||
+        Entry >= NumberOfRvaAndSizes ||
+        Entry >= (SizeOfOptionalHeader - DataDirectoryOffset) / sizeof(IMAGE_DATA_DIRECTORY)) {
+        return NULL;
+    }
+
+    DWORD Rva = pDataDirectory[Entry].VirtualAddress;
+    DWORD Size = pDataDirectory[Entry].Size;
+    if (!Rva || !Size) {
+        return NULL;
+    }
+
+    const BYTE *data = pe_image_rva_data(image, Rva, Size);
+    if (data) {
+        *pSize = Size;
+    }
+    return data;
+}
+
+
+/*
+ * Get a NUL-terminated string from the COFF string table.
+ */
+PCSTR
+pe_image_string(const struct pe_image *image, DWORD offset)
+{
+    if (!image->pStringTable || offset < sizeof(DWORD) || offset >= image->nStringTableSize) {
+        return NULL;
+    }
+
+    PCSTR str = image->pStringTable + offset;
+    if (!memchr(str, '\0', image->nStringTableSize - offset)) {
+        return NULL;
+    }
+
+    return str;
+}
+
+
+/*
+ * Search for the symbol on PE's symbol table.
+ *
+ * Symbols for which there's no DWARF debugging information might still appear there, put by MinGW
+ * linker.
+ *
+ * - https://msdn.microsoft.com/en-gb/library/ms809762.aspx
+ *   - https://www.microsoft.com/msj/backissues86.aspx
+ * - http://go.microsoft.com/fwlink/p/?linkid=84140
+ */
+static void
+pe_image_index_symbols(struct pe_image *image)
+{
+    PIMAGE_SYMBOL pSymbolTable = image->pSymbolTable;
+    BOOL bUnderscore = !image->b64Bit;
+
+    if (!pSymbolTable) {
+        return;
+    }
+
+    // Short names aren't necessarily NUL-terminated, so they are copied into
+    // a pool, which must be sized upfront so that it never gets reallocated
+    size_t nFunctions = 0;
+    size_t nShortNames = 0;
+    for (DWORD i = 0; i < image->NumberOfSymbols; ++i) {
+        PIMAGE_SYMBOL pSymbol = &pSymbolTable[i];
+        if (ISFCN(pSymbol->Type)) {
+            ++nFunctions;
+            if (pSymbol->N.Name.Short != 0) {
+                ++nShortNames;
+            }
+        }
+        i += pSymbol->NumberOfAuxSymbols;
+    }
+    image->FunctionSymbols.reserve(nFunctions);
+    image->ShortNames.reserve(nShortNames * (IMAGE_SIZEOF_SHORT_NAME + 1));
+
+    for (DWORD i = 0; i < image->NumberOfSymbols; ++i) {
+        PIMAGE_SYMBOL pSymbol = &pSymbolTable[i];
+
+        if (ISFCN(pSymbol->Type)) {
+            DWORD64 SymbolAddr = pSymbol->Value;
+            SHORT SectionNumber = pSymbol->SectionNumber;
+            if (SectionNumber > 0 && SectionNumber <= image->NumberOfSections) {
+                PIMAGE_SECTION_HEADER pSection = image->Sections + SectionNumber - 1;
+                SymbolAddr += image->ImageBase + pSection->VirtualAddress;
+            }
+
+            PCSTR SymbolName;
+            if (pSymbol->N.Name.Short != 0) {
+                const char *ShortName = (const char *)pSymbol->N.ShortName;
+                size_t len = strnlen(ShortName, IMAGE_SIZEOF_SHORT_NAME);
+                SymbolName = image->ShortNames.data() + image->ShortNames.size();
+                image->ShortNames.insert(image->ShortNames.end(), ShortName, ShortName + len);
+                image->ShortNames.push_back('\0');
+            } else {
+                SymbolName = pe_image_string(image, pSymbol->N.Name.Long);
+            }
+
+            if (SymbolName) {
+                if (bUnderscore && SymbolName[0] == '_') {
+                    SymbolName = &SymbolName[1];
+                }
+
+                if (SymbolName[0] != '.' && SymbolName[0] != '\0') {
+                    image->FunctionSymbols.push_back({SymbolAddr, SymbolName});
+                }
+            }
+        }
+
+        i += pSymbol->NumberOfAuxSymbols;
+    }
+
+    // Stable, so that the first of several aliases is preferred
+    std::stable_sort(image->FunctionSymbols.begin(), image->FunctionSymbols.end(),
+                     [](const pe_symbol &a, const pe_symbol &b) { return a.Addr < b.Addr; });
+    image->FunctionSymbols.shrink_to_fit();
+}
+
+
+/*
+ * Get the function symbols sorted by address, indexing them on first use.
+ */
+const std::vector<pe_symbol> &
+pe_image_function_symbols(struct pe_image *image)
+{
+    if (!InterlockedCompareExchange(&image->bSymbolsIndexed, FALSE, FALSE)) {
+        AcquireSRWLockExclusive(&image->SymbolsLock);
+        if (!image->bSymbolsIndexed) {
+            pe_image_index_symbols(image);
+            InterlockedExchange(&image->bSymbolsIndexed, TRUE);
+        }
+        ReleaseSRWLockExclusive(&image->SymbolsLock);
+    }
+
+    return image->FunctionSymbols;
+}
+
+
+static BOOL
+pe_image_find_nearest(const std::vector<pe_symbol> &symbols,
+                      DWORD64 Addr,
+                      PCSTR *pName,
+                      PDWORD64 pDisplacement)
+{
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), Addr,
+                               [](DWORD64 addr, const pe_symbol &symbol) {
+                                   return addr < symbol.Addr;
+                               });
+    if (it == symbols.begin()) {
+        return FALSE;
+    }
+    --it;
+
+    // First symbol of those with the same address
+    while (it != symbols.begin() && std::prev(it)->Addr == it->Addr) {
+        --it;
+    }
+
+    *pName = it->Name;
+    if (pDisplacement) {
+        *pDisplacement = Addr - it->Addr;
+    }
+    return TRUE;
+}
+
+
+/*
+ * Find the nearest function symbol at or below the address.
+ */
+BOOL
+pe_image_find_symbol(struct pe_image *image, DWORD64 Addr, PCSTR *pName, PDWORD64 pDisplacement)
+{
+    return pe_image_find_nearest(pe_image_function_symbols(image), Addr, pName, pDisplacement);
+}
+
+
+/*
+ * Get a NUL-terminated string at a relative virtual address, or NULL if it
+ * runs past the data of its section.
+ */
+static PCSTR
+pe_image_rva_string(const struct pe_image *image, DWORD Rva)
+{
+    for (WORD i = 0; i < image->NumberOfSections; ++i) {
+        PIMAGE_SECTION_HEADER pSection = &image->Sections[i];
+        if (Rva < pSection->VirtualAddress) {
+            continue;
+        }
+        DWORD Offset = Rva - pSection->VirtualAddress;
+        DWORD SectionSize = 0;
+        const BYTE *data = pe_image_section_data(image, pSection, &SectionSize);
+        if (data && Offset < SectionSize && memchr(data + Offset, '\0', SectionSize - Offset)) {
+            return (PCSTR)(data + Offset);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Index the exports.  Exports by ordinal only are named "Ordinal<n>", and
+ * forwarders, as they refer to code in other modules, are kept apart, sorted
+ * by name.
+ */
+static void
+pe_image_index_exports(struct pe_image *image)
+{
+    DWORD Size = 0;
+    const BYTE *data = pe_image_directory_data(image, IMAGE_DIRECTORY_ENTRY_EXPORT, &Size);
+    if (!data || Size < sizeof(IMAGE_EXPORT_DIRECTORY)) {
+        return;
+    }
+
+    const IMAGE_EXPORT_DIRECTORY *pExportDirectory = (const IMAGE_EXPORT_DIRECTORY *)data;
+    DWORD NumberOfFunctions = pExportDirectory->NumberOfFunctions;
+    DWORD NumberOfNames = pExportDirectory->NumberOfNames;
+    if (NumberOfFunctions > image->SizeOfImage / sizeof(DWORD) ||
+        NumberOfNames > image->SizeOfImage / sizeof(DWORD)) {
+        OutputDebug("MGWHELP: invalid export directory\n");
+        return;
+    }
+
+    const DWORD *pFunctions = (const DWORD *)pe_image_rva_data(
+        image, pExportDirectory->AddressOfFunctions, NumberOfFunctions * sizeof(DWORD));
+    const DWORD *pNames = (const DWORD *)pe_image_rva_data(
+        image, pExportDirectory->AddressOfNames, NumberOfNames * sizeof(DWORD));
+    const WORD *pOrdinals = (const WORD *)pe_image_rva_data(
+        image, pExportDirectory->AddressOfNameOrdinals, NumberOfNames * sizeof(WORD));
+    if (!pFunctions || !pNames || !pOrdinals) {
+        OutputDebug("MGWHELP: invalid export directory\n");
+        return;
+    }
+
+    // Forwarders point to a string within the export directory
+    std::vector<PCSTR> Forwards(NumberOfFunctions);
+    for (DWORD i = 0; i < NumberOfFunctions; ++i) {
+        const BYTE *pCode = pe_image_rva_data(image, pFunctions[i], 1);
+        if (pFunctions[i] && pCode >= data && pCode < data + Size) {
+            Forwards[i] = pe_image_rva_string(image, pFunctions[i]);
+        }
+    }
+
+    std::vector<bool> bNamed(NumberOfFunctions);
+    image->ExportSymbols.reserve(NumberOfFunctions);
+    for (DWORD i = 0; i < NumberOfNames; ++i) {
+        WORD Ordinal = pOrdinals[i];
+        PCSTR Name = pe_image_rva_string(image, pNames[i]);
+        if (Ordinal >= NumberOfFunctions || !Name || Name[0] == '\0') {
+            continue;
+        }
+        bNamed[Ordinal] = true;
+
+        DWORD Rva = pFunctions[Ordinal];
+        if (Forwards[Ordinal]) {
+            image->ExportForwarders.push_back({Name, Forwards[Ordinal]});
+        } else if (Rva) {
+            image->ExportSymbols.push_back({image->ImageBase + Rva, Name});
+        }
+    }
+
+    // The pool must be sized upfront so that it never gets reallocated
+    const size_t nOrdinalNameSize = sizeof "Ordinal4294967295";
+    size_t nOrdinalNames = 0;
+    for (DWORD i = 0; i < NumberOfFunctions; ++i) {
+        if (!bNamed[i] && pFunctions[i] && !Forwards[i]) {
+            ++nOrdinalNames;
+        }
+    }
+    image->OrdinalNames.reserve(nOrdinalNames * nOrdinalNameSize);
+    for (DWORD i = 0; i < NumberOfFunctions; ++i) {
+        if (!bNamed[i] && pFunctions[i] && !Forwards[i]) {
+            char Name[nOrdinalNameSize];
+            int len = snprintf(Name, sizeof Name, "Ordinal%lu",
+                                (unsigned long)(pExportDirectory->Base + i));
+            PCSTR SymbolName = image->OrdinalNames.data() + image->OrdinalNames.size();
+            image->OrdinalNames.insert(image->OrdinalNames.end(), Name, Name + len + 1);
+            image->ExportSymbols.push_back({image->ImageBase + pFunctions[i], SymbolName});
+        }
+    }
+
+    std::stable_sort(image->ExportSymbols.begin(), image->ExportSymbols.end(),
+                     [](const pe_symbol &a, const pe_symbol &b) { return a.Addr < b.Addr; });
+    image->ExportSymbols.shrink_to_fit();
+
+    std::sort(image->ExportForwarders.begin(), image->ExportForwarders.end(),
+              [](const pe_forwarder &a, const pe_forwarder &b) {
+                  return strcmp(a.Name, b.Name) < 0;
+              });
+}
+
+
+/*
+ * Get the exports sorted by address, indexing them on first use.
+ */
+const std::vector<pe_symbol> &
+pe_image_export_symbols(struct pe_image *image)
+{
+    if (!InterlockedCompareExchange(&image->bExportsIndexed, FALSE, FALSE)) {
+        AcquireSRWLockExclusive(&image->SymbolsLock);
+        if (!image->bExportsIndexed) {
+            pe_image_index_exports(image);
+            InterlockedExchange(&image->bExportsIndexed, TRUE);
+        }
+        ReleaseSRWLockExclusive(&image->SymbolsLock);
+    }
+
+    return image->ExportSymbols;
+}
+
+
+/*
+ * Find the nearest export at or below the address.
+ */
+BOOL
+pe_image_find_export(struct pe_image *image, DWORD64 Addr, PCSTR *pName, PDWORD64 pDisplacement)
+{
+    return pe_image_find_nearest(pe_image_export_symbols(image), Addr, pName, pDisplacement);
+}
+
+
+/*
+ * Find the target of a forwarded export, as "MODULE.Name" or
+ * "MODULE.#Ordinal".
+ */
+PCSTR
+pe_image_find_forwarder(struct pe_image *image, PCSTR Name)
+{
+    pe_image_export_symbols(image);
+
+    const std::vector<pe_forwarder> &forwarders = image->ExportForwarders;
+    auto it = std::lower_bound(forwarders.begin(), forwarders.end(), Name,
+                               [](const pe_forwarder &forwarder, PCSTR name) {
+                                   return strcmp(forwarder.Name, name) < 0;
+                               });
+    if (it == forwarders.end() || strcmp(it->Name, Name) != 0) {
+        return NULL;
+    }
+    return it->Target;
+}
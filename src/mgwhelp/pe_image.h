@@ -0,0 +1,123 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+
+struct pe_symbol {
+    DWORD64 Addr;
+    PCSTR Name;
+};
+
+
+struct pe_forwarder {
+    PCSTR Name;
+    PCSTR Target;
+};
+
+
+/*
+ * Read-only view of a PE image file, shared by the PE symbol table lookups
+ * and the DWARF object access methods.
+ *
+ * Headers, sections, and COFF symbol/string tables are parsed and bounds
+ * checked once, when the image is created.
+ */
+struct pe_image {
+    LONG refcount;
+
+    HANDLE hFileMapping;
+    PBYTE lpFileBase;
+    SIZE_T nFileSize;
+
+    PIMAGE_NT_HEADERS pNtHeaders;
+    BOOL b64Bit;
+    DWORD64 ImageBase;
+    DWORD SizeOfImage;
+
+    PIMAGE_SECTION_HEADER Sections;
+    WORD NumberOfSections;
+    std::vector<std::string> SectionNames;
+
+    // COFF symbol table, or NULL if absent or invalid
+    PIMAGE_SYMBOL pSymbolTable;
+    DWORD NumberOfSymbols;
+    PCSTR pStringTable;
+    DWORD nStringTableSize;
+
+    // Function symbols sorted by address, built on first use
+    SRWLOCK SymbolsLock;
+    LONG volatile bSymbolsIndexed;
+    std::vector<pe_symbol> FunctionSymbols;
+    std::vector<char> ShortNames;
+
+    // Exports sorted by address, and forwarders sorted by name, built on
+    // first use
+    LONG volatile bExportsIndexed;
+    std::vector<pe_symbol> ExportSymbols;
+    std::vector<pe_forwarder> ExportForwarders;
+    std::vector<char> OrdinalNames;
+};
+
+
+struct pe_image *
+pe_image_create(HANDLE hFile, const wchar_t *name);
+
+struct pe_image *
+pe_image_ref(struct pe_image *image);
+
+void
+pe_image_unref(struct pe_image *image);
+
+PIMAGE_SECTION_HEADER
+pe_image_find_section(const struct pe_image *image, const char *name);
+
+const BYTE *
+pe_image_section_data(const struct pe_image *image,
+                      PIMAGE_SECTION_HEADER pSection,
+                      DWORD *pSize);
+
+const BYTE *
+pe_image_rva_data(const struct pe_image *image, DWORD Rva, DWORD Size);
+
+const BYTE *
+pe_image_directory_data(const struct pe_image *image, WORD Entry, DWORD *pSize);
+
+PCSTR
+pe_image_string(const struct pe_image *image, DWORD offset);
+
+const std::vector<pe_symbol> &
+pe_image_function_symbols(struct pe_image *image);
+
+BOOL
+pe_image_find_symbol(struct pe_image *image, DWORD64 Addr, PCSTR *pName, PDWORD64 pDisplacement);
+
+const std::vector<pe_symbol> &
+pe_image_export_symbols(struct pe_image *image);
+
+BOOL
+pe_image_find_export(struct pe_image *image, DWORD64 Addr, PCSTR *pName, PDWORD64 pDisplacement);
+
+PCSTR
+pe_image_find_forwarder(struct pe_image *image, PCSTR Name);
@@ -0,0 +1,558 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Stack unwinding with x64 function tables.
+ *
+ * RUNTIME_FUNCTION entries and their UNWIND_INFO are read straight from the
+ * mapped image, the same way RtlVirtualUnwind does from the loaded one, so
+ * that unwinding neither depends on the DbgHelp implementation, nor has to
+ * read the tables from the (possibly remote) process.
+ *
+ * See also:
+ * - https://learn.microsoft.com/en-us/cpp/build/exception-handling-x64
+ */
+
+
+#include "pe_unwind.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "pe_image.h"
+
+
+// UNWIND_INFO flags
+#define PE_UNW_FLAG_CHAININFO 0x4
+
+// Unwind operation codes
+enum {
+    PE_UWOP_PUSH_NONVOL,
+    PE_UWOP_ALLOC_LARGE,
+    PE_UWOP_ALLOC_SMALL,
+    PE_UWOP_SET_FPREG,
+    PE_UWOP_SAVE_NONVOL,
+    PE_UWOP_SAVE_NONVOL_FAR,
+    PE_UWOP_EPILOG,
+    PE_UWOP_SPARE_CODE,
+    PE_UWOP_SAVE_XMM128,
+    PE_UWOP_SAVE_XMM128_FAR,
+    PE_UWOP_PUSH_MACHFRAME,
+};
+
+// Maximum chained unwind information depth, to not loop forever on
+// corrupted tables
+#define PE_UNWIND_MAX_CHAIN 32
+
+
+/*
+ * Index the exception directory of an x64 image.
+ */
+struct pe_function_table *
+pe_function_table_create(const struct pe_image *image)
+{
+    if (!image->b64Bit ||
+        image->pNtHeaders->FileHeader.Machine != IMAGE_FILE_MACHINE_AMD64) {
+        return NULL;
+    }
+
+    DWORD nSize = 0;
+    const BYTE *pData = pe_image_directory_data(image, IMAGE_DIRECTORY_ENTRY_EXCEPTION, &nSize);
+    if (!pData) {
+        return NULL;
+    }
+
+    struct pe_function_table *table = new pe_function_table;
+    table->image = image;
+
+    DWORD nEntries = nSize / (3 * sizeof(DWORD));
+    table->Functions.reserve(nEntries);
+    for (DWORD i = 0; i < nEntries; ++i) {
+        struct pe_function function;
+        memcpy(&function, pData + i * sizeof function, sizeof function);
+        if (function.BeginRva >= function.EndRva || function.EndRva > image->SizeOfImage) {
+            continue;
+        }
+        table->Functions.push_back(function);
+    }
+
+    if (table->Functions.empty()) {
+        delete table;
+        return NULL;
+    }
+
+    // Linkers emit the table sorted, but don't rely on it
+    auto less = [](const struct pe_function &a, const struct pe_function &b) {
+        return a.BeginRva < b.BeginRva;
+    };
+    if (!std::is_sorted(table->Functions.begin(), table->Functions.end(), less)) {
+        std::sort(table->Functions.begin(), table->Functions.end(), less);
+    }
+
+    return table;
+}
+
+
+void
+pe_function_table_destroy(struct pe_function_table *table)
+{
+    delete table;
+}
+
+
+const struct pe_function *
+pe_function_table_find(const struct pe_function_table *table, DWORD Rva)
+{
+    auto it = std::upper_bound(table->Functions.begin(), table->Functions.end(), Rva,
+                               [](DWORD Value, const struct pe_function &function) {
+                                   return Value < function.BeginRva;
+                               });
+    if (it == table->Functions.begin()) {
+        return NULL;
+    }
+    --it;
+
+    if (Rva >= it->EndRva) {
+        return NULL;
+    }
+
+    return &*it;
+}
+
+
+/*
+ * Get the UNWIND_INFO at the given RVA, including its unwind codes, and the
+ * chained function entry, if any.
+ */
+static const BYTE *
+pe_unwind_info(const struct pe_image *image, DWORD UnwindRva)
+{
+    // An odd RVA refers to another function entry, sharing its unwind info
+    if (UnwindRva & 1) {
+        const BYTE *pFunction = pe_image_rva_data(image, UnwindRva & ~1U, 3 * sizeof(DWORD));
+        if (!pFunction) {
+            return NULL;
+        }
+        memcpy(&UnwindRva, pFunction + 2 * sizeof(DWORD), sizeof UnwindRva);
+    }
+
+    const BYTE *pInfo = pe_image_rva_data(image, UnwindRva, 4);
+    if (!pInfo) {
+        return NULL;
+    }
+
+    BYTE Version = pInfo[0] & 0x7;
+    BYTE Flags = pInfo[0] >> 3;
+    BYTE CountOfCodes = pInfo[2];
+    if (Version != 1 && Version != 2) {
+        return NULL;
+    }
+
+    DWORD Size = 4 + ((CountOfCodes + 1) & ~1U) * sizeof(WORD);
+    if (Flags & PE_UNW_FLAG_CHAININFO) {
+        Size += 3 * sizeof(DWORD);
+    }
+
+    return pe_image_rva_data(image, UnwindRva, Size);
+}
+
+
+/*
+ * Find the function containing the address, following chained entries, which
+ * describe parts of a function apart from its entry point (e.g., cold code),
+ * back to the primary entry of the function.
+ */
+const struct pe_function *
+pe_function_table_find_primary(const struct pe_function_table *table, DWORD Rva)
+{
+    const struct pe_function *function = pe_function_table_find(table, Rva);
+
+    for (unsigned nChain = 0; function && nChain < PE_UNWIND_MAX_CHAIN; ++nChain) {
+        const BYTE *pInfo = pe_unwind_info(table->image, function->UnwindRva);
+        if (!pInfo) {
+            break;
+        }
+
+        // An odd RVA refers to the entry sharing its unwind info
+        DWORD BeginRva;
+        BYTE Flags = pInfo[0] >> 3;
+        if (function->UnwindRva & 1) {
+            const BYTE *pFunction =
+                pe_image_rva_data(table->image, function->UnwindRva & ~1U, sizeof(DWORD));
+            if (!pFunction) {
+                break;
+            }
+            memcpy(&BeginRva, pFunction, sizeof BeginRva);
+        } else if (Flags & PE_UNW_FLAG_CHAININFO) {
+            BYTE CountOfCodes = pInfo[2];
+            memcpy(&BeginRva, pInfo + 4 + ((CountOfCodes + 1) & ~1U) * sizeof(WORD),
+                   sizeof BeginRva);
+        } else {
+            break;
+        }
+
+        const struct pe_function *primary = pe_function_table_find(table, BeginRva);
+        if (!primary || primary == function) {
+            break;
+        }
+        function = primary;
+    }
+
+    return function;
+}
+
+
+/*
+ * Number of slots taken by an unwind code.
+ */
+static unsigned
+pe_unwind_code_slots(BYTE Op, BYTE OpInfo)
+{
+    switch (Op) {
+    case PE_UWOP_ALLOC_LARGE:
+        return OpInfo ? 3 : 2;
+    case PE_UWOP_SAVE_NONVOL:
+    case PE_UWOP_SAVE_XMM128:
+    case PE_UWOP_EPILOG:
+        return 2;
+    case PE_UWOP_SAVE_NONVOL_FAR:
+    case PE_UWOP_SAVE_XMM128_FAR:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+
+static bool
+pe_unwind_return(DWORD64 Regs[PE_X64_REGS], pe_unwind_read_fn read, void *arg)
+{
+    DWORD64 ReturnAddress;
+    if (!read(arg, Regs[PE_X64_RSP], &ReturnAddress)) {
+        return false;
+    }
+    Regs[PE_X64_RIP] = ReturnAddress;
+    Regs[PE_X64_RSP] += 8;
+    return true;
+}
+
+
+static bool
+pe_unwind_pop(DWORD64 Regs[PE_X64_REGS], unsigned Register, pe_unwind_read_fn read, void *arg)
+{
+    DWORD64 Value;
+    if (!read(arg, Regs[PE_X64_RSP], &Value)) {
+        return false;
+    }
+    Regs[Register] = Value;
+    Regs[PE_X64_RSP] += 8;
+    return true;
+}
+
+
+/*
+ * Whether the code at the program counter is an epilogue, i.e., an optional
+ * stack pointer adjustment, followed by pops of nonvolatile registers, and a
+ * return or a jump out of the function.  When Regs is not NULL, the rest of
+ * the epilogue is emulated too, as unwind codes only describe prologues.
+ */
+static bool
+pe_unwind_epilog(const BYTE *pc,
+                 const BYTE *end,
+                 const struct pe_function *function,
+                 DWORD Rva,
+                 DWORD64 *Regs,
+                 pe_unwind_read_fn read,
+                 void *arg)
+{
+    const BYTE *start = pc;
+    INT32 Displacement;
+
+    if (end - pc >= 4 && (pc[0] & 0xf8) == 0x48) {
+        if (pc[0] == 0x48 && pc[1] == 0x83 && pc[2] == 0xc4) {
+            // add $imm8, %rsp
+            if (Regs) {
+                Regs[PE_X64_RSP] += (INT8)pc[3];
+            }
+            pc += 4;
+        } else if (pc[0] == 0x48 && pc[1] == 0x81 && pc[2] == 0xc4 && end - pc >= 7) {
+            // add $imm32, %rsp
+            memcpy(&Displacement, pc + 3, sizeof Displacement);
+            if (Regs) {
+                Regs[PE_X64_RSP] += Displacement;
+            }
+            pc += 7;
+        } else if (pc[1] == 0x8d) {
+            // lea disp(%reg), %rsp, without index registers
+            BYTE ModRM = pc[2];
+            if ((pc[0] & 0x06) || ((ModRM >> 3) & 7) != 4 || (ModRM & 7) == 4) {
+                return false;
+            }
+            unsigned Base = (ModRM & 7) + (pc[0] & 1) * 8;
+            if ((ModRM >> 6) == 1) {
+                Displacement = (INT8)pc[3];
+                pc += 4;
+            } else if ((ModRM >> 6) == 2 && end - pc >= 7) {
+                memcpy(&Displacement, pc + 3, sizeof Displacement);
+                pc += 7;
+            } else {
+                return false;
+            }
+            if (Regs) {
+                Regs[PE_X64_RSP] = Regs[Base] + Displacement;
+            }
+        }
+    }
+
+    while (pc < end) {
+        BYTE Rex = 0;
+        if ((*pc & 0xf0) == 0x40) {
+            Rex = *pc++;
+            if (pc >= end) {
+                return false;
+            }
+        }
+
+        BYTE Opcode = *pc;
+        if (Opcode >= 0x58 && Opcode <= 0x5f) {
+            // pop %reg
+            if (Regs && !pe_unwind_pop(Regs, (Opcode - 0x58) + (Rex & 1) * 8, read, arg)) {
+                return false;
+            }
+            ++pc;
+            continue;
+        }
+
+        DWORD Target;
+        switch (Opcode) {
+        case 0xc3:
+            // ret
+            break;
+        case 0xc2:
+            // ret $imm16
+            if (end - pc < 3) {
+                return false;
+            }
+            break;
+        case 0xf3:
+            // rep ret
+            if (end - pc < 2 || pc[1] != 0xc3) {
+                return false;
+            }
+            break;
+        case 0xe9:
+        case 0xeb:
+            // Tail calls jump out of the function, other jumps are not
+            // epilogues
+            if (Opcode == 0xe9) {
+                if (end - pc < 5) {
+                    return false;
+                }
+                memcpy(&Displacement, pc + 1, sizeof Displacement);
+                Target = (DWORD)(Rva + (pc - start) + 5 + Displacement);
+            } else {
+                if (end - pc < 2) {
+                    return false;
+                }
+                Target = (DWORD)(Rva + (pc - start) + 2 + (INT8)pc[1]);
+            }
+            if (Target >= function->BeginRva && Target < function->EndRva) {
+                return false;
+            }
+            break;
+        case 0xff:
+            // jmp *disp32(%rip)
+            if (end - pc < 2 || pc[1] != 0x25) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+
+        if (Regs) {
+            // Tail calls return straight to our caller too
+            if (!pe_unwind_return(Regs, read, arg)) {
+                return false;
+            }
+            if (Opcode == 0xc2) {
+                Regs[PE_X64_RSP] += pc[1] | (pc[2] << 8);
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Unwind a frame of x64 code, replacing the registers with the caller's.
+ *
+ * Return addresses point past the call instruction, which might be the
+ * start of another function (e.g., after calls to noreturn functions), so
+ * bReturnAddress tells to look up the function entry of the preceding byte.
+ */
+bool
+pe_unwind_x64(const struct pe_function_table *table,
+              DWORD64 ModuleBase,
+              bool bReturnAddress,
+              DWORD64 Regs[PE_X64_REGS],
+              pe_unwind_read_fn read,
+              void *arg)
+{
+    const struct pe_image *image = table->image;
+
+    DWORD Rva = (DWORD)(Regs[PE_X64_RIP] - ModuleBase);
+    const struct pe_function *function =
+        pe_function_table_find(table, bReturnAddress ? Rva - 1 : Rva);
+    if (!function) {
+        // Leaf functions have no function entry, and don't touch the stack
+        return pe_unwind_return(Regs, read, arg);
+    }
+
+    const BYTE *pInfo = pe_unwind_info(image, function->UnwindRva);
+    if (!pInfo) {
+        return false;
+    }
+
+    DWORD64 CallerRegs[PE_X64_REGS];
+    memcpy(CallerRegs, Regs, sizeof CallerRegs);
+
+    // Only the innermost frame can be interrupted in an epilogue
+    DWORD Offset = Rva - function->BeginRva;
+    if (!bReturnAddress && Offset >= pInfo[1]) {
+        DWORD nCodeSize = function->EndRva - Rva;
+        const BYTE *pCode = pe_image_rva_data(image, Rva, nCodeSize);
+        if (pCode && pe_unwind_epilog(pCode, pCode + nCodeSize, function, Rva, NULL, read, arg)) {
+            if (!pe_unwind_epilog(pCode, pCode + nCodeSize, function, Rva, CallerRegs, read,
+                                  arg)) {
+                return false;
+            }
+            memcpy(Regs, CallerRegs, sizeof CallerRegs);
+            return true;
+        }
+    }
+
+    bool bChained = false;
+    bool bMachineFrame = false;
+    for (unsigned nChain = 0; nChain < PE_UNWIND_MAX_CHAIN; ++nChain) {
+        BYTE Flags = pInfo[0] >> 3;
+        BYTE CountOfCodes = pInfo[2];
+        BYTE FrameRegister = pInfo[3] & 0xf;
+        BYTE FrameOffset = pInfo[3] >> 4;
+        const BYTE *pCodes = pInfo + 4;
+
+        // Chained unwind info describes prologues that ran to completion
+        auto executed = [&](unsigned i) {
+            return bChained || pCodes[i * 2] <= Offset;
+        };
+
+        // Nonvolatile registers are saved relative to the frame pointer once
+        // established, or the stack pointer otherwise
+        DWORD64 Frame = CallerRegs[PE_X64_RSP];
+        for (unsigned i = 0; i < CountOfCodes;) {
+            BYTE Op = pCodes[i * 2 + 1] & 0xf;
+            BYTE OpInfo = pCodes[i * 2 + 1] >> 4;
+            if (Op == PE_UWOP_SET_FPREG && executed(i)) {
+                Frame = CallerRegs[FrameRegister] - FrameOffset * 16;
+            }
+            i += pe_unwind_code_slots(Op, OpInfo);
+        }
+
+        for (unsigned i = 0; i < CountOfCodes;) {
+            BYTE Op = pCodes[i * 2 + 1] & 0xf;
+            BYTE OpInfo = pCodes[i * 2 + 1] >> 4;
+            unsigned nSlots = pe_unwind_code_slots(Op, OpInfo);
+            if (i + nSlots > CountOfCodes) {
+                return false;
+            }
+
+            if (!executed(i)) {
+                i += nSlots;
+                continue;
+            }
+
+            WORD Slot1 = pCodes[i * 2 + 2] | (pCodes[i * 2 + 3] << 8);
+            DWORD Slots12 = nSlots >= 3 ? Slot1 | (pCodes[i * 2 + 4] << 16) |
+                                              ((DWORD)pCodes[i * 2 + 5] << 24)
+                                        : 0;
+            DWORD64 Value;
+            switch (Op) {
+            case PE_UWOP_PUSH_NONVOL:
+                if (!pe_unwind_pop(CallerRegs, OpInfo, read, arg)) {
+                    return false;
+                }
+                break;
+            case PE_UWOP_ALLOC_LARGE:
+                CallerRegs[PE_X64_RSP] += OpInfo ? Slots12 : Slot1 * 8;
+                break;
+            case PE_UWOP_ALLOC_SMALL:
+                CallerRegs[PE_X64_RSP] += OpInfo * 8 + 8;
+                break;
+            case PE_UWOP_SET_FPREG:
+                CallerRegs[PE_X64_RSP] = CallerRegs[FrameRegister] - FrameOffset * 16;
+                break;
+            case PE_UWOP_SAVE_NONVOL:
+            case PE_UWOP_SAVE_NONVOL_FAR:
+                if (!read(arg, Frame + (Op == PE_UWOP_SAVE_NONVOL ? Slot1 * 8 : Slots12),
+                          &Value)) {
+                    return false;
+                }
+                CallerRegs[OpInfo] = Value;
+                break;
+            case PE_UWOP_PUSH_MACHFRAME:
+                // Interrupt or exception frame, optionally with an error code
+                if (OpInfo) {
+                    CallerRegs[PE_X64_RSP] += 8;
+                }
+                if (!read(arg, CallerRegs[PE_X64_RSP], &CallerRegs[PE_X64_RIP]) ||
+                    !read(arg, CallerRegs[PE_X64_RSP] + 24, &Value)) {
+                    return false;
+                }
+                CallerRegs[PE_X64_RSP] = Value;
+                bMachineFrame = true;
+                break;
+            default:
+                // XMM registers are not tracked
+                break;
+            }
+
+            i += nSlots;
+        }
+
+        if (!(Flags & PE_UNW_FLAG_CHAININFO)) {
+            if (!bMachineFrame && !pe_unwind_return(CallerRegs, read, arg)) {
+                return false;
+            }
+            memcpy(Regs, CallerRegs, sizeof CallerRegs);
+            return true;
+        }
+
+        struct pe_function chained;
+        memcpy(&chained, pCodes + ((CountOfCodes + 1) & ~1U) * sizeof(WORD), sizeof chained);
+        pInfo = pe_unwind_info(image, chained.UnwindRva);
+        if (!pInfo) {
+            return false;
+        }
+        bChained = true;
+    }
+
+    return false;
+}
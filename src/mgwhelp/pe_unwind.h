@@ -0,0 +1,94 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+
+struct pe_image;
+
+
+struct pe_function {
+    DWORD BeginRva;
+    DWORD EndRva;
+    DWORD UnwindRva;
+};
+
+
+/*
+ * Function table of an x64 image, i.e., its exception directory (.pdata),
+ * sorted by address.
+ */
+struct pe_function_table {
+    const struct pe_image *image;
+
+    std::vector<struct pe_function> Functions;
+};
+
+
+/*
+ * Registers unwound, numbered as in x64 unwind codes.
+ */
+enum {
+    PE_X64_RAX,
+    PE_X64_RCX,
+    PE_X64_RDX,
+    PE_X64_RBX,
+    PE_X64_RSP,
+    PE_X64_RBP,
+    PE_X64_RSI,
+    PE_X64_RDI,
+    PE_X64_R8,
+    PE_X64_R9,
+    PE_X64_R10,
+    PE_X64_R11,
+    PE_X64_R12,
+    PE_X64_R13,
+    PE_X64_R14,
+    PE_X64_R15,
+    PE_X64_RIP,
+    PE_X64_REGS
+};
+
+
+typedef bool (*pe_unwind_read_fn)(void *arg, DWORD64 Address, DWORD64 *pValue);
+
+
+struct pe_function_table *
+pe_function_table_create(const struct pe_image *image);
+
+void
+pe_function_table_destroy(struct pe_function_table *table);
+
+const struct pe_function *
+pe_function_table_find(const struct pe_function_table *table, DWORD Rva);
+
+const struct pe_function *
+pe_function_table_find_primary(const struct pe_function_table *table, DWORD Rva);
+
+bool
+pe_unwind_x64(const struct pe_function_table *table,
+              DWORD64 ModuleBase,
+              bool bReturnAddress,
+              DWORD64 Regs[PE_X64_REGS],
+              pe_unwind_read_fn read,
+              void *arg);
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "result_cache.h"
+
+#include <utility>
+
+
+bool
+result_cache_lookup(struct result_cache *cache, DWORD64 Address, struct result_cache_entry *entry)
+{
+    bool found = false;
+
+    AcquireSRWLockShared(&cache->lock);
+    auto it = cache->entries.find(Address);
+    if (it != cache->entries.end()) {
+        *entry = it->second;
+        found = true;
+    }
+    ReleaseSRWLockShared(&cache->lock);
+
+    return found;
+}
+
+
+static const wchar_t *
+result_cache_intern(struct result_cache *cache, const wchar_t *s)
+{
+    if (!s) {
+        return NULL;
+    }
+    return cache->strings.wide.insert(s).first->c_str();
+}
+
+
+static const char *
+result_cache_intern(struct result_cache *cache, const char *s)
+{
+    if (!s) {
+        return NULL;
+    }
+    return cache->strings.narrow.insert(s).first->c_str();
+}
+
+
+/*
+ * Evict all entries, whenever adding Entries entries, or Strings strings of
+ * either kind, would exceed the bounds.  The strings of the evicted entries are
+ * only freed on the next eviction, as results handed out may still point to
+ * them.
+ */
+static void
+result_cache_reserve(struct result_cache *cache, size_t Entries, size_t Strings)
+{
+    if (cache->entries.size() + Entries <= RESULT_CACHE_MAX_ENTRIES &&
+        cache->strings.wide.size() + Strings <= RESULT_CACHE_MAX_STRINGS &&
+        cache->strings.narrow.size() + Strings <= RESULT_CACHE_MAX_STRINGS) {
+        return;
+    }
+
+    cache->entries.clear();
+    std::swap(cache->strings, cache->old_strings);
+    cache->strings.wide.clear();
+    cache->strings.narrow.clear();
+}
+
+
+void
+result_cache_insert(struct result_cache *cache,
+                    DWORD64 Address,
+                    const struct result_cache_entry *entry)
+{
+    AcquireSRWLockExclusive(&cache->lock);
+    result_cache_reserve(cache, 1, 3);
+    struct result_cache_entry interned = *entry;
+    interned.Name = result_cache_intern(cache, entry->Name);
+    interned.UndName = result_cache_intern(cache, entry->UndName);
+    interned.FileName = result_cache_intern(cache, entry->FileName);
+    interned.NameA = result_cache_intern(cache, entry->NameA);
+    interned.UndNameA = result_cache_intern(cache, entry->UndNameA);
+    interned.FileNameA = result_cache_intern(cache, entry->FileNameA);
+    cache->entries.emplace(Address, interned);
+    ReleaseSRWLockExclusive(&cache->lock);
+}
+
+
+/*
+ * Intern a string other than those of cached results, e.g., the call sites of
+ * inline frames, with the same lifetime as those.
+ */
+template <typename Char>
+static const Char *
+result_cache_intern_string_locked(struct result_cache *cache, const Char *s)
+{
+    AcquireSRWLockExclusive(&cache->lock);
+    result_cache_reserve(cache, 0, 1);
+    const Char *interned = result_cache_intern(cache, s);
+    ReleaseSRWLockExclusive(&cache->lock);
+    return interned;
+}
+
+
+const wchar_t *
+result_cache_intern_string(struct result_cache *cache, const wchar_t *s)
+{
+    return result_cache_intern_string_locked(cache, s);
+}
+
+
+const char *
+result_cache_intern_string(struct result_cache *cache, const char *s)
+{
+    return result_cache_intern_string_locked(cache, s);
+}
+
+
+/*
+ * Forget the results within a module's address range, as another module may
+ * later be loaded there.
+ */
+void
+result_cache_remove(struct result_cache *cache, DWORD64 Base, DWORD64 Size)
+{
+    AcquireSRWLockExclusive(&cache->lock);
+    for (auto it = cache->entries.begin(); it != cache->entries.end();) {
+        if (it->first - Base < Size) {
+            it = cache->entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ReleaseSRWLockExclusive(&cache->lock);
+}
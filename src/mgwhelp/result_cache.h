@@ -0,0 +1,92 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+
+// Bounds on the cache size.  Past either, all entries are evicted, and the
+// cache refilled.
+#define RESULT_CACHE_MAX_ENTRIES 65536
+#define RESULT_CACHE_MAX_STRINGS (3 * RESULT_CACHE_MAX_ENTRIES)
+
+
+/*
+ * Symbol and line of an address, as resolved from DWARF.  Strings are
+ * interned, and remain valid until the cache has been evicted twice, or until
+ * it is destroyed.
+ */
+struct result_cache_entry {
+    const wchar_t *Name;    // as in the debugging information
+    const wchar_t *UndName; // undecorated, or same as Name
+    DWORD Displacement;     // from the start of the symbol
+
+    const wchar_t *FileName; // NULL without line information
+    DWORD LineNumber;
+    DWORD ColumnNumber;
+    DWORD LineDisplacement; // from the start of the line
+
+    // UTF-8 versions of the above, for the narrow entry points
+    const char *NameA;
+    const char *UndNameA;
+    const char *FileNameA;
+};
+
+
+/*
+ * Results of DWARF lookups, keyed by address, so that repeated lookups, as
+ * return addresses recur across threads and dumps, cost one hash probe, and
+ * no allocations, demangling, nor transcoding.
+ */
+struct result_cache {
+    SRWLOCK lock = SRWLOCK_INIT;
+
+    std::unordered_map<DWORD64, struct result_cache_entry> entries;
+
+    // Interned strings of the current entries, and those of the entries
+    // evicted last, which are kept for a generation more, so that results
+    // can still be used without holding the lock
+    struct result_cache_strings {
+        std::unordered_set<std::wstring> wide;
+        std::unordered_set<std::string> narrow;
+    } strings, old_strings;
+};
+
+
+bool
+result_cache_lookup(struct result_cache *cache, DWORD64 Address, struct result_cache_entry *entry);
+
+void
+result_cache_insert(struct result_cache *cache,
+                    DWORD64 Address,
+                    const struct result_cache_entry *entry);
+
+const wchar_t *
+result_cache_intern_string(struct result_cache *cache, const wchar_t *s);
+
+const char *
+result_cache_intern_string(struct result_cache *cache, const char *s);
+
+void
+result_cache_remove(struct result_cache *cache, DWORD64 Base, DWORD64 Size);
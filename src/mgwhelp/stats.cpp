@@ -0,0 +1,147 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Lookup instrumentation.
+ *
+ * Every counter is kept per module and globally, and updated with atomic
+ * additions, as lookups happen concurrently.
+ */
+
+
+#include "stats.h"
+
+#include <stddef.h>
+
+#include "outdbg.h"
+
+
+static struct mgwhelp_stats mgwhelp_global_stats;
+
+
+static const char *
+mgwhelp_stat_names[MGWHELP_STAT_COUNT] = {
+    "DwarfLoads",
+    "DwarfEvictions",
+    "IndexCacheHits",
+    "IndexCacheMisses",
+    "CuReads",
+    "DwarfLookups",
+    "DwarfHits",
+    "PeLookups",
+    "PeHits",
+    "DbgHelpLookups",
+    "DbgHelpHits",
+    "Demangles",
+    "BytesMapped",
+    "DwarfLoadTime",
+    "CuReadTime",
+    "DwarfLookupTime",
+    "PeLookupTime",
+    "DbgHelpLookupTime",
+    "DemangleTime",
+};
+
+
+/*
+ * Add to a module's counter, if any, and to the global one.
+ */
+void
+mgwhelp_stats_add(struct mgwhelp_stats *stats, enum mgwhelp_stat stat, LONG64 value)
+{
+    if (stats) {
+        InterlockedExchangeAdd64(&stats->values[stat], value);
+    }
+    InterlockedExchangeAdd64(&mgwhelp_global_stats.values[stat], value);
+}
+
+
+LONG64
+mgwhelp_stats_clock(void)
+{
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+    return Counter.QuadPart;
+}
+
+
+/*
+ * Add the time elapsed since start, as returned by mgwhelp_stats_clock.
+ */
+void
+mgwhelp_stats_add_time(struct mgwhelp_stats *stats, enum mgwhelp_stat stat, LONG64 start)
+{
+    mgwhelp_stats_add(stats, stat, mgwhelp_stats_clock() - start);
+}
+
+
+void
+mgwhelp_stats_get(const struct mgwhelp_stats *stats, PMGW_STATS Stats)
+{
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+
+    DWORD SizeOfStruct = Stats->SizeOfStruct;
+    DWORD64 *pValues = (DWORD64 *)((PBYTE)Stats + offsetof(MGW_STATS, DwarfLoads));
+    for (unsigned i = 0; i < MGWHELP_STAT_COUNT; ++i) {
+        // Older callers may pass a smaller structure
+        if (offsetof(MGW_STATS, DwarfLoads) + (i + 1) * sizeof(DWORD64) > SizeOfStruct) {
+            break;
+        }
+
+        DWORD64 value = (DWORD64)stats->values[i];
+        if (i >= MGWHELP_STAT_FIRST_TIME) {
+            value = value / Frequency.QuadPart * 1000000 +
+                    value % Frequency.QuadPart * 1000000 / Frequency.QuadPart;
+        }
+        pValues[i] = value;
+    }
+}
+
+
+void
+mgwhelp_stats_get_global(PMGW_STATS Stats)
+{
+    mgwhelp_stats_get(&mgwhelp_global_stats, Stats);
+}
+
+
+/*
+ * Dump the counters with OutputDebugString, with NULL stats standing for
+ * the global ones.
+ */
+void
+mgwhelp_stats_dump(const wchar_t *name, const struct mgwhelp_stats *stats)
+{
+    if (!stats) {
+        stats = &mgwhelp_global_stats;
+    }
+
+    MGW_STATS Stats;
+    Stats.SizeOfStruct = sizeof Stats;
+    mgwhelp_stats_get(stats, &Stats);
+
+    const DWORD64 *pValues = &Stats.DwarfLoads;
+    OutputDebug("MGWHELP: %ls stats:\n", name);
+    for (unsigned i = 0; i < MGWHELP_STAT_COUNT; ++i) {
+        if (pValues[i]) {
+            OutputDebug("MGWHELP:   %-18s %llu%s\n", mgwhelp_stat_names[i],
+                        (unsigned long long)pValues[i], i >= MGWHELP_STAT_FIRST_TIME ? " us" : "");
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <windows.h>
+
+#include "mgwhelp.h"
+
+
+/*
+ * Counters, in the same order as the MGW_STATS fields.  Times are kept in
+ * performance counter ticks, and only converted when queried.
+ */
+enum mgwhelp_stat {
+    MGWHELP_STAT_DWARF_LOADS,
+    MGWHELP_STAT_DWARF_EVICTIONS,
+    MGWHELP_STAT_INDEX_CACHE_HITS,
+    MGWHELP_STAT_INDEX_CACHE_MISSES,
+    MGWHELP_STAT_CU_READS,
+    MGWHELP_STAT_DWARF_LOOKUPS,
+    MGWHELP_STAT_DWARF_HITS,
+    MGWHELP_STAT_PE_LOOKUPS,
+    MGWHELP_STAT_PE_HITS,
+    MGWHELP_STAT_DBGHELP_LOOKUPS,
+    MGWHELP_STAT_DBGHELP_HITS,
+    MGWHELP_STAT_DEMANGLES,
+    MGWHELP_STAT_BYTES_MAPPED,
+    MGWHELP_STAT_DWARF_LOAD_TIME,
+    MGWHELP_STAT_CU_READ_TIME,
+    MGWHELP_STAT_DWARF_LOOKUP_TIME,
+    MGWHELP_STAT_PE_LOOKUP_TIME,
+    MGWHELP_STAT_DBGHELP_LOOKUP_TIME,
+    MGWHELP_STAT_DEMANGLE_TIME,
+    MGWHELP_STAT_COUNT
+};
+
+#define MGWHELP_STAT_FIRST_TIME MGWHELP_STAT_DWARF_LOAD_TIME
+
+
+struct mgwhelp_stats {
+    LONG64 volatile values[MGWHELP_STAT_COUNT];
+};
+
+
+void
+mgwhelp_stats_add(struct mgwhelp_stats *stats, enum mgwhelp_stat stat, LONG64 value);
+
+LONG64
+mgwhelp_stats_clock(void);
+
+void
+mgwhelp_stats_add_time(struct mgwhelp_stats *stats, enum mgwhelp_stat stat, LONG64 start);
+
+void
+mgwhelp_stats_get(const struct mgwhelp_stats *stats, PMGW_STATS Stats);
+
+void
+mgwhelp_stats_get_global(PMGW_STATS Stats);
+
+void
+mgwhelp_stats_dump(const wchar_t *name, const struct mgwhelp_stats *stats);
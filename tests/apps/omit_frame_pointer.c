@@ -0,0 +1,63 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/*
+ * Crash in code built without frame pointers (see CMakeLists.txt), which
+ * can only be unwound with the DWARF call frame information on x86.
+ */
+
+#include <stddef.h>
+
+#include "macros.h"
+
+static int *volatile null_pointer = NULL;
+
+static NO_INLINE void
+inner(void)
+{
+    *null_pointer = 0;  LINE_BARRIER
+}
+
+static NO_INLINE void
+outer(void)
+{
+    inner();  LINE_BARRIER
+}
+
+int
+main(int argc, char *argv[])
+{
+    outer();  LINE_BARRIER
+
+    return 0;
+}
+
+// CHECK_STDERR: /  omit_frame_pointer\.exe\!inner\+0x[0-9a-f]+  \[.*\bomit_frame_pointer\.c:43\]/
+// CHECK_STDERR: /  omit_frame_pointer\.exe\!outer\+0x[0-9a-f]+  \[.*\bomit_frame_pointer\.c:49\]/
+// CHECK_STDERR: /  omit_frame_pointer\.exe\!main\+0x[0-9a-f]+  \[.*\bomit_frame_pointer\.c:55\]/
+// CHECK_EXIT_CODE: 0xc0000005
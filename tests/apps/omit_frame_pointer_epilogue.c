@@ -0,0 +1,85 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/*
+ * Crash in code built without frame pointers (see CMakeLists.txt), which
+ * can only be unwound with the DWARF call frame information on x86.
+ */
+
+#include <stddef.h>
+/*
+ * Crash past an early return in code built without frame pointers (see
+ * CMakeLists.txt).  The early return's epilogue pops the saved registers
+ * between DW_CFA_remember_state and DW_CFA_restore_state, so unwinding the
+ * crash relies on the CFA being restored along with the register rules.
+ */
+
+#include <stddef.h>
+
+#include "macros.h"
+
+#if defined(__GNUC__)
+#  define LIKELY(x) __builtin_expect(!!(x), 1)
+#else
+#  define LIKELY(x) (x)
+#endif
+
+static int *volatile null_pointer = NULL;
+static volatile int early_return = 0;
+
+static NO_INLINE int
+inner(int n)
+{
+    int a = rand();
+    int b = rand();
+    // Likely, so that the early return is laid out before the crash
+    if (LIKELY(early_return)) {
+        return a + b + n;
+    }
+    *null_pointer = a - b;  LINE_BARRIER
+    return a * b;
+}
+
+static NO_INLINE void
+outer(int n)
+{
+    inner(n);  LINE_BARRIER
+}
+
+int
+main(int argc, char *argv[])
+{
+    outer(argc);  LINE_BARRIER
+
+    return 0;
+}
+
+// CHECK_STDERR: /  omit_frame_pointer_epilogue\.exe\!inner\+0x[0-9a-f]+  \[.*\bomit_frame_pointer_epilogue\.c:64\]/
+// CHECK_STDERR: /  omit_frame_pointer_epilogue\.exe\!outer\+0x[0-9a-f]+  \[.*\bomit_frame_pointer_epilogue\.c:71\]/
+// CHECK_STDERR: /  omit_frame_pointer_epilogue\.exe\!main\+0x[0-9a-f]+  \[.*\bomit_frame_pointer_epilogue\.c:77\]/
+// CHECK_EXIT_CODE: 0xc0000005
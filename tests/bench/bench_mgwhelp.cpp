@@ -0,0 +1,305 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * mgwhelp symbolization benchmark.
+ *
+ * Times, for this executable or each of the given DLLs (as produced by
+ * generate.cmake):
+ *
+ * - cold initialization, i.e., SymInitialize;
+ * - the first lookup, which loads the module's debugging information;
+ * - steady state SymFromAddr + SymGetLineFromAddr64 throughput, over random
+ *   addresses across all functions, and over stack-like addresses, i.e.,
+ *   short sequences drawn from a small working set, as when symbolizing
+ *   many similar stack traces.
+ *
+ * Results are written to stdout, or appended to a file, as one JSON object
+ * per module.
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <windows.h>
+#include <dbghelp.h>
+
+#include <vector>
+
+#include "mgwhelp.h"
+
+
+#define BENCH_STACK_DEPTH 16
+#define BENCH_WORKING_SET 64
+
+
+extern "C" size_t
+bench_get_functions(const void *const **functions);
+
+
+typedef size_t (*PFN_BENCH_GET_FUNCTIONS)(const void *const **functions);
+
+
+static LARGE_INTEGER g_Frequency;
+static FILE *g_fpResults = stdout;
+
+
+static LONGLONG
+benchClock(void)
+{
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+    return Counter.QuadPart;
+}
+
+
+static double
+benchSeconds(LONGLONG start, LONGLONG end)
+{
+    return (double)(end - start) / (double)g_Frequency.QuadPart;
+}
+
+
+// Deterministic pseudo-random numbers, so that runs are comparable
+static unsigned
+benchRandom(unsigned *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7fff;
+}
+
+
+static bool
+benchLookup(HANDLE hProcess, DWORD64 dwAddress)
+{
+    struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[512];
+    } s;
+    s.Symbol.SizeOfStruct = sizeof s.Symbol;
+    s.Symbol.MaxNameLen = sizeof s.Symbol.Name + sizeof s.Name;
+    DWORD64 dwSymDisplacement = 0;
+    if (!SymFromAddr(hProcess, dwAddress, &dwSymDisplacement, &s.Symbol)) {
+        return false;
+    }
+
+    IMAGEHLP_LINE64 Line;
+    ZeroMemory(&Line, sizeof Line);
+    Line.SizeOfStruct = sizeof Line;
+    DWORD dwLineDisplacement = 0;
+    SymGetLineFromAddr64(hProcess, dwAddress, &dwLineDisplacement, &Line);
+
+    return true;
+}
+
+
+static double
+benchLookups(HANDLE hProcess, const std::vector<DWORD64> &addresses, size_t *pnResolved)
+{
+    size_t nResolved = 0;
+    LONGLONG start = benchClock();
+    for (DWORD64 dwAddress : addresses) {
+        nResolved += benchLookup(hProcess, dwAddress);
+    }
+    LONGLONG end = benchClock();
+
+    *pnResolved = nResolved;
+    double seconds = benchSeconds(start, end);
+    return seconds > 0 ? addresses.size() / seconds : 0;
+}
+
+
+static const char *
+benchBaseName(const char *szPath)
+{
+    const char *szBaseName = szPath;
+    for (const char *p = szPath; *p; ++p) {
+        if (*p == '\\' || *p == '/') {
+            szBaseName = p + 1;
+        }
+    }
+    return szBaseName;
+}
+
+
+static bool
+benchModule(const char *szModule, HMODULE hModule, unsigned nLookups)
+{
+    const void *const *functions = nullptr;
+    size_t nFunctions;
+    if (hModule) {
+        PFN_BENCH_GET_FUNCTIONS pfnGetFunctions =
+            (PFN_BENCH_GET_FUNCTIONS)GetProcAddress(hModule, "bench_get_functions");
+        if (!pfnGetFunctions) {
+            fprintf(stderr, "bench_mgwhelp: error: %s has no bench_get_functions\n", szModule);
+            return false;
+        }
+        nFunctions = pfnGetFunctions(&functions);
+    } else {
+        nFunctions = bench_get_functions(&functions);
+    }
+    if (!nFunctions) {
+        return false;
+    }
+
+    // Return addresses point inside functions, not at their entry points
+    std::vector<DWORD64> functionAddresses(nFunctions);
+    for (size_t i = 0; i < nFunctions; ++i) {
+        functionAddresses[i] = (DWORD64)(UINT_PTR)functions[i] + 1;
+    }
+
+    HANDLE hProcess = GetCurrentProcess();
+
+    LONGLONG start = benchClock();
+    if (!SymInitialize(hProcess, nullptr, TRUE)) {
+        fprintf(stderr, "bench_mgwhelp: error: SymInitialize failed (0x%08lx)\n",
+                GetLastError());
+        return false;
+    }
+    LONGLONG end = benchClock();
+    double coldInit = benchSeconds(start, end);
+
+    start = benchClock();
+    bool bFirstResolved = benchLookup(hProcess, functionAddresses[0]);
+    end = benchClock();
+    double firstLookup = benchSeconds(start, end);
+
+    unsigned state = 1;
+
+    std::vector<DWORD64> randomAddresses(nLookups);
+    for (auto &dwAddress : randomAddresses) {
+        size_t i = (benchRandom(&state) << 15 | benchRandom(&state)) % nFunctions;
+        dwAddress = functionAddresses[i];
+    }
+
+    std::vector<DWORD64> workingSet(BENCH_WORKING_SET);
+    for (auto &dwAddress : workingSet) {
+        size_t i = (benchRandom(&state) << 15 | benchRandom(&state)) % nFunctions;
+        dwAddress = functionAddresses[i];
+    }
+    std::vector<DWORD64> stackAddresses;
+    stackAddresses.reserve(nLookups);
+    while (stackAddresses.size() < nLookups) {
+        size_t i = benchRandom(&state) % BENCH_WORKING_SET;
+        for (unsigned depth = 0; depth < BENCH_STACK_DEPTH && stackAddresses.size() < nLookups;
+             ++depth) {
+            stackAddresses.push_back(workingSet[(i + depth) % BENCH_WORKING_SET]);
+        }
+    }
+
+    size_t nRandomResolved = 0;
+    double randomRate = benchLookups(hProcess, randomAddresses, &nRandomResolved);
+    size_t nStackResolved = 0;
+    double stackRate = benchLookups(hProcess, stackAddresses, &nStackResolved);
+
+    MGW_STATS Stats;
+    Stats.SizeOfStruct = sizeof Stats;
+    DWORD64 dwBase = (DWORD64)(UINT_PTR)(hModule ? hModule : GetModuleHandleA(nullptr));
+    if (!MgwSymGetStats(hProcess, dwBase, &Stats)) {
+        ZeroMemory(&Stats, sizeof Stats);
+    }
+
+    SymCleanup(hProcess);
+
+    fprintf(g_fpResults, "{\"module\": \"%s\", \"functions\": %u, \"lookups\": %u, "
+           "\"cold_init_us\": %.1f, \"first_lookup_us\": %.1f, \"first_resolved\": %s, "
+           "\"random_lookups_per_s\": %.0f, \"random_resolved\": %u, "
+           "\"stack_lookups_per_s\": %.0f, \"stack_resolved\": %u, "
+           "\"dwarf_hits\": %llu, \"pe_hits\": %llu, \"dbghelp_hits\": %llu, "
+           "\"dwarf_load_us\": %llu, \"cu_reads\": %llu}\n",
+           benchBaseName(szModule), (unsigned)nFunctions, nLookups,
+           coldInit * 1e6, firstLookup * 1e6, bFirstResolved ? "true" : "false",
+           randomRate, (unsigned)nRandomResolved,
+           stackRate, (unsigned)nStackResolved,
+           (unsigned long long)Stats.DwarfHits, (unsigned long long)Stats.PeHits,
+           (unsigned long long)Stats.DbgHelpHits, (unsigned long long)Stats.DwarfLoadTime,
+           (unsigned long long)Stats.CuReads);
+    fflush(g_fpResults);
+
+    return bFirstResolved;
+}
+
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: bench_mgwhelp [options] [DLL]...\n"
+            "\n"
+            "options:\n"
+            "  -n LOOKUPS   number of lookups per address set (default 100000)\n"
+            "  -c           disable the on-disk DWARF index cache\n"
+            "  -o FILE      append results to FILE instead of writing them to stdout\n");
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned nLookups = 100000;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            nLookups = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            g_fpResults = fopen(argv[++i], "at");
+            if (!g_fpResults) {
+                fprintf(stderr, "bench_mgwhelp: error: failed to open %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-c") == 0) {
+            SetEnvironmentVariableA("MGWHELP_INDEX_CACHE", "0");
+            _putenv("MGWHELP_INDEX_CACHE=0");
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    QueryPerformanceFrequency(&g_Frequency);
+
+    SymSetOptions(SymGetOptions() | SYMOPT_LOAD_LINES);
+
+    bool ok = true;
+    if (i == argc) {
+        char szModule[MAX_PATH];
+        GetModuleFileNameA(nullptr, szModule, sizeof szModule);
+        ok = benchModule(szModule, nullptr, nLookups);
+    }
+    for (; i < argc; ++i) {
+        HMODULE hModule = LoadLibraryA(argv[i]);
+        if (!hModule) {
+            fprintf(stderr, "bench_mgwhelp: error: failed to load %s (0x%08lx)\n", argv[i],
+                    GetLastError());
+            ok = false;
+            continue;
+        }
+        ok = benchModule(argv[i], hModule, nLookups) && ok;
+        FreeLibrary(hModule);
+    }
+
+    if (g_fpResults != stdout) {
+        fclose(g_fpResults);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
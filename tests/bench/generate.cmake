@@ -0,0 +1,103 @@
+#
+# Generator of synthetic sources for the mgwhelp benchmark.
+#
+# bench_generate (<output dir> <CUs> <functions per CU> <inlined calls per
+# function> <padding types per CU> <output sources variable>)
+#
+# Every CU defines non-inlined functions, each calling a number of always
+# inlined helpers, and optionally padding structure types, which only grow
+# the DWARF debugging information.  A registry CU exposes the addresses of
+# all functions through bench_get_functions().
+#
+# Files are only rewritten when their contents change, so that reconfiguring
+# doesn't rebuild everything.
+#
+
+function (bench_write_file path contents)
+    file (WRITE "${path}.tmp" "${contents}")
+    configure_file ("${path}.tmp" "${path}" COPYONLY)
+    file (REMOVE "${path}.tmp")
+endfunction ()
+
+function (bench_generate output_dir num_cus num_functions num_inlines num_padding out_sources)
+    file (MAKE_DIRECTORY "${output_dir}")
+
+    set (sources)
+    set (declarations "")
+    set (entries "")
+
+    math (EXPR last_cu "${num_cus} - 1")
+    math (EXPR last_function "${num_functions} - 1")
+    math (EXPR last_inline "${num_inlines} - 1")
+    math (EXPR last_padding "${num_padding} - 1")
+
+    foreach (cu RANGE ${last_cu})
+        set (src "// Generated by generate.cmake -- do not edit\n\n")
+
+        if (num_padding GREATER 0)
+            foreach (pad RANGE ${last_padding})
+                string (APPEND src
+                    "struct bench_pad_${cu}_${pad} {\n"
+                    "    int i${pad};\n"
+                    "    double d${pad};\n"
+                    "    const char *s${pad};\n"
+                    "    struct bench_pad_${cu}_${pad} *next;\n"
+                    "};\n"
+                    "volatile struct bench_pad_${cu}_${pad} *bench_pad_var_${cu}_${pad};\n\n"
+                )
+            endforeach ()
+        endif ()
+
+        foreach (function RANGE ${last_function})
+            set (name "bench_func_${cu}_${function}")
+
+            set (body "    int y = x;\n")
+            if (num_inlines GREATER 0)
+                foreach (inline RANGE ${last_inline})
+                    string (APPEND src
+                        "static inline __attribute__((always_inline)) int\n"
+                        "${name}_inline_${inline}(int x)\n"
+                        "{\n"
+                        "    return x * ${inline} + ${function};\n"
+                        "}\n\n"
+                    )
+                    string (APPEND body "    y += ${name}_inline_${inline}(y);\n")
+                endforeach ()
+            endif ()
+
+            string (APPEND src
+                "extern \"C\" __attribute__((noinline)) int\n"
+                "${name}(int x)\n"
+                "{\n"
+                "${body}"
+                "    return y;\n"
+                "}\n\n"
+            )
+
+            string (APPEND declarations "extern \"C\" int ${name}(int x);\n")
+            string (APPEND entries "    (const void *)&${name},\n")
+        endforeach ()
+
+        bench_write_file ("${output_dir}/bench_cu_${cu}.cpp" "${src}")
+        list (APPEND sources "${output_dir}/bench_cu_${cu}.cpp")
+    endforeach ()
+
+    string (CONCAT registry
+        "// Generated by generate.cmake -- do not edit\n\n"
+        "#include <stddef.h>\n\n"
+        "${declarations}\n"
+        "static const void *const bench_functions[] = {\n"
+        "${entries}"
+        "};\n\n"
+        "extern \"C\" __declspec(dllexport) size_t\n"
+        "bench_get_functions(const void *const **functions)\n"
+        "{\n"
+        "    *functions = bench_functions;\n"
+        "    return sizeof bench_functions / sizeof bench_functions[0];\n"
+        "}\n"
+    )
+    bench_write_file ("${output_dir}/bench_registry.cpp" "${registry}")
+    list (APPEND sources "${output_dir}/bench_registry.cpp")
+
+    set (${out_sources} ${sources} PARENT_SCOPE)
+endfunction ()
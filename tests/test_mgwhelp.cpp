@@ -27,6 +27,11 @@
 #include <dbghelp.h>
 #include <shlwapi.h>
 
+#include "mgwhelp.h"
+
+#include <algorithm>
+#include <set>
+
 
 static bool
 comparePath(const char *s1, const char *s2)
@@ -91,6 +96,34 @@ checkSym(HANDLE hProcess,
 }
 
 
+/*
+ * Get the displacement of an address from the start of the run of addresses
+ * before it on the same line, within the function, to which line
+ * displacements are relative.
+ */
+static DWORD
+getLineDisplacement(HANDLE hProcess,
+                    DWORD64 dwAddr,
+                    DWORD dwLineNumber,
+                    DWORD64 dwSymbolDisplacement)
+{
+    DWORD dwLineDisplacement = 0;
+    while (dwLineDisplacement < dwSymbolDisplacement) {
+        DWORD dwDisplacement;
+        IMAGEHLP_LINE64 Line;
+        ZeroMemory(&Line, sizeof Line);
+        Line.SizeOfStruct = sizeof Line;
+        if (!SymGetLineFromAddr64(hProcess, dwAddr - dwLineDisplacement - 1, &dwDisplacement,
+                                  &Line) ||
+            Line.LineNumber != dwLineNumber) {
+            break;
+        }
+        ++dwLineDisplacement;
+    }
+    return dwLineDisplacement;
+}
+
+
 static void
 checkSymLine(HANDLE hProcess,
              PVOID pvSymbol,
@@ -132,11 +165,60 @@ checkSymLine(HANDLE hProcess,
             test_diagnostic("LineNumber = %lu != %lu",
                             Line.LineNumber, dwLineNumber);
         }
-        ok = dwDisplacement == dwExpectDisplacement;
+        DWORD dwExpectLineDisplacement =
+            getLineDisplacement(hProcess, dwAddr, dwLineNumber, dwExpectDisplacement);
+        ok = dwDisplacement == dwExpectLineDisplacement;
         test_line(ok, "SymGetLineFromAddr64(&%s).Displacement", szSymbolName);
         if (!ok) {
-            test_diagnostic("Displacement = %lx != %I64x",
-                            dwDisplacement, dwExpectDisplacement);
+            test_diagnostic("Displacement = %lx != %lx",
+                            dwDisplacement, dwExpectLineDisplacement);
+        }
+    }
+
+    // Test MgwSymFromAddrEx
+    DWORD64 Displacement = -1;
+    struct {
+        SYMBOL_INFOW Symbol;
+        WCHAR Name[256];
+    } s;
+    memset(&s, 0, sizeof s);
+    s.Symbol.SizeOfStruct = sizeof s.Symbol;
+    s.Symbol.MaxNameLen = _countof(s.Symbol.Name) + _countof(s.Name);
+    MGW_LINEW64 LineW;
+    ZeroMemory(&LineW, sizeof LineW);
+    LineW.SizeOfStruct = sizeof LineW;
+    ok = MgwSymFromAddrEx(hProcess, dwAddr, &Displacement, &s.Symbol, &LineW);
+    test_line(ok, "MgwSymFromAddrEx(&%s)", szSymbolName);
+    if (!ok) {
+        test_diagnostic_last_error();
+    } else {
+        char szName[256];
+        WideCharToMultiByte(CP_ACP, 0, s.Symbol.Name, -1, szName, sizeof szName, NULL, NULL);
+        ok = strcmp(szName, szSymbolName) == 0;
+        test_line(ok, "MgwSymFromAddrEx(&%s).Name", szSymbolName);
+        if (!ok) {
+            test_diagnostic("Name = \"%s\" != \"%s\"",
+                            szName, szSymbolName);
+        }
+        ok = Displacement == dwExpectDisplacement;
+        test_line(ok, "MgwSymFromAddrEx(&%s).Displacement", szSymbolName);
+        if (!ok) {
+            test_diagnostic("Displacement = %I64x != %I64x",
+                            Displacement, dwExpectDisplacement);
+        }
+        char szLineFileName[MAX_PATH];
+        WideCharToMultiByte(CP_ACP, 0, LineW.FileName, -1, szLineFileName, sizeof szLineFileName, NULL, NULL);
+        ok = comparePath(szLineFileName, szFileName);
+        test_line(ok, "MgwSymFromAddrEx(&%s).FileName", szSymbolName);
+        if (!ok) {
+            test_diagnostic("FileName = \"%s\" != \"%s\"",
+                            szLineFileName, szFileName);
+        }
+        ok = LineW.LineNumber == dwLineNumber;
+        test_line(ok, "MgwSymFromAddrEx(&%s).LineNumber", szSymbolName);
+        if (!ok) {
+            test_diagnostic("LineNumber = %lu != %lu",
+                            LineW.LineNumber, dwLineNumber);
         }
     }
 }
@@ -168,6 +250,489 @@ checkExport(HANDLE hProcess,
 
 
 
+static void
+checkBatch(HANDLE hProcess,
+           PVOID pvSymbol1,
+           const char *szSymbolName1,
+           PVOID pvSymbol2,
+           const char *szSymbolName2)
+{
+    bool ok;
+
+    // Deliberately out of order, and with duplicates
+    DWORD64 Addresses[] = {
+        (DWORD64)(UINT_PTR)pvSymbol2,
+        (DWORD64)(UINT_PTR)pvSymbol1,
+        (DWORD64)(UINT_PTR)pvSymbol2,
+    };
+    const char *szSymbolNames[] = {
+        szSymbolName2,
+        szSymbolName1,
+        szSymbolName2,
+    };
+    MGW_SYMBOLW64 Symbols[_countof(Addresses)];
+
+    ULONG nFound = MgwSymFromAddrs(hProcess, _countof(Addresses), Addresses, Symbols);
+    ok = nFound == _countof(Addresses);
+    test_line(ok, "MgwSymFromAddrs()");
+    if (!ok) {
+        test_diagnostic("nFound = %lu != %u", nFound, (unsigned)_countof(Addresses));
+    }
+
+    for (unsigned i = 0; i < _countof(Addresses); ++i) {
+        char szName[MGW_MAX_SYM_NAME];
+        WideCharToMultiByte(CP_ACP, 0, Symbols[i].Name, -1, szName, sizeof szName, NULL, NULL);
+        if (!g_bStripped) {
+            ok = Symbols[i].Found && strcmp(szName, szSymbolNames[i]) == 0;
+        } else {
+            // XXX: ignore differences due to demangling
+            ok = Symbols[i].Found && strncmp(szSymbolNames[i], szName, strlen(szSymbolNames[i])) == 0;
+        }
+        test_line(ok, "MgwSymFromAddrs()[%u].Name", i);
+        if (!ok) {
+            test_diagnostic("Name = \"%s\" != \"%s\"",
+                            szName, szSymbolNames[i]);
+        }
+    }
+}
+
+
+struct ThreadParams {
+    HANDLE hProcess;
+    DWORD64 dwAddr;
+    const char *szSymbolName;
+    LONG nFailures;
+};
+
+
+static DWORD WINAPI
+threadProc(LPVOID lpParameter)
+{
+    ThreadParams *pParams = (ThreadParams *)lpParameter;
+
+    for (unsigned i = 0; i < 256; ++i) {
+        struct {
+            SYMBOL_INFOW Symbol;
+            WCHAR Name[256];
+        } s;
+        memset(&s, 0, sizeof s);
+        s.Symbol.SizeOfStruct = sizeof s.Symbol;
+        s.Symbol.MaxNameLen = _countof(s.Symbol.Name) + _countof(s.Name);
+        MGW_LINEW64 Line;
+        ZeroMemory(&Line, sizeof Line);
+        Line.SizeOfStruct = sizeof Line;
+        DWORD64 Displacement = -1;
+
+        char szName[256] = "";
+        if (MgwSymFromAddrEx(pParams->hProcess, pParams->dwAddr, &Displacement, &s.Symbol, &Line)) {
+            WideCharToMultiByte(CP_ACP, 0, s.Symbol.Name, -1, szName, sizeof szName, NULL, NULL);
+        }
+        if (strncmp(szName, pParams->szSymbolName, strlen(pParams->szSymbolName)) != 0) {
+            InterlockedIncrement(&pParams->nFailures);
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+checkThreads(HANDLE hProcess,
+             PVOID pvSymbol,
+             const char *szSymbolName)
+{
+    ThreadParams params;
+    params.hProcess = hProcess;
+    params.dwAddr = (DWORD64)(UINT_PTR)pvSymbol;
+    params.szSymbolName = szSymbolName;
+    params.nFailures = 0;
+
+    HANDLE hThreads[4];
+    for (unsigned i = 0; i < _countof(hThreads); ++i) {
+        hThreads[i] = CreateThread(NULL, 0, threadProc, &params, 0, NULL);
+        assert(hThreads[i]);
+    }
+    WaitForMultipleObjects(_countof(hThreads), hThreads, TRUE, INFINITE);
+    for (unsigned i = 0; i < _countof(hThreads); ++i) {
+        CloseHandle(hThreads[i]);
+    }
+
+    bool ok = params.nFailures == 0;
+    test_line(ok, "MgwSymFromAddrEx(&%s) from multiple threads", szSymbolName);
+    if (!ok) {
+        test_diagnostic("nFailures = %ld", params.nFailures);
+    }
+}
+
+
+static void
+checkResultCache(HANDLE hProcess,
+                 PVOID pvSymbol,
+                 const char *szSymbolName,
+                 const char *szFileName,
+                 DWORD dwLineNumber)
+{
+    bool ok;
+
+    MGW_STATS Before;
+    Before.SizeOfStruct = sizeof Before;
+    MgwSymGetStats(hProcess, 0, &Before);
+
+    checkSymLine(hProcess, pvSymbol, szSymbolName, szFileName, dwLineNumber, 0);
+
+    MGW_STATS After;
+    After.SizeOfStruct = sizeof After;
+    MgwSymGetStats(hProcess, 0, &After);
+
+    // Repeated lookups must not go back to DWARF
+    ok = After.DwarfLookups == Before.DwarfLookups && After.Demangles == Before.Demangles;
+    test_line(ok, "MgwSymFromAddrEx(&%s) from the result cache", szSymbolName);
+    if (!ok) {
+        test_diagnostic("DwarfLookups = %I64u != %I64u", After.DwarfLookups, Before.DwarfLookups);
+    }
+}
+
+
+static void
+checkUnDecorate(const char *szDecoratedName, DWORD dwFlags, const char *szExpectName)
+{
+    char szName[256] = "";
+    DWORD dwRet = UnDecorateSymbolName(szDecoratedName, szName, sizeof szName, dwFlags);
+    bool ok = dwRet == strlen(szName) && strcmp(szName, szExpectName) == 0;
+    test_line(ok, "UnDecorateSymbolName(\"%s\", 0x%lx)", szDecoratedName, dwFlags);
+    if (!ok) {
+        test_diagnostic("Name = \"%s\" != \"%s\" (%lu)", szName, szExpectName, dwRet);
+    }
+
+    WCHAR szDecoratedNameW[256];
+    WCHAR szExpectNameW[256];
+    MultiByteToWideChar(CP_UTF8, 0, szDecoratedName, -1, szDecoratedNameW,
+                        _countof(szDecoratedNameW));
+    MultiByteToWideChar(CP_UTF8, 0, szExpectName, -1, szExpectNameW, _countof(szExpectNameW));
+
+    WCHAR szNameW[256] = L"";
+    dwRet = UnDecorateSymbolNameW(szDecoratedNameW, szNameW, _countof(szNameW), dwFlags);
+    ok = dwRet == wcslen(szNameW) && wcscmp(szNameW, szExpectNameW) == 0;
+    test_line(ok, "UnDecorateSymbolNameW(\"%s\", 0x%lx)", szDecoratedName, dwFlags);
+    if (!ok) {
+        test_diagnostic("Name = \"%S\" != \"%s\" (%lu)", szNameW, szExpectName, dwRet);
+    }
+}
+
+
+static void
+checkFromName(HANDLE hProcess, const char *szName, PVOID pvSymbol)
+{
+    bool ok;
+
+    DWORD64 dwAddr = (DWORD64)(UINT_PTR)pvSymbol;
+
+    struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[256];
+    } s;
+    memset(&s, 0, sizeof s);
+    s.Symbol.SizeOfStruct = sizeof s.Symbol;
+    s.Symbol.MaxNameLen = sizeof s.Symbol.Name + sizeof s.Name;
+    ok = SymFromName(hProcess, szName, &s.Symbol);
+    test_line(ok, "SymFromName(\"%s\")", szName);
+    if (!ok) {
+        test_diagnostic_last_error();
+    } else {
+        ok = s.Symbol.Address == dwAddr;
+        test_line(ok, "SymFromName(\"%s\").Address", szName);
+        if (!ok) {
+            test_diagnostic("Address = %I64x != %I64x", s.Symbol.Address, dwAddr);
+        }
+    }
+}
+
+
+struct EnumSymbolsParams {
+    DWORD64 dwAddr;
+    bool bFound;
+};
+
+
+static BOOL CALLBACK
+enumSymbolsCallback(PSYMBOL_INFO pSymInfo, ULONG SymbolSize, PVOID UserContext)
+{
+    EnumSymbolsParams *pParams = (EnumSymbolsParams *)UserContext;
+    if (pSymInfo->Address == pParams->dwAddr) {
+        pParams->bFound = true;
+    }
+    return TRUE;
+}
+
+
+static void
+checkEnumSymbols(HANDLE hProcess, const char *szMask, PVOID pvSymbol)
+{
+    EnumSymbolsParams params;
+    params.dwAddr = (DWORD64)(UINT_PTR)pvSymbol;
+    params.bFound = false;
+    bool ok = SymEnumSymbols(hProcess, 0, szMask, enumSymbolsCallback, &params) && params.bFound;
+    test_line(ok, "SymEnumSymbols(\"%s\")", szMask);
+}
+
+
+static BOOL CALLBACK
+collectAddressesCallback(PSYMBOL_INFO pSymInfo, ULONG SymbolSize, PVOID UserContext)
+{
+    std::set<DWORD64> *pAddresses = (std::set<DWORD64> *)UserContext;
+    pAddresses->insert(pSymInfo->Address);
+    return TRUE;
+}
+
+
+typedef BOOL(WINAPI *PFN_SYMENUMSYMBOLS)(HANDLE, ULONG64, PCSTR, PSYM_ENUMERATESYMBOLS_CALLBACK,
+                                         PVOID);
+
+
+/*
+ * Check that the symbols of a module without DWARF or COFF symbols are
+ * enumerated at least as completely as DbgHelp itself does.
+ */
+static void
+checkEnumDbgHelpSymbols(HANDLE hProcess, ULONG64 BaseOfDll, const char *szMask)
+{
+    PFN_SYMENUMSYMBOLS pfnSymEnumSymbols =
+        (PFN_SYMENUMSYMBOLS)GetProcAddress(GetModuleHandleA("dbghelp.dll"), "SymEnumSymbols");
+    if (!pfnSymEnumSymbols) {
+        test_line(false, "GetProcAddress(\"SymEnumSymbols\")");
+        return;
+    }
+
+    std::set<DWORD64> Expected;
+    pfnSymEnumSymbols(hProcess, BaseOfDll, szMask, collectAddressesCallback, &Expected);
+
+    std::set<DWORD64> Actual;
+    bool ok = SymEnumSymbols(hProcess, BaseOfDll, szMask, collectAddressesCallback, &Actual);
+    ok = ok && !Expected.empty() &&
+         std::includes(Actual.begin(), Actual.end(), Expected.begin(), Expected.end());
+    test_line(ok, "SymEnumSymbols(0x%I64x, \"%s\")", BaseOfDll, szMask);
+    if (!ok) {
+        test_diagnostic("%u symbols, DbgHelp enumerated %u", (unsigned)Actual.size(),
+                        (unsigned)Expected.size());
+    }
+}
+
+
+typedef BOOL(WINAPI *PFN_SYMFROMADDR)(HANDLE, DWORD64, PDWORD64, PSYMBOL_INFO);
+
+
+static bool
+hasPdb(HANDLE hProcess, HMODULE hModule)
+{
+    IMAGEHLP_MODULEW64 ModuleInfo;
+    ZeroMemory(&ModuleInfo, sizeof ModuleInfo);
+    ModuleInfo.SizeOfStruct = sizeof ModuleInfo;
+    return SymGetModuleInfoW64(hProcess, (DWORD64)(UINT_PTR)hModule, &ModuleInfo) &&
+           ModuleInfo.SymType == SymPdb;
+}
+
+
+/*
+ * Check that the symbols of a module DbgHelp has a PDB for are those of
+ * DbgHelp, rather than the nearest exports, at addresses past an export,
+ * most of which lie in functions that aren't exported.
+ */
+static void
+checkPdbSymbols(HANDLE hProcess, const char *szModuleName, const char *szSymbolName)
+{
+    PFN_SYMFROMADDR pfnSymFromAddr =
+        (PFN_SYMFROMADDR)GetProcAddress(GetModuleHandleA("dbghelp.dll"), "SymFromAddr");
+    if (!pfnSymFromAddr) {
+        test_line(false, "GetProcAddress(\"SymFromAddr\")");
+        return;
+    }
+
+    HMODULE hModule = GetModuleHandleA(szModuleName);
+    DWORD64 dwSymbolAddr = (DWORD64)(UINT_PTR)GetProcAddress(hModule, szSymbolName);
+
+    struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[512];
+    } expected, actual;
+
+    unsigned nChecked = 0;
+    unsigned nMismatches = 0;
+    for (unsigned i = 0; i < 64; ++i) {
+        DWORD64 dwAddr = dwSymbolAddr + i * 0x40;
+
+        ZeroMemory(&expected, sizeof expected);
+        expected.Symbol.SizeOfStruct = sizeof expected.Symbol;
+        expected.Symbol.MaxNameLen = sizeof expected.Symbol.Name + sizeof expected.Name;
+        DWORD64 dwExpectedDisplacement = 0;
+        // Also loads the module's symbols, when deferred
+        if (!pfnSymFromAddr(hProcess, dwAddr, &dwExpectedDisplacement, &expected.Symbol)) {
+            continue;
+        }
+        if (!hasPdb(hProcess, hModule)) {
+            test_diagnostic("no PDB for %s", szModuleName);
+            return;
+        }
+
+        ZeroMemory(&actual, sizeof actual);
+        actual.Symbol.SizeOfStruct = sizeof actual.Symbol;
+        actual.Symbol.MaxNameLen = sizeof actual.Symbol.Name + sizeof actual.Name;
+        DWORD64 dwDisplacement = 0;
+        if (!SymFromAddr(hProcess, dwAddr, &dwDisplacement, &actual.Symbol) ||
+            strcmp(actual.Symbol.Name, expected.Symbol.Name) != 0 ||
+            dwDisplacement != dwExpectedDisplacement) {
+            test_diagnostic("0x%I64x: %s+0x%I64x != %s+0x%I64x", dwAddr, actual.Symbol.Name,
+                            dwDisplacement, expected.Symbol.Name, dwExpectedDisplacement);
+            ++nMismatches;
+        }
+        ++nChecked;
+    }
+
+    test_line(nChecked > 0 && nMismatches == 0, "SymFromAddr() in %s from its PDB",
+              szModuleName);
+}
+
+
+static PVOID
+    __attribute__ ((noinline))
+getReturnAddress(void)
+{
+    return __builtin_return_address(0);
+}
+
+
+/*
+ * Static function whose symbol is stripped from test_mgwhelp_stripped, so
+ * that only its extents, from .pdata or the CFI, are known there.
+ */
+static PVOID
+    __attribute__ ((noinline))
+strippedFunction(void)
+{
+    PVOID pvAddress = getReturnAddress();
+    rand(); // not a tail call
+    return pvAddress;
+}
+
+
+/*
+ * Check that an address inside a function without a symbol of its own is
+ * named after the function's preferred virtual address, and displaced from
+ * the function's start, rather than from the nearest symbol.
+ */
+static void
+checkStrippedFunction(HANDLE hProcess)
+{
+    PVOID pvAddress = strippedFunction();
+
+    HMODULE hModule = GetModuleHandleA(NULL);
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hModule;
+    PIMAGE_NT_HEADERS pNtHeaders = (PIMAGE_NT_HEADERS)((PBYTE)hModule + pDosHeader->e_lfanew);
+    DWORD64 dwStart = (DWORD64)(UINT_PTR)&strippedFunction;
+    DWORD64 dwPreferredStart =
+        pNtHeaders->OptionalHeader.ImageBase + (dwStart - (DWORD64)(UINT_PTR)hModule);
+
+    char szSymbolName[32];
+    snprintf(szSymbolName, sizeof szSymbolName, "sub_%I64X", dwPreferredStart);
+    checkSym(hProcess, pvAddress, szSymbolName, (DWORD64)(UINT_PTR)pvAddress - dwStart);
+}
+
+
+static const DWORD inlineHelper_line = __LINE__ + 4;
+static inline PVOID
+    __attribute__ ((always_inline))
+inlineHelper(void)
+{
+    return getReturnAddress();
+}
+
+
+static PVOID
+    __attribute__ ((noinline))
+inlineCaller(void)
+{
+    return inlineHelper();
+}
+
+
+static void
+checkInline(HANDLE hProcess)
+{
+    bool ok;
+
+    // Within the call instruction, as the return address may lie past the
+    // inlined code
+    DWORD64 dwAddr = (DWORD64)(UINT_PTR)inlineCaller() - 1;
+
+    DWORD dwInlineFrames = MgwSymAddrIncludeInlineTrace(hProcess, dwAddr);
+    ok = dwInlineFrames > 0;
+    test_line(ok, "SymAddrIncludeInlineTrace(&inlineHelper)");
+    if (!ok) {
+        return;
+    }
+
+    DWORD dwContext = INLINE_FRAME_CONTEXT_INIT;
+    DWORD dwFrameIndex = 0;
+    ok = MgwSymQueryInlineTrace(hProcess, dwAddr, INLINE_FRAME_CONTEXT_INIT, dwAddr, dwAddr,
+                                &dwContext, &dwFrameIndex) &&
+         dwContext != INLINE_FRAME_CONTEXT_INIT && dwContext != INLINE_FRAME_CONTEXT_IGNORE;
+    test_line(ok, "SymQueryInlineTrace(&inlineHelper)");
+    if (!ok) {
+        test_diagnostic("Context = 0x%lx", dwContext);
+        return;
+    }
+
+    struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[256];
+    } s;
+    memset(&s, 0, sizeof s);
+    s.Symbol.SizeOfStruct = sizeof s.Symbol;
+    s.Symbol.MaxNameLen = sizeof s.Symbol.Name + sizeof s.Name;
+    DWORD64 Displacement = -1;
+    ok = MgwSymFromInlineContext(hProcess, dwAddr, dwContext, &Displacement, &s.Symbol);
+    test_line(ok, "SymFromInlineContext(&inlineHelper)");
+    if (!ok) {
+        test_diagnostic_last_error();
+    } else {
+        ok = strcmp(s.Symbol.Name, "inlineHelper") == 0 &&
+             s.Symbol.NameLen == strlen(s.Symbol.Name);
+        test_line(ok, "SymFromInlineContext(&inlineHelper).Name");
+        if (!ok) {
+            test_diagnostic("Name = \"%s\" != \"inlineHelper\"", s.Symbol.Name);
+        }
+    }
+
+    DWORD dwDisplacement;
+    IMAGEHLP_LINE64 Line;
+    ZeroMemory(&Line, sizeof Line);
+    Line.SizeOfStruct = sizeof Line;
+    ok = MgwSymGetLineFromInlineContext(hProcess, dwAddr, dwContext, 0, &dwDisplacement, &Line);
+    test_line(ok, "SymGetLineFromInlineContext(&inlineHelper)");
+    if (!ok) {
+        test_diagnostic_last_error();
+    } else {
+        ok = comparePath(Line.FileName, __FILE__);
+        test_line(ok, "SymGetLineFromInlineContext(&inlineHelper).FileName");
+        if (!ok) {
+            test_diagnostic("FileName = \"%s\" != \"%s\"", Line.FileName, __FILE__);
+        }
+        ok = Line.LineNumber == inlineHelper_line;
+        test_line(ok, "SymGetLineFromInlineContext(&inlineHelper).LineNumber");
+        if (!ok) {
+            test_diagnostic("LineNumber = %lu != %lu", Line.LineNumber, inlineHelper_line);
+        }
+    }
+
+    // The outermost context is the function everything was inlined into
+    ok = MgwSymFromInlineContext(hProcess, dwAddr, dwInlineFrames + 1, &Displacement, &s.Symbol) &&
+         strcmp(s.Symbol.Name, "inlineCaller") == 0;
+    test_line(ok, "SymFromInlineContext(&inlineCaller)");
+    if (!ok) {
+        test_diagnostic("Name = \"%s\" != \"inlineCaller\"", s.Symbol.Name);
+    }
+}
+
+
 static const DWORD foo_line = __LINE__; static int foo(int a, int b) {
     return a * b;
 }
@@ -196,6 +761,8 @@ main(int argc, char **argv)
         test_line(GetProcAddress(hMgwHelpDll, "EnumDirTree@24") == NULL, "!GetProcAddress(\"EnumDirTree\")");
         test_line(GetProcAddress(hMgwHelpDll, "SymGetOptions") != NULL, "GetProcAddress(\"SymGetOptions\")");
         test_line(GetProcAddress(hMgwHelpDll, "SymGetOptions@0") == NULL, "!GetProcAddress(\"SymGetOptions\")");
+        test_line(GetProcAddress(hMgwHelpDll, "SymAddrIncludeInlineTrace") != NULL, "GetProcAddress(\"SymAddrIncludeInlineTrace\")");
+        test_line(GetProcAddress(hMgwHelpDll, "SymAddrIncludeInlineTrace@12") == NULL, "!GetProcAddress(\"SymAddrIncludeInlineTrace\")");
     }
 
     ok = SymInitialize(hProcess, "", TRUE);
@@ -203,14 +770,68 @@ main(int argc, char **argv)
     if (!ok) {
         test_diagnostic_last_error();
     } {
+        ok = MgwSymPrewarmModule(hProcess, (DWORD64)(UINT_PTR)GetModuleHandleA(NULL));
+        test_line(ok, "MgwSymPrewarmModule()");
+
         checkSymLine(hProcess, (PVOID)&foo, "foo", __FILE__, foo_line, 0);
 
         checkCaller(hProcess, (PVOID)&main, "main", __FILE__, __LINE__); LINE_BARRIER
 
-        // Test DbgHelp fallback
+        checkBatch(hProcess, (PVOID)&foo, "foo", (PVOID)&main, "main");
+
+        checkThreads(hProcess, (PVOID)&foo, "foo");
+
+        checkUnDecorate("_Z3fooii", UNDNAME_COMPLETE, "foo(int, int)");
+        checkUnDecorate("_ZN2ns3barIiEEvT_", UNDNAME_NAME_ONLY, "ns::bar<int>");
+
+        if (!g_bStripped) {
+            checkResultCache(hProcess, (PVOID)&foo, "foo", __FILE__, foo_line);
+
+            checkFromName(hProcess, "foo", (PVOID)&foo);
+            checkEnumSymbols(hProcess, "*!f?o", (PVOID)&foo);
+
+            checkInline(hProcess);
+        } else {
+            checkStrippedFunction(hProcess);
+        }
+
+        MGW_STATS Stats;
+        Stats.SizeOfStruct = sizeof Stats;
+        ok = MgwSymGetStats(hProcess, 0, &Stats);
+        test_line(ok && Stats.DwarfLookups + Stats.PeLookups + Stats.DbgHelpLookups > 0,
+                  "MgwSymGetStats()");
+
+        // Test export fallback, which must not involve DbgHelp, unless it
+        // has a PDB for the module
         // XXX: Doesn't work reliably on Wine
         if (!insideWine()) {
+            bool bPdb = hasPdb(hProcess, GetModuleHandleA("kernel32"));
+
+            MGW_STATS Before;
+            Before.SizeOfStruct = sizeof Before;
+            MgwSymGetStats(hProcess, 0, &Before);
+
             checkExport(hProcess, "kernel32", "Sleep");
+
+            MGW_STATS After;
+            After.SizeOfStruct = sizeof After;
+            MgwSymGetStats(hProcess, 0, &After);
+            if (bPdb) {
+                test_line(After.DbgHelpLookups > Before.DbgHelpLookups,
+                          "SymFromAddr(&Sleep) from the PDB");
+            } else {
+                test_line(After.DbgHelpLookups == Before.DbgHelpLookups,
+                          "SymFromAddr(&Sleep) from the exports");
+            }
+
+            // Modules DbgHelp has PDBs for are named by DbgHelp
+            checkPdbSymbols(hProcess, "kernel32", "Sleep");
+            checkPdbSymbols(hProcess, "ntdll", "RtlAllocateHeap");
+
+            // Modules without DWARF or COFF symbols are enumerated by DbgHelp too
+            checkEnumDbgHelpSymbols(hProcess, (DWORD64)(UINT_PTR)GetModuleHandleA("kernel32"),
+                                    "*");
+            checkEnumDbgHelpSymbols(hProcess, 0, "kernel32!*");
         }
 
         ok = SymCleanup(hProcess);
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2026 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Reaching the result cache bounds through MgwHelp would take looking up
+ * hundreds of thousands of distinct functions, so the cache is tested on its
+ * own.
+ */
+
+
+#include "tap.h"
+
+#include <string.h>
+#include <wchar.h>
+
+#include <string>
+
+#include "result_cache.h"
+
+
+static void
+setEntry(struct result_cache_entry *entry,
+         std::wstring &Name,
+         std::string &NameA,
+         unsigned i)
+{
+    Name = L"f" + std::to_wstring(i);
+    NameA = "f" + std::to_string(i);
+
+    ZeroMemory(entry, sizeof *entry);
+    entry->Name = Name.c_str();
+    entry->UndName = Name.c_str();
+    entry->FileName = L"file.c";
+    entry->LineNumber = i;
+    entry->NameA = NameA.c_str();
+    entry->UndNameA = NameA.c_str();
+    entry->FileNameA = "file.c";
+}
+
+
+/*
+ * Insert the results of addresses [First, First + Count), each with its own
+ * names if bDistinct, plus as many other strings, and count how many are
+ * found right after.  Stop early once the result of StopAddress is evicted.
+ */
+static unsigned
+insertEntries(struct result_cache *cache,
+              unsigned First,
+              unsigned Count,
+              bool bDistinct,
+              DWORD64 StopAddress = ~0ULL)
+{
+    unsigned hits = 0;
+    for (unsigned i = First; i < First + Count; ++i) {
+        std::wstring Name;
+        std::string NameA;
+        struct result_cache_entry entry;
+        setEntry(&entry, Name, NameA, bDistinct ? i : 0);
+        result_cache_insert(cache, i, &entry);
+
+        struct result_cache_entry found;
+        if (result_cache_lookup(cache, i, &found) &&
+            wcscmp(found.Name, Name.c_str()) == 0 &&
+            strcmp(found.NameA, NameA.c_str()) == 0) {
+            ++hits;
+        }
+
+        if (bDistinct) {
+            result_cache_intern_string(cache, (L"inline" + Name).c_str());
+            result_cache_intern_string(cache, ("inline" + NameA).c_str());
+        }
+
+        if (StopAddress != ~0ULL && !result_cache_lookup(cache, StopAddress, &found)) {
+            break;
+        }
+    }
+    return hits;
+}
+
+
+int
+main()
+{
+    const unsigned Count = 2 * RESULT_CACHE_MAX_ENTRIES + 1;
+    struct result_cache *cache;
+    unsigned hits;
+
+    // Past the entries bound, with few strings
+    cache = new result_cache;
+    hits = insertEntries(cache, 0, Count, false);
+    test_line(hits == Count, "%u of %u results past the entries bound", hits, Count);
+    delete cache;
+
+    // Past the strings bound, which every result and the strings interned
+    // along with it reach before the entries bound
+    cache = new result_cache;
+    hits = insertEntries(cache, 0, Count, true);
+    test_line(hits == Count, "%u of %u results past the strings bound", hits, Count);
+
+    const wchar_t *FileName = result_cache_intern_string(cache, L"inline.c");
+    const char *FileNameA = result_cache_intern_string(cache, "inline.c");
+    test_line(FileName && wcscmp(FileName, L"inline.c") == 0 &&
+              FileNameA && strcmp(FileNameA, "inline.c") == 0,
+              "result_cache_intern_string() past the strings bound");
+
+    // Strings handed out remain valid after their results are evicted
+    std::wstring Name;
+    std::string NameA;
+    struct result_cache_entry entry;
+    setEntry(&entry, Name, NameA, Count);
+    result_cache_insert(cache, Count, &entry);
+    bool ok = result_cache_lookup(cache, Count, &entry);
+    test_line(ok, "result_cache_lookup(%u)", Count);
+    if (ok) {
+        insertEntries(cache, Count + 1, RESULT_CACHE_MAX_ENTRIES, true, Count);
+        struct result_cache_entry found;
+        ok = !result_cache_lookup(cache, Count, &found);
+        test_line(ok, "result_cache_lookup(%u) after eviction", Count);
+        ok = wcscmp(entry.Name, Name.c_str()) == 0 && strcmp(entry.NameA, NameA.c_str()) == 0;
+        test_line(ok, "names valid after eviction");
+    }
+    delete cache;
+
+    test_exit();
+}